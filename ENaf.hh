@@ -14,17 +14,27 @@
 
 //core
 #include "./inc/EIoBuffer.hh"
+#include "./inc/EIoBufferChain.hh"
 #include "./inc/EIoFilter.hh"
 #include "./inc/EIoFilterAdapter.hh"
 #include "./inc/EIoFilterChain.hh"
 #include "./inc/EIoFilterChainBuilder.hh"
 #include "./inc/EIoService.hh"
 #include "./inc/EIoSession.hh"
+#include "./inc/EIoTrace.hh"
 #include "./inc/ESubnet.hh"
+#include "./inc/ESubnetTrie.hh"
+#include "./inc/ESubnetFileWatcher.hh"
+#include "./inc/ERcuReference.hh"
+#include "./inc/EWakeSignal.hh"
 #include "./inc/ESocketSession.hh"
 #include "./inc/ESocketAcceptor.hh"
 #include "./inc/EBlacklistFilter.hh"
 #include "./inc/EWhitelistFilter.hh"
+#include "./inc/ERateLimitFilter.hh"
+#include "./inc/ECompressionFilter.hh"
+#include "./inc/ELengthFieldCodecFilter.hh"
+#include "./inc/EExecutorFilter.hh"
 
 using namespace efc::naf;
 
@@ -47,6 +47,11 @@ public:
 	 * @param trailers supplies the trailers to encode.
 	 */
 	virtual void encodeTrailers(const HeaderMap& trailers) = 0;
+
+	/**
+	 * @return Stream& the backing stream.
+	 */
+	virtual Stream& getStream() = 0;
 };
 
 /**
@@ -104,6 +109,33 @@ enum class StreamResetReason {
 	Overflow
 };
 
+/**
+ * Callbacks that fire against a stream.
+ */
+class StreamCallbacks {
+public:
+	virtual ~StreamCallbacks() {
+	}
+
+	/**
+	 * Fires when a stream has been reset.
+	 * @param reason supplies the reset reason.
+	 */
+	virtual void onResetStream(StreamResetReason reason) = 0;
+
+	/**
+	 * Fires before the codec frees a stream which was not reset, e.g. once its response is written.
+	 * The stream must not be used afterwards.
+	 */
+	virtual void onStreamDestroyed() {}
+
+	/**
+	 * Fires when buffered data of the stream has been handed to the connection, so that
+	 * Stream::bufferedBytes() went down.
+	 */
+	virtual void onBufferedDataSent() {}
+};
+
 /**
  * An HTTP stream (request, response, and push).
  */
@@ -112,6 +144,18 @@ public:
 	virtual ~Stream() {
 	}
 
+	/**
+	 * Add stream callbacks.
+	 * @param callbacks supplies the callbacks to fire on stream events.
+	 */
+	virtual void addCallbacks(StreamCallbacks& callbacks) = 0;
+
+	/**
+	 * Remove stream callbacks.
+	 * @param callbacks supplies the callbacks to remove.
+	 */
+	virtual void removeCallbacks(StreamCallbacks& callbacks) = 0;
+
 	/**
 	 * Reset the stream. No events will fire beyond this point.
 	 * @param reason supplies the reset reason.
@@ -122,9 +166,19 @@ public:
 	 * Enable/disable further data from this stream.
 	 * Cessation of data may not be immediate. For example, for HTTP/2 this may stop further flow
 	 * control window updates which will result in the peer eventually stopping sending data.
+	 * For HTTP/1.1 the connection is not parsed further, for HTTP/2 the received data is not
+	 * given back to the peer window. The calls are counted, each disable needs an enable.
 	 * @param disable informs if reads should be disabled (true) or re-enabled (false).
 	 */
-//  virtual void readDisable(bool disable) = 0;
+	virtual void readDisable(bool disable) = 0;
+
+	/**
+	 * Return the number of bytes encoded for this stream but not yet handed to the connection,
+	 * e.g. held behind earlier pipelined responses or by the HTTP/2 flow control window.
+	 * @return uint64_t the buffered bytes of the stream.
+	 */
+	virtual uint64_t bufferedBytes() = 0;
+
 	/*
 	 * Return the number of bytes this stream is allowed to buffer, or 0 if there is no limit
 	 * configured.
@@ -158,6 +212,11 @@ struct Http1Settings {
 	bool accept_http_10_ { false };
 	// Set a default host if no Host: header is present for HTTP/1.0 requests.`
 	std::string default_host_for_http_10_;
+	// Max pipelined requests of a connection in flight, the parser stops reading ahead at it.
+	uint32_t max_pipeline_depth_ { DEFAULT_MAX_PIPELINE_DEPTH };
+
+	static const uint32_t MIN_MAX_PIPELINE_DEPTH = 1;
+	static const uint32_t DEFAULT_MAX_PIPELINE_DEPTH = 16;
 };
 
 /**
@@ -170,6 +229,9 @@ struct Http2Settings {
 	uint32_t initial_stream_window_size_ { DEFAULT_INITIAL_STREAM_WINDOW_SIZE };
 	uint32_t initial_connection_window_size_ {
 			DEFAULT_INITIAL_CONNECTION_WINDOW_SIZE };
+	// the percent of a stream or connection window received and consumed before it is given back
+	// to the peer by one WINDOW_UPDATE.
+	uint32_t window_update_threshold_ { DEFAULT_WINDOW_UPDATE_THRESHOLD };
 
 	// disable HPACK compression
 	static const uint32_t MIN_HPACK_TABLE_SIZE = 0;
@@ -191,11 +253,11 @@ struct Http2Settings {
 	// initial value from HTTP/2 spec, same as NGHTTP2_INITIAL_WINDOW_SIZE from nghttp2
 	// NOTE: we only support increasing window size now, so this is also the minimum
 	// TODO(jwfang): make this 0 to support decrease window size
-	static const uint32_t MIN_INITIAL_STREAM_WINDOW_SIZE = (1 << 3) - 1;
+	static const uint32_t MIN_INITIAL_STREAM_WINDOW_SIZE = (1 << 16) - 1;
 	// initial value from HTTP/2 spec is 65535, but we want more (256MiB)
-	static const uint32_t DEFAULT_INITIAL_STREAM_WINDOW_SIZE = 16; //256 * 1024 * 1024;
+	static const uint32_t DEFAULT_INITIAL_STREAM_WINDOW_SIZE = 256 * 1024 * 1024;
 	// maximum from HTTP/2 spec, same as NGHTTP2_MAX_WINDOW_SIZE from nghttp2
-	static const uint32_t MAX_INITIAL_STREAM_WINDOW_SIZE = (1U << 5) - 1;
+	static const uint32_t MAX_INITIAL_STREAM_WINDOW_SIZE = (1U << 31) - 1;
 
 	// CONNECTION_WINDOW_SIZE is similar to STREAM_WINDOW_SIZE, but for connection-level window
 	// TODO(jwfang): make this 0 to support decrease window size
@@ -205,6 +267,12 @@ struct Http2Settings {
 	static const uint32_t DEFAULT_INITIAL_CONNECTION_WINDOW_SIZE = 256 * 1024
 			* 1024;
 	static const uint32_t MAX_INITIAL_CONNECTION_WINDOW_SIZE = (1U << 31) - 1;
+
+	// a WINDOW_UPDATE per DATA frame at the minimum, nghttp2 gives back half of the window by default
+	static const uint32_t MIN_WINDOW_UPDATE_THRESHOLD = 1;
+	static const uint32_t DEFAULT_WINDOW_UPDATE_THRESHOLD = 50;
+	// the peer must not stall on a closed window before the update arrives
+	static const uint32_t MAX_WINDOW_UPDATE_THRESHOLD = 90;
 };
 
 /**
@@ -232,6 +300,12 @@ public:
 	 */
 	virtual Protocol protocol() = 0;
 
+	/**
+	 * Called when the underlying connection was closed, possibly by another fiber, to wake a
+	 * dispatch which waits for the response side.
+	 */
+	virtual void onConnectionClosed() {}
+
 	/**
 	 * Indicate a "shutdown notice" to the remote. This is a hint that the remote should not send
 	 * any new streams, but if streams do arrive that will not be reset.
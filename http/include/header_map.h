@@ -9,6 +9,8 @@
 #include <memory>
 #include <string>
 
+#include "./method.h"
+
 namespace efc {
 namespace naf {
 namespace Http {
@@ -95,8 +97,8 @@ public:
 	std::string getString() const {return std::string(buffer_.ref_, string_length_);}
 
 	/**
-	 * Return the string to a default state. Reference strings are not touched. Both inline/dynamic
-	 * strings are reset to zero size.
+	 * Return the string to a default state. Reference strings become empty inline strings, the
+	 * referenced memory is not touched. Both inline/dynamic strings are reset to zero size.
 	 */
 	void clear();
 
@@ -152,6 +154,14 @@ public:
 	 */
 	void setReference(const std::string& ref_value);
 
+	/**
+	 * Set the value of the string to a reference of a memory span.
+	 * @param data MUST be null terminated and live beyond the lifetime of the string, e.g. it is in
+	 *        the arena of the header map which owns the string.
+	 * @param size supplies the size of the span, not including the null terminator.
+	 */
+	void setReference(const char* data, uint32_t size);
+
 	/**
 	 * @return the size of the string, not including the null terminator.
 	 */
@@ -467,6 +477,18 @@ public:
 	 * @return the number of headers in the map.
 	 */
 	virtual size_t size() const = 0;
+
+	/**
+	 * @return Method the :method of a request map as classified by the codec which decoded it, so
+	 * that upper layers dispatch on it without string compares. Method::Other if not classified.
+	 */
+	virtual Method method() const = 0;
+
+	/**
+	 * Set the classified :method, it is not checked against the :method header.
+	 * @param method supplies the method.
+	 */
+	virtual void setMethod(Method method) = 0;
 };
 
 typedef sp<HeaderMap> HeaderMapPtr;
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+namespace efc {
+namespace naf {
+namespace Http {
+
+/**
+ * Request methods the codecs classify the :method header into, Other for the extension methods.
+ * The parallel NumMethods constant allows defining fixed arrays for each method, e.g. a dispatch
+ * table, but does not pollute the enum.
+ */
+enum class Method { Get, Head, Post, Put, Delete, Options, Trace, Patch, Connect, Other };
+const size_t NumMethods = 10;
+
+} // namespace http
+} // namespace naf
+} // namespace efc
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include "../include/codec.h"
+
+namespace efc {
+namespace naf {
+namespace Http {
+
+class StreamCallbackHelper {
+public:
+	void runResetCallbacks(StreamResetReason reason) {
+		// Reset callbacks are a special case, and the only StreamCallbacks allowed
+		// to run after resetCallbacksRun_ is set.
+		if (reset_callbacks_run_) {
+			return;
+		}
+
+		for (StreamCallbacks* callbacks : callbacks_) {
+			if (callbacks) {
+				callbacks->onResetStream(reason);
+			}
+		}
+		reset_callbacks_run_ = true;
+	}
+
+	void runBufferedDataSentCallbacks() {
+		if (reset_callbacks_run_) {
+			return;
+		}
+
+		for (StreamCallbacks* callbacks : callbacks_) {
+			if (callbacks) {
+				callbacks->onBufferedDataSent();
+			}
+		}
+	}
+
+	void runDestroyCallbacks() {
+		// After a reset the callbacks know the stream is gone already.
+		if (reset_callbacks_run_) {
+			return;
+		}
+
+		std::vector<StreamCallbacks*> callbacks;
+		callbacks.swap(callbacks_);
+		for (StreamCallbacks* callback : callbacks) {
+			if (callback) {
+				callback->onStreamDestroyed();
+			}
+		}
+	}
+
+protected:
+	void addCallbacks_(StreamCallbacks& callbacks) {
+		callbacks_.push_back(&callbacks);
+	}
+
+	void removeCallbacks_(StreamCallbacks& callbacks) {
+		// For performance reasons we just clear the callback and do not resize the vector.
+		// Reset callbacks scale with the number of filters per request and do not get added and
+		// removed multiple times.
+		for (size_t i = 0; i < callbacks_.size(); i++) {
+			if (callbacks_[i] == &callbacks) {
+				callbacks_[i] = nullptr;
+				return;
+			}
+		}
+	}
+
+private:
+	std::vector<StreamCallbacks*> callbacks_;
+	bool reset_callbacks_run_ {};
+};
+
+} // namespace Http
+} // namespace naf
+} // namespace efc
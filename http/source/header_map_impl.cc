@@ -3,7 +3,8 @@
 #include "Efc.hh"
 
 #include <cstdint>
-#include <list>
+#include <new>
+#include <vector>
 #include <string>
 #include <stdlib.h>
 
@@ -38,7 +39,11 @@ HeaderString::HeaderString(HeaderString&& move_value) {
 	string_length_ = move_value.string_length_;
 	switch (move_value.type_) {
 	case Type::Reference: {
+		// When we move a reference header, we switch the moved header back to its default state too.
 		buffer_.ref_ = move_value.buffer_.ref_;
+		move_value.type_ = Type::Inline;
+		move_value.buffer_.dynamic_ = move_value.inline_buffer_;
+		move_value.clear();
 		break;
 	}
 	case Type::Dynamic: {
@@ -122,7 +127,10 @@ void HeaderString::append(const char* data, uint32_t size) {
 void HeaderString::clear() {
 	switch (type_) {
 	case Type::Reference: {
-		break;
+		// Drop the reference, the referenced memory is not ours.
+		type_ = Type::Inline;
+		buffer_.dynamic_ = inline_buffer_;
+		FALLTHRU;
 	}
 	case Type::Inline: {
 		inline_buffer_[0] = 0;
@@ -201,6 +209,13 @@ void HeaderString::setReference(const std::string& ref_value) {
 	string_length_ = ref_value.size();
 }
 
+void HeaderString::setReference(const char* data, uint32_t size) {
+	freeDynamic();
+	type_ = Type::Reference;
+	buffer_.ref_ = data;
+	string_length_ = size;
+}
+
 HeaderMapImpl::HeaderEntryImpl::HeaderEntryImpl(const LowerCaseString& key) :
 		key_(key) {
 }
@@ -281,16 +296,16 @@ HeaderMapImpl::HeaderMapImpl(const HeaderMap& rhs) :
 		HeaderMapImpl() {
 	rhs.iterate(
 			[](const HeaderEntry& header, void* context) -> HeaderMap::Iterate {
-				// TODO(mattklein123) PERF: Avoid copying here is not necessary.
+				HeaderMapImpl* self = static_cast<HeaderMapImpl*>(context);
 				HeaderString key_string;
-				key_string.setCopy(header.key().c_str(), header.key().size());
+				self->arenaString(key_string, header.key().c_str(), header.key().size());
 				HeaderString value_string;
-				value_string.setCopy(header.value().c_str(), header.value().size());
+				self->arenaString(value_string, header.value().c_str(), header.value().size());
 
-				static_cast<HeaderMapImpl*>(context)->addViaMove(std::move(key_string),
-						std::move(value_string));
+				self->addViaMove(std::move(key_string), std::move(value_string));
 				return HeaderMap::Iterate::Continue;
 			}, this);
+	method_ = rhs.method();
 }
 
 HeaderMapImpl::HeaderMapImpl(
@@ -298,21 +313,49 @@ HeaderMapImpl::HeaderMapImpl(
 		HeaderMapImpl() {
 	for (auto& value : values) {
 		HeaderString key_string;
-		key_string.setCopy(value.first.get().c_str(), value.first.get().size());
+		arenaString(key_string, value.first.get().c_str(), value.first.get().size());
 		HeaderString value_string;
-		value_string.setCopy(value.second.c_str(), value.second.size());
+		arenaString(value_string, value.second.c_str(), value.second.size());
 		addViaMove(std::move(key_string), std::move(value_string));
 	}
 }
 
+HeaderMapImpl::~HeaderMapImpl() {
+	EntrySegment* segment = first_segment_;
+	while (segment) {
+		EntrySegment* next = segment->next_;
+		for (uint32_t i = 0; i < segment->size_; i++) {
+			segment->entries()[i].~HeaderEntryImpl();
+		}
+		free(segment);
+		segment = next;
+	}
+
+	ArenaChunk* chunk = arena_;
+	while (chunk) {
+		ArenaChunk* next = chunk->next_;
+		free(chunk);
+		chunk = next;
+	}
+}
+
 bool HeaderMapImpl::operator==(const HeaderMapImpl& rhs) const {
 	if (size() != rhs.size()) {
 		return false;
 	}
 
-	for (auto i = headers_.begin(), j = rhs.headers_.begin();
-			i != headers_.end(); ++i, ++j) {
-		if (i->key() != j->key().c_str() || i->value() != j->value().c_str()) {
+	std::vector<const HeaderEntry*> lhs_entries;
+	std::vector<const HeaderEntry*> rhs_entries;
+	auto collect = [](const HeaderEntry& header, void* context) -> HeaderMap::Iterate {
+		static_cast<std::vector<const HeaderEntry*>*>(context)->push_back(&header);
+		return HeaderMap::Iterate::Continue;
+	};
+	iterate(collect, &lhs_entries);
+	rhs.iterate(collect, &rhs_entries);
+
+	for (size_t i = 0; i < lhs_entries.size(); i++) {
+		if (lhs_entries[i]->key() != rhs_entries[i]->key().c_str()
+				|| lhs_entries[i]->value() != rhs_entries[i]->value().c_str()) {
 			return false;
 		}
 	}
@@ -320,6 +363,83 @@ bool HeaderMapImpl::operator==(const HeaderMapImpl& rhs) const {
 	return true;
 }
 
+template <class... Args>
+HeaderMapImpl::HeaderEntryImpl& HeaderMapImpl::appendEntry(Args&&... args) {
+	if (!last_segment_ || last_segment_->size_ == last_segment_->capacity_) {
+		uint32_t capacity = last_segment_ ? last_segment_->capacity_ * 2 : FIRST_SEGMENT_ENTRIES;
+		EntrySegment* segment = static_cast<EntrySegment*>(malloc(
+				sizeof(EntrySegment) + capacity * sizeof(HeaderEntryImpl)));
+		segment->prev_ = last_segment_;
+		segment->next_ = nullptr;
+		segment->capacity_ = capacity;
+		segment->size_ = 0;
+		if (last_segment_) {
+			last_segment_->next_ = segment;
+		} else {
+			first_segment_ = segment;
+		}
+		last_segment_ = segment;
+	}
+
+	HeaderEntryImpl* entry = new (last_segment_->entries() + last_segment_->size_) HeaderEntryImpl(
+			std::forward<Args>(args)...);
+	last_segment_->size_++;
+	size_++;
+	return *entry;
+}
+
+char* HeaderMapImpl::arenaAllocate(uint32_t needed) {
+	if (!arena_ || arena_->capacity_ - arena_->used_ < needed) {
+		uint32_t capacity = arena_ ?
+				ES_MIN(arena_->capacity_ * 2, MAX_ARENA_CHUNK_SIZE) : FIRST_ARENA_CHUNK_SIZE;
+		capacity = ES_MAX(capacity, needed);
+		ArenaChunk* chunk = static_cast<ArenaChunk*>(malloc(sizeof(ArenaChunk) + capacity));
+		chunk->next_ = arena_;
+		chunk->capacity_ = capacity;
+		chunk->used_ = 0;
+		arena_ = chunk;
+	}
+
+	char* span = arena_->data() + arena_->used_;
+	arena_->used_ += needed;
+	return span;
+}
+
+const char* HeaderMapImpl::arenaCopy(const char* data, uint32_t size) {
+	char* copy = arenaAllocate(size + 1);
+	memcpy(copy, data, size);
+	copy[size] = 0;
+	return copy;
+}
+
+void HeaderMapImpl::arenaString(HeaderString& string, const char* data, uint32_t size) {
+	string.setReference(arenaCopy(data, size), size);
+}
+
+void HeaderMapImpl::arenaAppend(HeaderString& string, const char* data, uint32_t size) {
+	uint32_t old_size = string.size();
+	if (old_size == 0) {
+		arenaString(string, data, size);
+		return;
+	}
+
+	// The last copy of the arena grows in place over its terminator.
+	char* end = arena_ ? arena_->data() + arena_->used_ - 1 : nullptr;
+	if (string.c_str() + old_size == end && arena_->capacity_ - arena_->used_ >= size) {
+		memcpy(end, data, size);
+		end[size] = 0;
+		arena_->used_ += size;
+		string.setReference(string.c_str(), old_size + size);
+		return;
+	}
+
+	char* copy = arenaAllocate(old_size + size + 1);
+	memcpy(copy, string.c_str(), old_size);
+	memcpy(copy + old_size, data, size);
+	copy[old_size + size] = 0;
+	string.setReference(copy, old_size + size);
+}
+
 void HeaderMapImpl::insertByKey(HeaderString&& key, HeaderString&& value) {
 	StaticLookupEntry::EntryCb cb = ConstSingleton<StaticLookupTable>::get().find(key.c_str());
   if (cb) {
@@ -332,9 +452,7 @@ void HeaderMapImpl::insertByKey(HeaderString&& key, HeaderString&& value) {
     StaticLookupResponse ref_lookup_response = cb(*this);
     maybeCreateInline(ref_lookup_response.entry_, *ref_lookup_response.key_, std::move(value));
   } else {
-    std::list<HeaderEntryImpl>::iterator i =
-        headers_.emplace(headers_.end(), std::move(key), std::move(value));
-    i->entry_ = i;
+    appendEntry(std::move(key), std::move(value));
   }
 }
 
@@ -342,6 +460,15 @@ void HeaderMapImpl::addViaMove(HeaderString&& key, HeaderString&& value) {
 	insertByKey(std::move(key), std::move(value));
 }
 
+HeaderMapImpl::InlineSlot HeaderMapImpl::inlineSlot(const char* key) {
+	return ConstSingleton<StaticLookupTable>::get().find(key);
+}
+
+void HeaderMapImpl::addInline(InlineSlot slot, HeaderString&& value) {
+	StaticLookupResponse ref_lookup_response = slot(*this);
+	maybeCreateInline(ref_lookup_response.entry_, *ref_lookup_response.key_, std::move(value));
+}
+
 void HeaderMapImpl::addReference(const LowerCaseString& key,
 		const std::string& value) {
 	HeaderString ref_key(key);
@@ -408,28 +535,30 @@ void HeaderMapImpl::setReferenceKey(const LowerCaseString& key,
 
 uint64_t HeaderMapImpl::byteSize() const {
 	uint64_t byte_size = 0;
-	for (const HeaderEntryImpl& header : headers_) {
-		byte_size += header.key().size();
-		byte_size += header.value().size();
+	for (const EntrySegment* segment = first_segment_; segment; segment = segment->next_) {
+		const HeaderEntryImpl* entries = segment->entries();
+		for (uint32_t i = 0; i < segment->size_; i++) {
+			if (!entries[i].removed_) {
+				byte_size += entries[i].key().size();
+				byte_size += entries[i].value().size();
+			}
+		}
 	}
 
 	return byte_size;
 }
 
 const HeaderEntry* HeaderMapImpl::get(const LowerCaseString& key) const {
-	for (const HeaderEntryImpl& header : headers_) {
-		if (header.key() == key.get().c_str()) {
-			return &header;
-		}
-	}
-
-	return nullptr;
+	return const_cast<HeaderMapImpl*>(this)->get(key);
 }
 
 HeaderEntry* HeaderMapImpl::get(const LowerCaseString& key) {
-	for (HeaderEntryImpl& header : headers_) {
-		if (header.key() == key.get().c_str()) {
-			return &header;
+	for (EntrySegment* segment = first_segment_; segment; segment = segment->next_) {
+		HeaderEntryImpl* entries = segment->entries();
+		for (uint32_t i = 0; i < segment->size_; i++) {
+			if (!entries[i].removed_ && entries[i].key() == key.get().c_str()) {
+				return &entries[i];
+			}
 		}
 	}
 
@@ -437,17 +566,24 @@ HeaderEntry* HeaderMapImpl::get(const LowerCaseString& key) {
 }
 
 void HeaderMapImpl::iterate(ConstIterateCb cb, void* context) const {
-	for (const HeaderEntryImpl& header : headers_) {
-		if (cb(header, context) == HeaderMap::Iterate::Break) {
-			break;
+	for (const EntrySegment* segment = first_segment_; segment; segment = segment->next_) {
+		const HeaderEntryImpl* entries = segment->entries();
+		for (uint32_t i = 0; i < segment->size_; i++) {
+			if (!entries[i].removed_ && cb(entries[i], context) == HeaderMap::Iterate::Break) {
+				return;
+			}
 		}
 	}
 }
 
 void HeaderMapImpl::iterateReverse(ConstIterateCb cb, void* context) const {
-	for (auto it = headers_.rbegin(); it != headers_.rend(); it++) {
-		if (cb(*it, context) == HeaderMap::Iterate::Break) {
-			break;
+	for (const EntrySegment* segment = last_segment_; segment; segment = segment->prev_) {
+		const HeaderEntryImpl* entries = segment->entries();
+		for (uint32_t i = segment->size_; i > 0; i--) {
+			if (!entries[i - 1].removed_
+					&& cb(entries[i - 1], context) == HeaderMap::Iterate::Break) {
+				return;
+			}
 		}
 	}
 }
@@ -484,11 +620,13 @@ void HeaderMapImpl::remove(const LowerCaseString& key) {
 		StaticLookupResponse ref_lookup_response = cb(*this);
 		removeInline(ref_lookup_response.entry_);
 	} else {
-		for (auto i = headers_.begin(); i != headers_.end();) {
-			if (i->key() == key.get().c_str()) {
-				i = headers_.erase(i);
-			} else {
-				++i;
+		for (EntrySegment* segment = first_segment_; segment; segment = segment->next_) {
+			HeaderEntryImpl* entries = segment->entries();
+			for (uint32_t i = 0; i < segment->size_; i++) {
+				if (!entries[i].removed_ && entries[i].key() == key.get().c_str()) {
+					entries[i].removed_ = true;
+					size_--;
+				}
 			}
 		}
 	}
@@ -500,10 +638,7 @@ HeaderMapImpl::HeaderEntryImpl& HeaderMapImpl::maybeCreateInline(
 		return **entry;
 	}
 
-	std::list<HeaderEntryImpl>::iterator i = headers_.emplace(headers_.end(),
-			key);
-	i->entry_ = i;
-	*entry = &(*i);
+	*entry = &appendEntry(key);
 	return **entry;
 }
 
@@ -514,9 +649,7 @@ HeaderMapImpl::HeaderEntryImpl& HeaderMapImpl::maybeCreateInline(
     return **entry;
   }
 
-  std::list<HeaderEntryImpl>::iterator i = headers_.emplace(headers_.end(), key, std::move(value));
-  i->entry_ = i;
-  *entry = &(*i);
+  *entry = &appendEntry(key, std::move(value));
   return **entry;
 }
 
@@ -527,7 +660,8 @@ void HeaderMapImpl::removeInline(HeaderEntryImpl** ptr_to_entry) {
 
 	HeaderEntryImpl* entry = *ptr_to_entry;
 	*ptr_to_entry = nullptr;
-	headers_.erase(entry->entry_);
+	entry->removed_ = true;
+	size_--;
 }
 
 } // namespace http
@@ -2,7 +2,6 @@
 
 #include <array>
 #include <cstdint>
-#include <list>
 #include <memory>
 #include <string>
 
@@ -34,13 +33,19 @@ public:
  * If it is, we store a reference to it that can be accessed later directly. Most high performance
  * paths use O(1) direct access. In general, we try to copy as little as possible and allocate as
  * little as possible in any of the paths.
+ *
+ * The entries are kept in insertion order in a few contiguous segments instead of a node per
+ * header, most requests fit in the first one. A codec which can not reference the received bytes
+ * copies them into an arena of the map with arenaString() instead of a heap allocation each. All
+ * of it is freed with the map. Strings moved in are kept as they are.
  */
-class HeaderMapImpl: public HeaderMap {
+class HeaderMapImpl: public HeaderMap, NonCopyable {
 public:
 	HeaderMapImpl();
 	HeaderMapImpl(
 			const std::initializer_list<std::pair<LowerCaseString, std::string>>& values);
 	HeaderMapImpl(const HeaderMap& rhs);
+	~HeaderMapImpl();
 
 	/**
 	 * Add a header via full move. This is the expected high performance paths for codecs populating
@@ -48,6 +53,17 @@ public:
 	 */
 	void addViaMove(HeaderString&& key, HeaderString&& value);
 
+	/**
+	 * Set a string to a reference of a copy of a memory span in the arena of the map.
+	 */
+	void arenaString(HeaderString& string, const char* data, uint32_t size);
+
+	/**
+	 * Append a memory span to a string in the arena of the map, the string is set as by
+	 * arenaString() if it is empty. The last copy in the arena is extended in place.
+	 */
+	void arenaAppend(HeaderString& string, const char* data, uint32_t size);
+
 	/**
 	 * For testing. Equality is based on equality of the backing list. This is an exact match
 	 * comparison (order matters).
@@ -69,7 +85,29 @@ public:
 	void iterateReverse(ConstIterateCb cb, void* context) const override;
 	Lookup lookup(const LowerCaseString& key, const HeaderEntry** entry) const override;
 	void remove(const LowerCaseString& key) override;
-	size_t size() const override {return headers_.size();}
+	size_t size() const override {return size_;}
+	Method method() const override {return method_;}
+	void setMethod(Method method) override {method_ = method;}
+
+protected:
+	struct StaticLookupResponse;
+
+public:
+	/**
+	 * The accessor of an inline header slot. A codec which sees the same keys again looks it up
+	 * once and adds the values to the slot directly.
+	 */
+	typedef StaticLookupResponse (*InlineSlot)(HeaderMapImpl&);
+
+	/**
+	 * @return the slot of an inline header key, or nullptr if it is not one.
+	 */
+	static InlineSlot inlineSlot(const char* key);
+
+	/**
+	 * Add a value to an inline header slot via full move, see addViaMove().
+	 */
+	void addInline(InlineSlot slot, HeaderString&& value);
 
 protected:
 	struct HeaderEntryImpl : public HeaderEntry, NonCopyable {
@@ -88,16 +126,46 @@ protected:
 
 		HeaderString key_;
 		HeaderString value_;
-		std::list<HeaderEntryImpl>::iterator entry_;
+		bool removed_ {}; // skipped, the entries never move so the pointers to them stay valid.
 	};
 
+	/**
+	 * A run of entries in one allocation, each segment doubles the previous one.
+	 */
+	struct EntrySegment {
+		EntrySegment* prev_;
+		EntrySegment* next_;
+		uint32_t capacity_;
+		uint32_t size_;
+
+		HeaderEntryImpl* entries() {return reinterpret_cast<HeaderEntryImpl*>(this + 1);}
+		const HeaderEntryImpl* entries() const {
+			return reinterpret_cast<const HeaderEntryImpl*>(this + 1);
+		}
+	};
+
+	/**
+	 * A chunk of the arena of the key and value bytes.
+	 */
+	struct ArenaChunk {
+		ArenaChunk* next_;
+		uint32_t capacity_;
+		uint32_t used_;
+
+		char* data() {return reinterpret_cast<char*>(this + 1);}
+	};
+
+	static const uint32_t FIRST_SEGMENT_ENTRIES = 16;
+	static const uint32_t FIRST_ARENA_CHUNK_SIZE = 1024;
+	static const uint32_t MAX_ARENA_CHUNK_SIZE = 64 * 1024;
+
 	struct StaticLookupResponse {
 		HeaderEntryImpl** entry_;
 		const LowerCaseString* key_;
 	};
 
 	struct StaticLookupEntry {
-		typedef StaticLookupResponse (*EntryCb)(HeaderMapImpl&);
+		typedef InlineSlot EntryCb;
 
 		EntryCb cb_ {};
 		std::array<std::unique_ptr<StaticLookupEntry>, 256> entries_;
@@ -125,8 +193,28 @@ protected:
 			HeaderString&& value);
 	void removeInline(HeaderEntryImpl** entry);
 
+	/**
+	 * Construct an entry at the end.
+	 */
+	template <class... Args> HeaderEntryImpl& appendEntry(Args&&... args);
+
+	/**
+	 * Copy a memory span into the arena.
+	 * @return the null terminated copy, valid until the map is destroyed.
+	 */
+	const char* arenaCopy(const char* data, uint32_t size);
+
+	/**
+	 * Reserve a span of the arena, in a new chunk if the current one is full.
+	 */
+	char* arenaAllocate(uint32_t needed);
+
 	AllInlineHeaders inline_headers_;
-	std::list<HeaderEntryImpl> headers_;
+	EntrySegment* first_segment_ {};
+	EntrySegment* last_segment_ {};
+	ArenaChunk* arena_ {};
+	size_t size_ {};
+	Method method_ {Method::Other};
 
 	ALL_INLINE_HEADERS(DEFINE_INLINE_HEADER_FUNCS)
 };
@@ -43,6 +43,7 @@ public:
 	const LowerCaseString GrpcAcceptEncoding{"grpc-accept-encoding"};
 	const LowerCaseString Host{":authority"};
 	const LowerCaseString HostLegacy{"host"};
+	const LowerCaseString IfNoneMatch{"if-none-match"};
 	const LowerCaseString KeepAlive{"keep-alive"};
 	const LowerCaseString LastModified{"last-modified"};
 	const LowerCaseString Location{"location"};
@@ -1,6 +1,7 @@
 #include "./codec_impl.h"
 
 #include "../../../inc/EHttpSession.hh"
+#include "../../../inc/EIoBufferChain.hh"
 
 #include <cstdint>
 #include <string>
@@ -39,12 +40,12 @@ void StreamEncoderImpl::encodeHeader(const char* key, uint32_t key_size,
 
 	ES_ASSERT(key_size > 0);
 
-	connection_.copyToBuffer(key, key_size);
-	connection_.addCharToBuffer(':');
-	connection_.addCharToBuffer(' ');
-	connection_.copyToBuffer(value, value_size);
-	connection_.addCharToBuffer('\r');
-	connection_.addCharToBuffer('\n');
+	copyToBuffer(key, key_size);
+	addCharToBuffer(':');
+	addCharToBuffer(' ');
+	copyToBuffer(value, value_size);
+	addCharToBuffer('\r');
+	addCharToBuffer('\n');
 }
 
 void StreamEncoderImpl::encode100ContinueHeaders(const HeaderMap& headers) {
@@ -107,13 +108,13 @@ void StreamEncoderImpl::encodeHeaders(const HeaderMap& headers,
 		}
 	}
 
-	connection_.addCharToBuffer('\r');
-	connection_.addCharToBuffer('\n');
+	addCharToBuffer('\r');
+	addCharToBuffer('\n');
 
 	if (end_stream) {
 		endEncode();
 	} else {
-		connection_.flushOutput();
+		connection_.flushOutput(*this);
 	}
 }
 
@@ -122,22 +123,22 @@ void StreamEncoderImpl::encodeData(Buffer::Instance& data, bool end_stream) {
 	// atually write the zero length buffer out.
 	if (data.length() > 0) {
 		if (chunk_encoding_) {
-			//@see: connection_.buffer().add(fmt::format("{:x}\r\n", data.length()));
-			connection_.buffer().add(
+			//@see: buffer().add(fmt::format("{:x}\r\n", data.length()));
+			buffer().add(
 					EString::formatOf("%x\r\n", data.length()).data());
 		}
 
-		connection_.buffer().move(data);
+		buffer().move(data);
 
 		if (chunk_encoding_) {
-			connection_.buffer().add(CRLF);
+			buffer().add(CRLF);
 		}
 	}
 
 	if (end_stream) {
 		endEncode();
 	} else {
-		connection_.flushOutput();
+		connection_.flushOutput(*this);
 	}
 }
 
@@ -147,39 +148,62 @@ void StreamEncoderImpl::encodeTrailers(const HeaderMap&) {
 
 void StreamEncoderImpl::endEncode() {
 	if (chunk_encoding_) {
-		connection_.buffer().add(LAST_CHUNK);
+		buffer().add(LAST_CHUNK);
 	}
 
-	connection_.flushOutput();
-	connection_.onEncodeComplete();
+	// Complete before the last flush, so the connection writes it with the responses behind it.
+	connection_.onEncodeComplete(*this);
+	connection_.flushOutput(*this);
 }
 
-void ConnectionImpl::flushOutput() {
-	output_buffer_.add(reserved_iovec_);
-
-	Buffer::LinkedBuffer& lb = output_buffer_.buffer();
+void ConnectionImpl::flushOutput(StreamEncoderImpl& encoder) {
+	Buffer::LinkedBuffer& lb = encoder.buffer().buffer();
 	sp<EIoBuffer> buf;
 	while ((buf = lb.poll()) != null) {
 		connection_->write(buf);
 	}
 }
 
-void ConnectionImpl::addCharToBuffer(char c) {
-	reserved_iovec_->put(c);
+Buffer::OwnedImpl& StreamEncoderImpl::buffer() {
+	// The reserved bytes go before anything added after them, a new one is reserved for the next.
+	if (reserved_iovec_ != null && reserved_iovec_->position() > 0) {
+		output_buffer_.add(reserved_iovec_);
+		reserved_iovec_ = null;
+	}
+	return output_buffer_;
+}
+
+void StreamEncoderImpl::addCharToBuffer(char c) {
+	reservedBuffer()->put(c);
+}
+
+void StreamEncoderImpl::addIntToBuffer(uint64_t i) {
+	reservedBuffer()->putString(EString(i).toString().c_str());
 }
 
-void ConnectionImpl::addIntToBuffer(uint64_t i) {
-	reserved_iovec_->putString(EString(i).toString().c_str());
+void StreamEncoderImpl::copyToBuffer(const char* data, uint64_t length) {
+	reservedBuffer()->put(data, length);
 }
 
-void ConnectionImpl::copyToBuffer(const char* data, uint64_t length) {
-	reserved_iovec_->put(data, length);
+EIoBuffer* StreamEncoderImpl::reservedBuffer() {
+	if (reserved_iovec_ == null) {
+		reserved_iovec_ = EIoBuffer::allocate()->setAutoExpand(true);
+	}
+	return reserved_iovec_.get();
 }
 
 void StreamEncoderImpl::resetStream(StreamResetReason reason) {
 	connection_.onResetStreamBase(reason);
 }
 
+void StreamEncoderImpl::readDisable(bool disable) {
+	connection_.readDisable(disable);
+}
+
+uint64_t StreamEncoderImpl::bufferedBytes() {
+	return connection_.bufferedBytes(*this);
+}
+
 static const char RESPONSE_PREFIX[] = "HTTP/1.1 ";
 static const char HTTP_10_RESPONSE_PREFIX[] = "HTTP/1.0 ";
 
@@ -190,21 +214,21 @@ void ResponseStreamEncoderImpl::encodeHeaders(const HeaderMap& headers,
 
 	if (connection_.protocol() == Protocol::Http10
 			&& connection_.supports_http_10()) {
-		connection_.copyToBuffer(HTTP_10_RESPONSE_PREFIX,
+		copyToBuffer(HTTP_10_RESPONSE_PREFIX,
 				sizeof(HTTP_10_RESPONSE_PREFIX) - 1);
 	} else {
-		connection_.copyToBuffer(RESPONSE_PREFIX, sizeof(RESPONSE_PREFIX) - 1);
+		copyToBuffer(RESPONSE_PREFIX, sizeof(RESPONSE_PREFIX) - 1);
 	}
-	connection_.addIntToBuffer(numeric_status);
-	connection_.addCharToBuffer(' ');
+	addIntToBuffer(numeric_status);
+	addCharToBuffer(' ');
 
 	const char* status_string = CodeUtility::toString(
 			static_cast<Code>(numeric_status));
 	uint32_t status_string_len = strlen(status_string);
-	connection_.copyToBuffer(status_string, status_string_len);
+	copyToBuffer(status_string, status_string_len);
 
-	connection_.addCharToBuffer('\r');
-	connection_.addCharToBuffer('\n');
+	addCharToBuffer('\r');
+	addCharToBuffer('\n');
 
 	StreamEncoderImpl::encodeHeaders(headers, end_stream);
 }
@@ -224,10 +248,10 @@ void RequestStreamEncoderImpl::encodeHeaders(const HeaderMap& headers,
 		head_request_ = true;
 	}
 
-	connection_.copyToBuffer(method->value().c_str(), method->value().size());
-	connection_.addCharToBuffer(' ');
-	connection_.copyToBuffer(path->value().c_str(), path->value().size());
-	connection_.copyToBuffer(REQUEST_POSTFIX, sizeof(REQUEST_POSTFIX) - 1);
+	copyToBuffer(method->value().c_str(), method->value().size());
+	addCharToBuffer(' ');
+	copyToBuffer(path->value().c_str(), path->value().size());
+	copyToBuffer(REQUEST_POSTFIX, sizeof(REQUEST_POSTFIX) - 1);
 
 	StreamEncoderImpl::encodeHeaders(headers, end_stream);
 }
@@ -268,9 +292,7 @@ const ToLowerTable& ConnectionImpl::toLowerTable() {
 
 ConnectionImpl::ConnectionImpl(sp<EHttpSession>& connection,
 		http_parser_type type) :
-		connection_(connection), output_buffer_() {
-	reserved_iovec_ = EIoBuffer::allocate()->setAutoExpand(true);
-
+		connection_(connection) {
 	http_parser_init(&parser_, type);
 	parser_.data = this;
 }
@@ -292,12 +314,28 @@ void ConnectionImpl::dispatch(sp<EIoBuffer>& data) {
 	// Always unpause before dispatch.
 	http_parser_pause(&parser_, 0);
 
-	ssize_t total_parsed = 0;
-	if (data->remaining() > 0) {
-		total_parsed += dispatchSlice(static_cast<const char*>(data->current()),
-				data->remaining());
-	} else {
+	if (data->remaining() == 0) {
 		dispatchSlice(nullptr, 0);
+		return;
+	}
+
+	// A callback pauses the parser to apply back pressure. Go on with the rest of the data after it,
+	// the buffer is reused by the next read.
+	const char* slice = static_cast<const char*>(data->current());
+	size_t len = data->remaining();
+	while (true) {
+		size_t rc = dispatchSlice(slice, len);
+		slice += rc;
+		len -= rc;
+
+		if (HTTP_PARSER_ERRNO(&parser_) != HPE_PAUSED || connection_->isClosed()) {
+			break;
+		}
+		onParserPaused();
+		if (len == 0) {
+			break;
+		}
+		http_parser_pause(&parser_, 0);
 	}
 }
 
@@ -325,7 +363,7 @@ void ConnectionImpl::onHeaderField(const char* data, size_t length) {
 		completeLastHeader();
 	}
 
-	current_header_field_.append(data, length);
+	appendFragment(current_header_field_, data, length);
 }
 
 void ConnectionImpl::onHeaderValue(const char* data, size_t length) {
@@ -335,7 +373,18 @@ void ConnectionImpl::onHeaderValue(const char* data, size_t length) {
 	}
 
 	header_parsing_state_ = HeaderParsingState::Value;
-	current_header_value_.append(data, length);
+	appendFragment(current_header_value_, data, length);
+}
+
+void ConnectionImpl::appendFragment(HeaderString& string, const char* data, size_t length) {
+	// Copy into the arena of the header map, the read buffer is reused by the next read. A string
+	// which spans reads grows there.
+	if (current_header_map_) {
+		current_header_map_->arenaAppend(string, data, length);
+		return;
+	}
+
+	string.append(data, length);
 }
 
 int ConnectionImpl::onHeadersCompleteBase() {
@@ -359,6 +408,17 @@ void ConnectionImpl::onMessageBeginBase() {
 	onMessageBegin();
 }
 
+void ConnectionImpl::readDisable(bool disable) {
+	if (disable) {
+		read_disable_count_++;
+	} else {
+		ES_ASSERT(read_disable_count_.load() > 0);
+		if (--read_disable_count_ == 0) {
+			parser_signal_.signal();
+		}
+	}
+}
+
 void ConnectionImpl::onResetStreamBase(StreamResetReason reason) {
 	ES_ASSERT(!reset_stream_called_);
 	reset_stream_called_ = true;
@@ -371,14 +431,130 @@ ServerConnectionImpl::ServerConnectionImpl(sp<EHttpSession>& connection,
 				settings) {
 }
 
-void ServerConnectionImpl::onEncodeComplete() {
-	ES_ASSERT(active_request_);
-	if (active_request_->remote_complete_) {
-		// Only do this if remote is complete. If we are replying before the request is complete the
-		// only logical thing to do is for higher level code to reset() / close the connection so we
-		// leave the request around so that it can fire reset callbacks.
-		active_request_.reset();
+void ServerConnectionImpl::onEncodeComplete(StreamEncoderImpl& encoder) {
+	SYNCBLOCK(&pipeline_lock_) {
+		ActiveRequest* request = findRequest(encoder);
+		if (request) {
+			// The request leaves the pipeline once remote is complete too. If we are replying before
+			// the request is complete the only logical thing to do is for higher level code to
+			// reset() / close the connection so we leave the request around so that it can fire
+			// reset callbacks.
+			request->encode_complete_ = true;
+		}
+	}}
+}
+
+void ServerConnectionImpl::flushOutput(StreamEncoderImpl& encoder) {
+	Buffer::OwnedImpl& output = encoder.buffer();
+	SYNCBLOCK(&pipeline_lock_) {
+		ActiveRequest* request = findRequest(encoder);
+		if (request) {
+			request->output_.move(output);
+		} else {
+			output.clear();
+		}
+	}}
+
+	writePipeline();
+}
+
+uint64_t ServerConnectionImpl::bufferedBytes(StreamEncoderImpl& encoder) {
+	// Held behind an earlier response of the pipeline, the one at the front is written at once.
+	uint64_t length = 0;
+	SYNCBLOCK(&pipeline_lock_) {
+		ActiveRequest* request = findRequest(encoder);
+		if (request) {
+			length = request->output_.length();
+		}
+	}}
+	return length;
+}
+
+ServerConnectionImpl::ActiveRequest* ServerConnectionImpl::findRequest(
+		StreamEncoderImpl& encoder) {
+	for (auto& request : pipeline_) {
+		if (&request->response_encoder_ == &encoder) {
+			return request.get();
+		}
 	}
+	return nullptr;
+}
+
+void ServerConnectionImpl::writePipeline() {
+	while (true) {
+		Buffer::OwnedImpl output;
+		bool popped = false;
+		SYNCBLOCK(&pipeline_lock_) {
+			if (writing_) {
+				return; // the writer goes on with ours after its write.
+			}
+
+			while (!pipeline_.empty()) {
+				ActiveRequest* request = pipeline_.front().get();
+				if (request->output_.length() > 0) {
+					output.move(request->output_);
+					request->response_encoder_.runBufferedDataSentCallbacks();
+				}
+				if (!request->encode_complete_ || !request->remote_complete_) {
+					break;
+				}
+				request->response_encoder_.runDestroyCallbacks();
+				pipeline_.pop_front();
+				popped = true;
+			}
+
+			if (!output.buffer().isEmpty()) {
+				writing_ = true;
+			}
+		}}
+
+		// Room in the pipeline, resume a dispatch paused on a full one.
+		if (popped) {
+			parser_signal_.signal();
+		}
+		if (output.buffer().isEmpty()) {
+			return;
+		}
+
+		ON_SCOPE_EXIT(
+			SYNCBLOCK(&pipeline_lock_) {
+				writing_ = false;
+			}}
+		);
+
+		Buffer::LinkedBuffer& lb = output.buffer();
+		if (lb.size() == 1) {
+			connection_->write(lb.peek());
+		} else {
+			// The responses ready are sent by one gather write.
+			sp<EIoBufferChain> chain(new EIoBufferChain());
+			for (auto buf : lb) {
+				chain->add(buf);
+			}
+			connection_->write(chain);
+		}
+	}
+}
+
+void ServerConnectionImpl::onParserPaused() {
+	// The pipeline is full or reads are disabled: wait until a response leaves the pipeline, the
+	// body reader resumes or the connection is closed.
+	parser_signal_.await([this]() {
+		if (connection_->isClosed()) {
+			return true;
+		}
+		if (readDisabled()) {
+			return false;
+		}
+		if (active_request_) {
+			return true; // paused in the body.
+		}
+		bool room;
+		SYNCBLOCK(&pipeline_lock_) {
+			room = pipeline_.size() < codec_settings_.max_pipeline_depth_;
+		}}
+		return room;
+	});
 }
 
 void ServerConnectionImpl::handlePath(HeaderMapImpl& headers,
@@ -469,6 +645,31 @@ void ServerConnectionImpl::handlePath(HeaderMapImpl& headers,
 	}
 }
 
+Method ServerConnectionImpl::toMethod(unsigned int method) {
+	switch (method) {
+	case HTTP_GET:
+		return Method::Get;
+	case HTTP_HEAD:
+		return Method::Head;
+	case HTTP_POST:
+		return Method::Post;
+	case HTTP_PUT:
+		return Method::Put;
+	case HTTP_DELETE:
+		return Method::Delete;
+	case HTTP_OPTIONS:
+		return Method::Options;
+	case HTTP_TRACE:
+		return Method::Trace;
+	case HTTP_PATCH:
+		return Method::Patch;
+	case HTTP_CONNECT:
+		return Method::Connect;
+	default:
+		return Method::Other;
+	}
+}
+
 int ServerConnectionImpl::onHeadersComplete(HeaderMapImplPtr&& headers) {
 	// Handle the case where response happens prior to request complete. It's up to upper layer code
 	// to disconnect the connection but we shouldn't fire any more events since it doesn't make
@@ -481,7 +682,9 @@ int ServerConnectionImpl::onHeadersComplete(HeaderMapImplPtr&& headers) {
 		handlePath(*headers, parser_.method);
 		ES_ASSERT(active_request_->request_url_.empty());
 
-		headers->insertMethod().value(method_string, strlen(method_string));
+		// The method string is static, referenced without a copy.
+		headers->insertMethod().value().setReference(method_string, strlen(method_string));
+		headers->setMethod(toMethod(parser_.method));
 
 		// Determine here whether we have a body or not. This uses the new RFC semantics where the
 		// presence of content-length or chunked transfer-encoding indicates a body vs. a particular
@@ -511,7 +714,11 @@ int ServerConnectionImpl::onHeadersComplete(HeaderMapImplPtr&& headers) {
 void ServerConnectionImpl::onMessageBegin() {
 	if (!resetStreamCalled()) {
 		ES_ASSERT(!active_request_);
-		active_request_.reset(new ActiveRequest(*this));
+		ActiveRequestPtr request(new ActiveRequest(*this));
+		active_request_ = request.get();
+		SYNCBLOCK(&pipeline_lock_) {
+			pipeline_.push_back(std::move(request));
+		}}
 		active_request_->request_decoder_ = &callbacks_.newStream(
 				active_request_->response_encoder_);
 	}
@@ -519,7 +726,7 @@ void ServerConnectionImpl::onMessageBegin() {
 
 void ServerConnectionImpl::onUrl(const char* data, size_t length) {
 	if (active_request_) {
-		active_request_->request_url_.append(data, length);
+		appendFragment(active_request_->request_url_, data, length);
 	}
 }
 
@@ -528,32 +735,58 @@ void ServerConnectionImpl::onBody(const char* data, size_t length) {
 	if (active_request_) {
 		Buffer::OwnedImpl buffer(data, length);
 		active_request_->request_decoder_->decodeData(buffer, false);
+
+		// The body reader is behind, stop parsing until it catches up.
+		if (readDisabled()) {
+			http_parser_pause(&parser_, 1);
+		}
 	}
 }
 
 void ServerConnectionImpl::onMessageComplete() {
 	if (active_request_) {
-		Buffer::OwnedImpl buffer;
-		active_request_->remote_complete_ = true;
+		// Once remote is complete the request may be replied, written and freed by another fiber, do
+		// not touch it after the decode below.
+		StreamDecoder* request_decoder = active_request_->request_decoder_;
+		SYNCBLOCK(&pipeline_lock_) {
+			active_request_->remote_complete_ = true;
+		}}
+		active_request_ = nullptr;
 
+		Buffer::OwnedImpl buffer;
 		if (!!deferred_end_stream_headers_) {
-			active_request_->request_decoder_->decodeHeaders(
-					std::move(deferred_end_stream_headers_), true);
+			request_decoder->decodeHeaders(std::move(deferred_end_stream_headers_), true);
 			deferred_end_stream_headers_.reset();
 		} else {
-			active_request_->request_decoder_->decodeData(buffer, true);
+			request_decoder->decodeData(buffer, true);
 		}
+
+		// It may have been replied before it was complete.
+		writePipeline();
 	}
 
-	// Always pause the parser so that the calling code can process 1 request at a time and apply
-	// back pressure. However this means that the calling code needs to detect if there is more data
-	// in the buffer and dispatch it again.
-	http_parser_pause(&parser_, 1);
+	// Keep decoding the pipelined requests, they are handled at the same time and replied in the
+	// request order. Pause the parser when the pipeline is full to apply back pressure, the calling
+	// code waits for a response before it goes on with the rest of the data.
+	bool full;
+	SYNCBLOCK(&pipeline_lock_) {
+		full = (pipeline_.size() >= codec_settings_.max_pipeline_depth_);
+	}}
+	if (full) {
+		http_parser_pause(&parser_, 1);
+	}
 }
 
 void ServerConnectionImpl::onResetStream(StreamResetReason reason) {
-	ES_ASSERT(active_request_);
-	active_request_.reset();
+	// The connection is going to be closed, no more callbacks of the request being decoded. The
+	// pipelined requests stay until then, their encoders may be in use by other fibers, but their
+	// owners learn that nothing more is going to be written.
+	SYNCBLOCK(&pipeline_lock_) {
+		for (auto& request : pipeline_) {
+			request->response_encoder_.runResetCallbacks(reason);
+		}
+	}}
+	active_request_ = nullptr;
 }
 
 void ServerConnectionImpl::sendProtocolError() {
@@ -5,14 +5,17 @@
 //#include "../../../inc/EHttpSession.hh"
 
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <list>
 #include <memory>
 #include <string>
 
 #include "../../include/codec.h"
+#include "../../../inc/EWakeSignal.hh"
 
 #include "../buffer_impl.h"
+#include "../codec_helper.h"
 #include "../to_lower_table.h"
 #include "../codes.h"
 #include "../header_map_impl.h"
@@ -40,20 +43,35 @@ class ConnectionImpl;
 /**
  * Base class for HTTP/1.1 request and response encoders.
  */
-class StreamEncoderImpl: public StreamEncoder, public Stream/*,
- public StreamCallbackHelper*/{
+class StreamEncoderImpl: public StreamEncoder, public Stream,
+ public StreamCallbackHelper {
 public:
 	// Http::StreamEncoder
 	void encode100ContinueHeaders(const HeaderMap& headers) override;
 	void encodeHeaders(const HeaderMap& headers, bool end_stream) override;
 	void encodeData(Buffer::Instance& data, bool end_stream) override;
 	void encodeTrailers(const HeaderMap& trailers) override;
+	Stream& getStream() override {return *this;}
 
+	// Http::Stream
+	void addCallbacks(StreamCallbacks& callbacks) override {addCallbacks_(callbacks);}
+	void removeCallbacks(StreamCallbacks& callbacks) override {removeCallbacks_(callbacks);}
 	void resetStream(StreamResetReason reason) override;
+	void readDisable(bool disable) override;
+	uint64_t bufferedBytes() override;
+
+	/**
+	 * @return Buffer::OwnedImpl& the encoded and not yet flushed output of this stream.
+	 */
+	Buffer::OwnedImpl& buffer();
 
 protected:
 	StreamEncoderImpl(ConnectionImpl& connection) : connection_(connection) {}
 
+	void addCharToBuffer(char c);
+	void addIntToBuffer(uint64_t i);
+	void copyToBuffer(const char* data, uint64_t length);
+
 	static const std::string CRLF;
 	static const std::string LAST_CHUNK;
 
@@ -74,8 +92,18 @@ private:
 	 */
 	void endEncode();
 
+	/**
+	 * @return EIoBuffer* the buffer of the small pieces, reserved until the next buffer() call.
+	 */
+	EIoBuffer* reservedBuffer();
+
 	bool chunk_encoding_ {true};
 	bool processing_100_continue_ {false};
+
+	// Each stream encodes into its own buffers, so pipelined responses can be encoded at the same
+	// time and written in the request order by the connection.
+	Buffer::OwnedImpl output_buffer_;
+	sp<EIoBuffer> reserved_iovec_;
 };
 
 /**
@@ -131,9 +159,11 @@ public:
 	}
 
 	/**
-	 * Called when the active encoder has completed encoding the outbound half of the stream.
+	 * Called when an encoder has completed encoding the outbound half of the stream, before the
+	 * last flushOutput() of it.
+	 * @param encoder supplies the encoder.
 	 */
-	virtual void onEncodeComplete() = 0;
+	virtual void onEncodeComplete(StreamEncoderImpl& encoder) = 0;
 
 	/**
 	 * Called when resetStream() has been called on an active stream. In HTTP/1.1 the only
@@ -143,23 +173,29 @@ public:
 	void onResetStreamBase(StreamResetReason reason);
 
 	/**
-	 * Flush all pending output from encoding.
+	 * Called by a stream to stop or resume parsing the connection, e.g. while a streamed request
+	 * body waits for its reader. It may be called by other fibers or threads.
+	 * @param disable supplies whether to stop (true) or resume (false).
 	 */
-	void flushOutput();
-
-	void addCharToBuffer(char c);
-	void addIntToBuffer(uint64_t i);
+	void readDisable(bool disable);
 
-	Buffer::OwnedImpl& buffer() {
-		return output_buffer_;
-	}
+	/**
+	 * Flush all pending output from encoding.
+	 * @param encoder supplies the encoder which has the output.
+	 */
+	virtual void flushOutput(StreamEncoderImpl& encoder);
 
-	void copyToBuffer(const char* data, uint64_t length);
+	/**
+	 * @param encoder supplies the encoder to look up.
+	 * @return uint64_t the flushed output of the encoder which is not yet written.
+	 */
+	virtual uint64_t bufferedBytes(StreamEncoderImpl& encoder) {return 0;}
 
 	// Http::Connection
 	void dispatch(sp<EIoBuffer>& data) override;
 	void goAway() override {} // Called during connection manager drain flow
 	Protocol protocol() override {return protocol_;}
+	void onConnectionClosed() override {parser_signal_.signal();}
 
 	virtual bool supports_http_10() {return false;}
 
@@ -167,6 +203,21 @@ protected:
 	ConnectionImpl(sp<EHttpSession>& connection, http_parser_type type);
 
 	bool resetStreamCalled() {return reset_stream_called_;}
+	bool readDisabled() {return read_disable_count_.load() > 0;}
+
+	/**
+	 * Called when the parser was paused by a callback, before it goes on with the rest of the
+	 * dispatched data. A wait here is woken by parser_signal_.
+	 */
+	virtual void onParserPaused() {}
+
+	/**
+	 * Append a fragment of a header name, value or url, copied into the arena of the header map.
+	 * @param string supplies the string to append to.
+	 * @param data supplies the start address.
+	 * @param length supplies the length.
+	 */
+	void appendFragment(HeaderString& string, const char* data, size_t length);
 
 	sp<EHttpSession> connection_;
 	http_parser parser_;
@@ -254,10 +305,9 @@ private:
 	HeaderString current_header_field_;
 	HeaderString current_header_value_;
 	bool reset_stream_called_ {};
+	std::atomic<int> read_disable_count_ {0};
+	EWakeSignal parser_signal_; // wakes a paused dispatch.
 
-	Buffer::OwnedImpl output_buffer_;
-
-	sp<EIoBuffer> reserved_iovec_;
 	Protocol protocol_ {Protocol::Http11};
 };
 
@@ -271,6 +321,10 @@ public:
 
 	virtual bool supports_http_10() override {return codec_settings_.accept_http_10_;}
 
+	// ConnectionImpl
+	void flushOutput(StreamEncoderImpl& encoder) override;
+	uint64_t bufferedBytes(StreamEncoderImpl& encoder) override;
+
 private:
 	/**
 	 * An active HTTP/1.1 request.
@@ -283,8 +337,24 @@ private:
 		HeaderString request_url_;
 		StreamDecoder* request_decoder_ { };
 		ResponseStreamEncoderImpl response_encoder_;bool remote_complete_ { };
+		bool encode_complete_ { };
+		Buffer::OwnedImpl output_; // flushed by the encoder, held until the earlier ones written.
 	};
 
+	typedef std::unique_ptr<ActiveRequest> ActiveRequestPtr;
+
+	/**
+	 * @return ActiveRequest* the pipelined request of the encoder, or nullptr if it was reset.
+	 */
+	ActiveRequest* findRequest(StreamEncoderImpl& encoder);
+
+	/**
+	 * Writes the held output of the pipelined requests in the request order, the output of all
+	 * the requests which are ready is coalesced into one write. Only one caller writes at a time,
+	 * the others leave their output to it.
+	 */
+	void writePipeline();
+
 	/**
 	 * Manipulate the request's first line, parsing the url and converting to a relative path if
 	 * neccessary. Compute Host / :authority headers based on 7230#5.7 and 7230#6
@@ -295,8 +365,15 @@ private:
 	 */
 	void handlePath(HeaderMapImpl& headers, unsigned int method);
 
+	/**
+	 * @param method supplies the http_parser method of a request.
+	 * @return Method the classified method.
+	 */
+	static Method toMethod(unsigned int method);
+
 	// ConnectionImpl
-	void onEncodeComplete() override;
+	void onEncodeComplete(StreamEncoderImpl& encoder) override;
+	void onParserPaused() override;
 	void onMessageBegin() override;
 	void onUrl(const char* data, size_t length) override;
 	int onHeadersComplete(HeaderMapImplPtr&& headers) override;
@@ -306,8 +383,14 @@ private:
 	void sendProtocolError() override;
 
 	ServerConnectionCallbacks& callbacks_;
-	std::unique_ptr<ActiveRequest> active_request_;
+	ActiveRequest* active_request_ { }; // the request being decoded, owned by pipeline_.
 	Http1Settings codec_settings_;
+
+	// Requests in the receive order, a request leaves when it is complete on both sides and its
+	// output is written. The responses may be encoded by other fibers or threads.
+	ESpinLock pipeline_lock_;
+	std::list<ActiveRequestPtr> pipeline_;
+	bool writing_ { };
 };
 
 } // namespace http1
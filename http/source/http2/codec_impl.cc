@@ -1,7 +1,9 @@
 #include "./codec_impl.h"
 
 #include "../../../inc/EHttpSession.hh"
+#include "../../../inc/EIoBufferChain.hh"
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <vector>
@@ -146,8 +148,11 @@ void ConnectionImpl::StreamImpl::encodeTrailers(const HeaderMap& trailers) {
 	}
 }
 
-void ConnectionImpl::StreamImpl::saveHeader(HeaderString&& name, HeaderString&&value) {
-	if (!Utility::reconstituteCrumbledCookies(name, value, cookies_)) {
+void ConnectionImpl::StreamImpl::saveHeader(HeaderString&& name, HeaderString&&value,
+		HeaderMapImpl::InlineSlot slot) {
+	if (slot) {
+		headers_->addInline(slot, std::move(value));
+	} else if (!Utility::reconstituteCrumbledCookies(name, value, cookies_)) {
 		headers_->addViaMove(std::move(name), std::move(value));
 	}
 }
@@ -190,17 +195,9 @@ int ConnectionImpl::StreamImpl::onDataSourceSend(const uint8_t* framehd,
 	// https://nghttp2.org/documentation/types.html#c.nghttp2_send_data_callback
 	static const uint64_t FRAME_HEADER_SIZE = 9;
 
-	Buffer::OwnedImpl output(framehd, FRAME_HEADER_SIZE);
-	output.move(pending_send_data_, length);
-
-	//parent_.connection_.write(output, false);
-	//cxxjava
-	Buffer::LinkedBuffer& lb = output.buffer();
-	sp<EIoBuffer> buf;
-	while ((buf = lb.poll()) != null) {
-		parent_.connection_->write(buf);
-	}
-
+	parent_.appendOutput(framehd, FRAME_HEADER_SIZE);
+	parent_.appendOutput(pending_send_data_, length);
+	runBufferedDataSentCallbacks();
 	return 0;
 }
 
@@ -240,6 +237,9 @@ void ConnectionImpl::StreamImpl::encodeData(Buffer::Instance& data,
 }
 
 void ConnectionImpl::StreamImpl::resetStream(StreamResetReason reason) {
+	// Higher layers expect calling resetStream() to immediately raise reset callbacks.
+	runResetCallbacks(reason);
+
 	// If we submit a reset, nghttp2 will cancel outbound frames that have not yet been sent.
 	// We want these frames to go out so we defer the reset until we send all of the frames that
 	// end the local stream.
@@ -256,6 +256,21 @@ void ConnectionImpl::StreamImpl::resetStream(StreamResetReason reason) {
 	parent_.sendPendingFrames();
 }
 
+void ConnectionImpl::StreamImpl::readDisable(bool disable) {
+	if (disable) {
+		++read_disable_count_;
+	} else {
+		ES_ASSERT(read_disable_count_ > 0);
+		--read_disable_count_;
+		if (!buffers_overrun()) {
+			// Give the data held back to the peer window now.
+			parent_.consumeData(*this, unconsumed_bytes_);
+			unconsumed_bytes_ = 0;
+			parent_.sendPendingFrames();
+		}
+	}
+}
+
 void ConnectionImpl::StreamImpl::resetStreamWorker(StreamResetReason reason) {
 	int rc = nghttp2_submit_rst_stream(parent_.session_, NGHTTP2_FLAG_NONE,
 			stream_id_,
@@ -296,13 +311,40 @@ int ConnectionImpl::onData(int32_t stream_id, const uint8_t* data, size_t len) {
 	// Update the window to the peer unless some consumer of this stream's data has hit a flow control
 	// limit and disabled reads on this stream
 	if (!stream->buffers_overrun()) {
-		nghttp2_session_consume(session_, stream_id, len);
+		consumeData(*stream, len);
 	} else {
 		stream->unconsumed_bytes_ += len;
 	}
 	return 0;
 }
 
+void ConnectionImpl::consumeData(StreamImpl& stream, uint32_t length) {
+	// With no_auto_window_update nghttp2 leaves the WINDOW_UPDATEs to us. They are batched: a
+	// window is given back once the consumed bytes reach its threshold, and the frames queued
+	// during a dispatch() go out by one write after it.
+	stream.unacked_bytes_ += length;
+	if (stream.unacked_bytes_ >= stream_window_update_threshold_) {
+		int rc = nghttp2_submit_window_update(session_, NGHTTP2_FLAG_NONE, stream.stream_id_,
+				stream.unacked_bytes_);
+		ES_ASSERT(rc == 0);
+		UNREFERENCED_PARAMETER(rc);
+		stream.unacked_bytes_ = 0;
+	}
+
+	consumeConnectionData(length);
+}
+
+void ConnectionImpl::consumeConnectionData(uint32_t length) {
+	connection_unacked_bytes_ += length;
+	if (connection_unacked_bytes_ >= connection_window_update_threshold_) {
+		int rc = nghttp2_submit_window_update(session_, NGHTTP2_FLAG_NONE, 0,
+				connection_unacked_bytes_);
+		ES_ASSERT(rc == 0);
+		UNREFERENCED_PARAMETER(rc);
+		connection_unacked_bytes_ = 0;
+	}
+}
+
 void ConnectionImpl::goAway() {
 	int rc = nghttp2_submit_goaway(session_, NGHTTP2_FLAG_NONE,
 			nghttp2_session_get_last_proc_stream_id(session_), NGHTTP2_NO_ERROR,
@@ -356,6 +398,12 @@ int ConnectionImpl::onFrameReceived(const nghttp2_frame* frame) {
 		}
 
 		case NGHTTP2_HCAT_REQUEST: {
+			// nghttp2 checked the request has one :method.
+			const HeaderEntry* method = stream->headers_->Method();
+			if (method) {
+				stream->headers_->setMethod(MethodUtility::fromString(method->value().c_str(),
+						method->value().size()));
+			}
 			stream->decoder_->decodeHeaders(std::move(stream->headers_),
 					stream->remote_end_stream_);
 			break;
@@ -468,27 +516,94 @@ int ConnectionImpl::onInvalidFrame(int error_code) {
 }
 
 ssize_t ConnectionImpl::onSend(const uint8_t* data, size_t length) {
-	//cxxjava
-	//Buffer::OwnedImpl buffer(data, length);
-	//connection_.write(buffer, false);
-	sp<EIoBuffer> buf = EIoBuffer::wrap(data, length);
-	connection_->write(buf);
-
+	// The data is only valid in this callback, copy it. It is written by flushOutput() when
+	// nghttp2_session_send() returns.
+	appendOutput(data, length);
 	return length;
 }
 
-int ConnectionImpl::onStreamClose(int32_t stream_id, uint32_t error_code) {
-	UNREFERENCED_PARAMETER(error_code);
+void ConnectionImpl::appendOutput(const void* data, size_t length) {
+	if (output_frames_ != null && static_cast<size_t>(output_frames_->remaining()) < length) {
+		output_.add(output_frames_);
+		output_frames_ = null;
+	}
+	if (output_frames_ == null) {
+		output_frames_ = EIoBuffer::allocate(std::max<size_t>(length, OUTPUT_FRAMES_SIZE));
+	}
+	output_frames_->put(data, length);
+}
+
+void ConnectionImpl::appendOutput(Buffer::Instance& data, uint64_t length) {
+	// Close the frames copied so far to keep the order.
+	if (output_frames_ != null) {
+		output_.add(output_frames_);
+		output_frames_ = null;
+	}
+
+	Buffer::LinkedBuffer& that_buf = dynamic_cast<Buffer::OwnedImpl&>(data).buffer();
+	Buffer::LinkedBuffer& lb = output_.buffer();
+	sp<EIoBuffer> buf;
+	while (length > 0 && (buf = that_buf.peek()) != null) {
+		if (length >= static_cast<uint64_t>(buf->remaining())) {
+			length -= buf->remaining();
+			lb.add(buf);
+			that_buf.removeFirst();
+		} else {
+			// A DATA frame ends inside this buffer, reference the part of it.
+			sp<EIoBuffer> slice(buf->getSlice(static_cast<int>(length)));
+			lb.add(slice);
+			output_retained_.add(buf);
+			length = 0;
+		}
+	}
+}
+
+void ConnectionImpl::flushOutput() {
+	if (output_frames_ != null) {
+		output_.add(output_frames_);
+		output_frames_ = null;
+	}
+
+	ON_SCOPE_EXIT(
+		output_.clear();
+		output_retained_.clear();
+	);
+
+	Buffer::LinkedBuffer& lb = output_.buffer();
+	if (lb.isEmpty() || connection_->isClosed()) {
+		return;
+	}
+	if (lb.size() == 1) {
+		connection_->write(lb.peek());
+	} else {
+		// One session write for the frames: the filter chain passes buffer chains through, the
+		// session coalesces them into tls records or writes them by writev(), which still takes
+		// more calls when the socket buffer is full.
+		sp<EIoBufferChain> chain(new EIoBufferChain());
+		for (auto buf : lb) {
+			chain->add(buf);
+		}
+		connection_->write(chain);
+	}
+}
 
+int ConnectionImpl::onStreamClose(int32_t stream_id, uint32_t error_code) {
 	StreamImpl* stream = getStream(stream_id);
 	if (stream) {
+		if (!stream->remote_end_stream_ || !stream->local_end_stream_) {
+			stream->runResetCallbacks(error_code == NGHTTP2_REFUSED_STREAM ?
+					StreamResetReason::RemoteRefusedStreamReset : StreamResetReason::RemoteReset);
+		}
+		stream->runDestroyCallbacks();
+
 		//cxxjava
 		//connection_.dispatcher().deferredDelete(stream->removeFromList(active_streams_));
 
 		// Any unconsumed data must be consumed before the stream is deleted.
 		// nghttp2 does not appear to track this internally, and any stream deleted
 		// with outstanding window will contribute to a slow connection-window leak.
-		nghttp2_session_consume(session_, stream_id, stream->unconsumed_bytes_);
+		// The stream window is gone, only the connection window is given back.
+		consumeConnectionData(stream->unconsumed_bytes_);
 		stream->unconsumed_bytes_ = 0;
 		nghttp2_session_set_stream_user_data(session_, stream->stream_id_,
 				nullptr);
@@ -501,7 +616,7 @@ int ConnectionImpl::onStreamClose(int32_t stream_id, uint32_t error_code) {
 }
 
 int ConnectionImpl::saveHeader(const nghttp2_frame* frame, HeaderString&& name,
-HeaderString&& value) {
+HeaderString&& value, HeaderMapImpl::InlineSlot slot) {
 	StreamImpl* stream = getStream(frame->hd.stream_id);
 	if (!stream) {
 		// We have seen 1 or 2 crashes where we get a headers callback but there is no associated
@@ -513,7 +628,7 @@ HeaderString&& value) {
 		return 0;
 	}
 
-	stream->saveHeader(std::move(name), std::move(value));
+	stream->saveHeader(std::move(name), std::move(value), slot);
 	if (stream->headers_->byteSize() > StreamImpl::MAX_HEADER_SIZE) {
 		// This will cause the library to reset/close the stream.
 		return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
@@ -529,6 +644,7 @@ void ConnectionImpl::sendPendingFrames() {
 	}
 
 	int rc = nghttp2_session_send(session_);
+	flushOutput();
 	if (rc != 0) {
 		ES_ASSERT(rc == NGHTTP2_ERR_CALLBACK_FAILURE);
 		throw CodecProtocolException(__FILE__, __LINE__, nghttp2_strerror(rc));
@@ -569,6 +685,8 @@ void ConnectionImpl::sendSettings(const Http2Settings& http2_settings,
 			http2_settings.initial_connection_window_size_ &&
 			http2_settings.initial_connection_window_size_ <=
 			Http2Settings::MAX_INITIAL_CONNECTION_WINDOW_SIZE);
+	ES_ASSERT(Http2Settings::MIN_WINDOW_UPDATE_THRESHOLD <= http2_settings.window_update_threshold_ &&
+			http2_settings.window_update_threshold_ <= Http2Settings::MAX_WINDOW_UPDATE_THRESHOLD);
 
 	std::vector<nghttp2_settings_entry> iv;
 
@@ -622,6 +740,54 @@ void ConnectionImpl::sendSettings(const Http2Settings& http2_settings,
 	}
 }
 
+int ConnectionImpl::onHeader(const nghttp2_frame* frame, nghttp2_rcbuf* name_buf,
+		nghttp2_rcbuf* value_buf) {
+	HeaderString name;
+	HeaderString value;
+	HeaderMapImpl::InlineSlot slot = nullptr;
+
+	StreamImpl* stream = getStream(frame->hd.stream_id);
+	if (stream && stream->headers_) {
+		slot = inlineSlot(name_buf);
+		if (!slot) {
+			toHeaderString(name, name_buf, *stream->headers_);
+		}
+		toHeaderString(value, value_buf, *stream->headers_);
+	}
+
+	return onHeader(frame, std::move(name), std::move(value), slot);
+}
+
+void ConnectionImpl::toHeaderString(HeaderString& string, nghttp2_rcbuf* buf,
+		HeaderMapImpl& headers) {
+	nghttp2_vec vec = nghttp2_rcbuf_get_buf(buf);
+	if (nghttp2_rcbuf_is_static(buf)) {
+		// A static table entry, it is null terminated and lives as long as the process.
+		string.setReference(reinterpret_cast<const char*>(vec.base), vec.len);
+	} else {
+		// The reference count of a dynamic table entry is not atomic, and the request may be freed
+		// by a worker thread while nghttp2 shares the entry with the next requests. Copy it into
+		// the arena of the map, which is not a heap allocation per header.
+		headers.arenaString(string, reinterpret_cast<const char*>(vec.base), vec.len);
+	}
+}
+
+HeaderMapImpl::InlineSlot ConnectionImpl::inlineSlot(nghttp2_rcbuf* name) {
+	if (!nghttp2_rcbuf_is_static(name)) {
+		return nullptr;
+	}
+
+	// The static table entries never move, so their addresses are the cache keys.
+	InlineSlotEntry& entry = inline_slots_[(reinterpret_cast<uintptr_t>(name) >> 4)
+			% inline_slots_.size()];
+	if (entry.name_ != name) {
+		entry.name_ = name;
+		entry.slot_ = HeaderMapImpl::inlineSlot(
+				reinterpret_cast<const char*>(nghttp2_rcbuf_get_buf(name).base));
+	}
+	return entry.slot_;
+}
+
 ConnectionImpl::Http2Callbacks::Http2Callbacks() {
 	nghttp2_session_callbacks_new(&callbacks_);
 	nghttp2_session_callbacks_set_send_callback(callbacks_,
@@ -642,17 +808,10 @@ ConnectionImpl::Http2Callbacks::Http2Callbacks() {
 				return static_cast<ConnectionImpl*>(user_data)->onBeginHeaders(frame);
 			});
 
-	nghttp2_session_callbacks_set_on_header_callback(callbacks_,
-			[](nghttp2_session*, const nghttp2_frame* frame, const uint8_t* raw_name, size_t name_length,
-					const uint8_t* raw_value, size_t value_length, uint8_t, void* user_data) -> int {
-
-				// TODO PERF: Can reference count here to avoid copies.
-				HeaderString name;
-				name.setCopy(reinterpret_cast<const char*>(raw_name), name_length);
-				HeaderString value;
-				value.setCopy(reinterpret_cast<const char*>(raw_value), value_length);
-				return static_cast<ConnectionImpl*>(user_data)->onHeader(frame, std::move(name),
-						std::move(value));
+	nghttp2_session_callbacks_set_on_header_callback2(callbacks_,
+			[](nghttp2_session*, const nghttp2_frame* frame, nghttp2_rcbuf* name,
+					nghttp2_rcbuf* value, uint8_t, void* user_data) -> int {
+				return static_cast<ConnectionImpl*>(user_data)->onHeader(frame, name, value);
 			});
 
 	nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks_,
@@ -739,11 +898,11 @@ int ServerConnectionImpl::onBeginHeaders(const nghttp2_frame* frame) {
 }
 
 int ServerConnectionImpl::onHeader(const nghttp2_frame* frame, HeaderString&& name,
-                                   HeaderString&& value) {
+                                   HeaderString&& value, HeaderMapImpl::InlineSlot slot) {
 	// For a server connection, we should never get push promise frames.
 	ES_ASSERT(frame->hd.type == NGHTTP2_HEADERS);
 	ES_ASSERT(frame->headers.cat == NGHTTP2_HCAT_REQUEST || frame->headers.cat == NGHTTP2_HCAT_HEADERS);
-	return saveHeader(frame, std::move(name), std::move(value));
+	return saveHeader(frame, std::move(name), std::move(value), slot);
 }
 
 } // namespace Http2
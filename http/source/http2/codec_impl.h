@@ -2,6 +2,8 @@
 
 //#include "../../../inc/EHttpSession.hh"
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <list>
 #include <memory>
@@ -11,6 +13,7 @@
 #include "../../include/codec.h"
 
 #include "../buffer_impl.h"
+#include "../codec_helper.h"
 #include "../linked_object.h"
 #include "../header_map_impl.h"
 
@@ -58,9 +61,12 @@ public:
 	ConnectionImpl(sp<EHttpSession>& connection, /*Stats::Scope& stats,*/
 	const Http2Settings& http2_settings) :
 		connection_(connection), per_stream_buffer_limit_(
-				http2_settings.initial_stream_window_size_), dispatching_(
-				false), raised_goaway_(false), pending_deferred_reset_(
-				false) {
+				http2_settings.initial_stream_window_size_),
+		stream_window_update_threshold_(windowUpdateThreshold(
+				http2_settings.initial_stream_window_size_, http2_settings.window_update_threshold_)),
+		connection_window_update_threshold_(windowUpdateThreshold(
+				http2_settings.initial_connection_window_size_, http2_settings.window_update_threshold_)),
+		dispatching_(false), raised_goaway_(false), pending_deferred_reset_(false) {
 	}
 
 	~ConnectionImpl();
@@ -106,7 +112,8 @@ protected:
 	 */
 	struct StreamImpl : public StreamEncoder,
 	public Stream,
-	public LinkedObject<StreamImpl> {
+	public LinkedObject<StreamImpl>,
+	public StreamCallbackHelper {
 		StreamImpl(ConnectionImpl& parent, uint32_t buffer_limit);
 
 		StreamImpl* base() {return this;}
@@ -114,7 +121,7 @@ protected:
 		int onDataSourceSend(const uint8_t* framehd, size_t length);
 		void resetStreamWorker(StreamResetReason reason);
 		static void buildHeaders(std::vector<nghttp2_nv>& final_headers, const HeaderMap& headers);
-		void saveHeader(HeaderString&& name, HeaderString&& value);
+		void saveHeader(HeaderString&& name, HeaderString&& value, HeaderMapImpl::InlineSlot slot);
 		virtual void submitHeaders(const std::vector<nghttp2_nv>& final_headers,
 				nghttp2_data_provider* provider) = 0;
 		void submitTrailers(const HeaderMap& trailers);
@@ -124,9 +131,14 @@ protected:
 		void encodeHeaders(const HeaderMap& headers, bool end_stream) override;
 		void encodeData(Buffer::Instance& data, bool end_stream) override;
 		void encodeTrailers(const HeaderMap& trailers) override;
+		Stream& getStream() override {return *this;}
 
 		// Http::Stream
+		void addCallbacks(StreamCallbacks& callbacks) override {addCallbacks_(callbacks);}
+		void removeCallbacks(StreamCallbacks& callbacks) override {removeCallbacks_(callbacks);}
 		void resetStream(StreamResetReason reason) override;
+		void readDisable(bool disable) override;
+		uint64_t bufferedBytes() override {return pending_send_data_.length();}
 
 		// Max header size of 63K. This is arbitrary but makes it easier to test since nghttp2 doesn't
 		// appear to transmit headers greater than approximtely 64K (NGHTTP2_MAX_HEADERSLEN) for reasons
@@ -140,6 +152,8 @@ protected:
 		StreamDecoder* decoder_ {};
 		int32_t stream_id_ {-1};
 		uint32_t unconsumed_bytes_ {0};
+		// consumed and not given back to the peer yet.
+		uint32_t unacked_bytes_ {0};
 		uint32_t read_disable_count_ {0};
 		Buffer::OwnedImpl pending_recv_data_ {};
 		Buffer::OwnedImpl pending_send_data_ {};
@@ -181,9 +195,19 @@ protected:
 
 	ConnectionImpl* base() {return this;}
 	StreamImpl* getStream(int32_t stream_id);
-	int saveHeader(const nghttp2_frame* frame, HeaderString&& name, HeaderString&& value);
+	int saveHeader(const nghttp2_frame* frame, HeaderString&& name, HeaderString&& value,
+			HeaderMapImpl::InlineSlot slot);
 	void sendPendingFrames();
+	void appendOutput(const void* data, size_t length);
+	void appendOutput(Buffer::Instance& data, uint64_t length);
+	void flushOutput();
 	void sendSettings(const Http2Settings& http2_settings, bool disable_push);
+	void consumeData(StreamImpl& stream, uint32_t length);
+	void consumeConnectionData(uint32_t length);
+
+	static uint32_t windowUpdateThreshold(uint32_t window_size, uint32_t percent) {
+		return std::max<uint32_t>(static_cast<uint64_t>(window_size) * percent / 100, 1);
+	}
 
 	static Http2Callbacks http2_callbacks_;
 	static Http2Options http2_options_;
@@ -193,17 +217,47 @@ protected:
 	sp<EHttpSession> connection_;
 	uint32_t per_stream_buffer_limit_;
 
+	// Consumed DATA is given back to the peer by one WINDOW_UPDATE once it reaches the threshold.
+	uint32_t stream_window_update_threshold_;
+	uint32_t connection_window_update_threshold_;
+	uint32_t connection_unacked_bytes_ {0};
+
+	// The frames of one nghttp2_session_send(), flushed by one gather write. Small frames are
+	// copied into output_frames_, DATA payloads are referenced.
+	Buffer::OwnedImpl output_ {};
+	sp<EIoBuffer> output_frames_;
+	// Buffers which output_ holds slices of, they must live until the flush.
+	Buffer::LinkedBuffer output_retained_ {};
+
+	static const uint32_t OUTPUT_FRAMES_SIZE = 4096;
+
 private:
 	virtual ConnectionCallbacks& callbacks() = 0;
 	virtual int onBeginHeaders(const nghttp2_frame* frame) = 0;
 	int onData(int32_t stream_id, const uint8_t* data, size_t len);
 	int onFrameReceived(const nghttp2_frame* frame);
 	int onFrameSend(const nghttp2_frame* frame);
-	virtual int onHeader(const nghttp2_frame* frame, HeaderString&& name, HeaderString&& value) = 0;
+	virtual int onHeader(const nghttp2_frame* frame, HeaderString&& name, HeaderString&& value,
+			HeaderMapImpl::InlineSlot slot) = 0;
 	int onInvalidFrame(int error_code);
 	ssize_t onSend(const uint8_t* data, size_t length);
 	int onStreamClose(int32_t stream_id, uint32_t error_code);
 
+	/**
+	 * Called with the reference counted buffers of a decoded header. The static table entries are
+	 * referenced without a copy, and the known names go to the inline header slots directly.
+	 */
+	int onHeader(const nghttp2_frame* frame, nghttp2_rcbuf* name, nghttp2_rcbuf* value);
+	void toHeaderString(HeaderString& string, nghttp2_rcbuf* buf, HeaderMapImpl& headers);
+	HeaderMapImpl::InlineSlot inlineSlot(nghttp2_rcbuf* name);
+
+	struct InlineSlotEntry {
+		const nghttp2_rcbuf* name_ {};
+		HeaderMapImpl::InlineSlot slot_ {};
+	};
+
+	std::array<InlineSlotEntry, 64> inline_slots_ {};
+
 	bool dispatching_ : 1;
 	bool raised_goaway_ : 1;
 	bool pending_deferred_reset_ : 1;
@@ -221,7 +275,8 @@ private:
 	// ConnectionImpl
 	ConnectionCallbacks& callbacks() override {return callbacks_;}
 	int onBeginHeaders(const nghttp2_frame* frame) override;
-	int onHeader(const nghttp2_frame* frame, HeaderString&& name, HeaderString&& value) override;
+	int onHeader(const nghttp2_frame* frame, HeaderString&& name, HeaderString&& value,
+			HeaderMapImpl::InlineSlot slot) override;
 
 	ServerConnectionCallbacks& callbacks_;
 };
@@ -4,6 +4,7 @@
 #include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <iterator>
 #include <string>
 
@@ -187,6 +188,38 @@ const std::string& StringUtil::nonEmptyStringOrDefault(const std::string& s,
 	return s.empty() ? default_value : s;
 }
 
+Method MethodUtility::fromString(const char* data, size_t size) {
+	// The size and the first char pick the one candidate to compare.
+	if (size < 3) {
+		return Method::Other;
+	}
+	switch (data[0]) {
+	case 'G':
+		return (size == 3 && memcmp(data, "GET", 3) == 0) ? Method::Get : Method::Other;
+	case 'H':
+		return (size == 4 && memcmp(data, "HEAD", 4) == 0) ? Method::Head : Method::Other;
+	case 'P':
+		if (size == 4) {
+			return (memcmp(data, "POST", 4) == 0) ? Method::Post : Method::Other;
+		} else if (size == 3) {
+			return (memcmp(data, "PUT", 3) == 0) ? Method::Put : Method::Other;
+		} else if (size == 5) {
+			return (memcmp(data, "PATCH", 5) == 0) ? Method::Patch : Method::Other;
+		}
+		return Method::Other;
+	case 'D':
+		return (size == 6 && memcmp(data, "DELETE", 6) == 0) ? Method::Delete : Method::Other;
+	case 'O':
+		return (size == 7 && memcmp(data, "OPTIONS", 7) == 0) ? Method::Options : Method::Other;
+	case 'T':
+		return (size == 5 && memcmp(data, "TRACE", 5) == 0) ? Method::Trace : Method::Other;
+	case 'C':
+		return (size == 7 && memcmp(data, "CONNECT", 7) == 0) ? Method::Connect : Method::Other;
+	default:
+		return Method::Other;
+	}
+}
+
 bool Primes::isPrime(uint32_t x) {
 	if (x < 4) {
 		return true; // eliminates special-casing 2.
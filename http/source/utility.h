@@ -12,6 +12,7 @@
 #include <vector>
 
 #include "./time.h"
+#include "../include/method.h"
 
 namespace efc {
 namespace naf {
@@ -191,6 +192,20 @@ public:
 			const std::string& default_value);
 };
 
+/**
+ * Utilities for request methods.
+ */
+class MethodUtility {
+public:
+	/**
+	 * Classify a :method value, methods are case sensitive.
+	 * @param data supplies the value.
+	 * @param size supplies the size of the value.
+	 * @return Method the method, Method::Other for an extension method.
+	 */
+	static Method fromString(const char* data, size_t size);
+};
+
 /**
  * Utilities for finding primes
  */
@@ -11,7 +11,9 @@
 #include "ELog.hh"
 
 #include "./EIoFilterAdapter.hh"
-#include "./ESubnet.hh"
+#include "./ESubnetTrie.hh"
+#include "./ESubnetFileWatcher.hh"
+#include "./ERcuReference.hh"
 
 namespace efc {
 namespace naf {
@@ -24,6 +26,10 @@ namespace naf {
 
 class EBlacklistFilter: public EIoFilterAdapter {
 public:
+	virtual ~EBlacklistFilter();
+
+	EBlacklistFilter();
+
 	/**
 	 * Sets the addresses to be blacklisted.
 	 *
@@ -63,9 +69,36 @@ public:
 	 */
 	EBlacklistFilter* setSubnetBlacklist(EIterable<ESubnet*>* subnets);
 
+	/**
+	 * Sets the subnets trie to be blacklisted, the filter takes the
+	 * ownership of it.
+	 *
+	 * The trie is published as an immutable snapshot: it's better to be
+	 * built off the io threads, sessions being checked keep using the old
+	 * one until they finished and the old one is freed after that.
+	 *
+	 * @param subnets a trie of subnets to be blacklisted.
+	 */
+	EBlacklistFilter* setSubnetBlacklist(ESubnetTrie* subnets);
+
+	/**
+	 * Loads the blacklist from a CIDR file and reloads it when the file
+	 * changed, see {@link ESubnetFileWatcher}.
+	 *
+	 * NOTE: this call will remove any previously blacklisted subnets.
+	 *
+	 * @param path the CIDR file.
+	 * @param intervalMillis the interval to check the file.
+	 * @throws EIOException if the file can not be read.
+	 */
+	EBlacklistFilter* watchBlacklistFile(const char* path, int intervalMillis=5000);
+
 	/**
 	 * Blocks the specified endpoint.
 	 *
+	 * NOTE: every single update copies the whole blacklist, use
+	 * {@link #setSubnetBlacklist(ESubnetTrie*)} for bulk updates.
+	 *
 	 * @param address The address to block
 	 */
 	EBlacklistFilter* block(EInetAddress* address);
@@ -101,8 +134,12 @@ public:
 private:
 	static sp<ELogger> LOGGER;// = LoggerFactory.getLogger(BlacklistFilter.class);
 
-	/** The list of blocked addresses */
-	ECopyOnWriteArrayList<ESubnet> blacklist;
+	/** The longest prefix match trie of blocked subnets, copy on write */
+	ERcuReference<ESubnetTrie> blacklist;
+	EReentrantLock updateLock;
+	sp<ESubnetFileWatcher> watcher;
+
+	void update(ESubnet* subnet, boolean add);
 
 	boolean isBlocked(EIoSession* session);
 };
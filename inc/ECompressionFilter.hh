@@ -0,0 +1,132 @@
+#ifndef ECOMPRESSIONFILTER_HH_
+#define ECOMPRESSIONFILTER_HH_
+
+#include "./EIoFilterAdapter.hh"
+#include "./EIoBuffer.hh"
+
+namespace efc {
+namespace naf {
+
+/**
+ * An {@link IoFilter} which compresses all data using zlib, in deflate
+ * (zlib wrapped) or gzip format.
+ *
+ * Every session has its own streaming deflate and inflate contexts, so
+ * the history window is shared by all messages of the session; each
+ * outbound message ends with a sync flush to let the peer decode it
+ * immediately. The contexts are reused from a per-thread pool.
+ *
+ * Outbound messages smaller than {@link #setMinCompressSize(int)} or
+ * already compressed (gzip, zip, png, jpeg, ...) are stored without
+ * compression inside the stream.
+ *
+ * Add this filter as the first one of the chain: inbound data is
+ * decompressed before any decoder, and an outbound message is passed to
+ * the filters behind first, the {@link EIoBuffer}, {@link EIoBufferChain}
+ * or {@link EFile} they encode it into is what gets compressed.
+ *
+ * The compression ratio and the time spent are reported by
+ * {@link EIoServiceStatistics}.
+ *
+ * @see: CompressionFilter.java
+ */
+
+class ECompressionFilter: public EIoFilterAdapter {
+public:
+	/**
+	 * Max compression level.  Will give the highest compression ratio, but
+	 * will also take more cpu time and is the slowest.
+	 */
+	static const int COMPRESSION_MAX = 9;
+
+	/**
+	 * Provides a good balance of speed and compression ratio.
+	 */
+	static const int COMPRESSION_DEFAULT = 6;
+
+	/**
+	 * Fastest compression, will also give the worst compression ratio.
+	 */
+	static const int COMPRESSION_MIN = 1;
+
+	/**
+	 * No compression done on the data.
+	 */
+	static const int COMPRESSION_NONE = 0;
+
+	enum Format {
+		ZLIB,
+		GZIP
+	};
+
+public:
+	virtual ~ECompressionFilter();
+
+	/**
+	 * Creates a new instance.
+	 *
+	 * @param compressInbound <tt>true</tt> if data read is to be decompressed
+	 * @param compressOutbound <tt>true</tt> if data written is to be compressed
+	 * @param compressionLevel the level of compression to be used.
+	 * @param format the stream format.
+	 */
+	ECompressionFilter(boolean compressInbound=true, boolean compressOutbound=true,
+			int compressionLevel=COMPRESSION_DEFAULT, Format format=ZLIB);
+
+	/**
+	 * Sets the size under which an outbound message is not compressed,
+	 * default is 64 bytes.
+	 */
+	ECompressionFilter* setMinCompressSize(int size);
+
+	/**
+	 * Sets the max bytes one inbound read can be decompressed to, the
+	 * session is failed if exceeded, default is 4M.
+	 */
+	ECompressionFilter* setMaxInflateSize(int size);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual boolean sessionCreated(EIoFilter::NextFilter* nextFilter, EIoSession* session) THROWS(EException);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual void sessionClosed(EIoFilter::NextFilter* nextFilter, EIoSession* session) THROWS(EException);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual sp<EObject> messageReceived(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) THROWS(EException);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual sp<EObject> messageSend(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) THROWS(EException);
+
+	/**
+	 * Returns <tt>true</tt> if the data starts with the magic of a well
+	 * known compressed format.
+	 */
+	static boolean isCompressed(const void* data, int size);
+
+private:
+	class Context;
+
+	boolean compressInbound;
+	boolean compressOutbound;
+	int compressionLevel;
+	Format format;
+	int minCompressSize;
+	int maxInflateSize;
+
+	Context* contextOf(EIoSession* session);
+	void setLevel(Context* ctx, int level, EIoBuffer* out);
+	void deflate(Context* ctx, const void* data, int size, int flush, EIoBuffer* out);
+	sp<EIoBuffer> inflate(Context* ctx, EIoBuffer* in);
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* ECOMPRESSIONFILTER_HH_ */
@@ -0,0 +1,146 @@
+#ifndef EEXECUTORFILTER_HH_
+#define EEXECUTORFILTER_HH_
+
+#include "./EIoFilterAdapter.hh"
+#include "./ESocketSession.hh"
+
+namespace efc {
+namespace naf {
+
+/**
+ * A filter that forwards the received messages to a pool of worker
+ * threads, so cpu heavy business logic does not stall the io fiber which
+ * keeps reading.
+ *
+ * The messages of one session are handled one by one in the received
+ * order, by at most one worker at a time; different sessions run in
+ * parallel. A non null object returned by the handler is written back
+ * in order by a writer fiber on the io thread of the session.
+ *
+ * At most <code>queueCapacity</code> messages of all sessions wait for
+ * a worker, a reading fiber which meets a full queue waits until there
+ * is room, so a slow handler slows down the peers instead of the memory
+ * growing without bound. Messages received after {@link #shutdown()}
+ * are dropped.
+ *
+ * Add this filter as the last one, the messages do not reach the session
+ * <code>read()</code>, which only returns on close.
+ *
+ * <pre>
+ *   EExecutorFilter executor(8);
+ *   executor.setHandler([](sp<ESocketSession>& session, sp<EObject> message) {
+ *       return process(message);
+ *   });
+ *   acceptor.getFilterChainBuilder()->addLast("executor", &executor);
+ * </pre>
+ *
+ * @see: ExecutorFilter.java
+ */
+
+class EExecutorFilter: public EIoFilterAdapter {
+public:
+	typedef std::function<sp<EObject>(sp<ESocketSession>& session, sp<EObject> message)> Handler;
+
+public:
+	virtual ~EExecutorFilter();
+
+	/**
+	 * Creates a new instance.
+	 *
+	 * @param threads the worker threads, 0 for the processor count.
+	 * @param queueCapacity the max messages waiting for a worker.
+	 */
+	EExecutorFilter(int threads=0, int queueCapacity=10000);
+
+	/**
+	 * Sets the handler called on the workers.
+	 */
+	void setHandler(Handler handler);
+
+	/**
+	 * Stops the workers after the queued messages, called by the
+	 * destructor too.
+	 */
+	void shutdown();
+
+	/**
+	 * Returns the number of worker threads.
+	 */
+	int getThreads();
+
+	/**
+	 * Returns the number of messages waiting for a worker now, and the
+	 * largest of it.
+	 */
+	int getQueueSize();
+	int getLargestQueueSize();
+
+	/**
+	 * Returns the average and the max time in millis a message waited in
+	 * the queue.
+	 */
+	double getAverageQueueWaitTime();
+	double getMaxQueueWaitTime();
+
+	/**
+	 * Returns the number of messages handled.
+	 */
+	llong getCompletedCount();
+
+	/**
+	 * Returns the number of times a reading fiber waited for a full queue.
+	 */
+	llong getBlockedCount();
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual boolean sessionCreated(EIoFilter::NextFilter* nextFilter, EIoSession* session) THROWS(EException);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual void sessionClosed(EIoFilter::NextFilter* nextFilter, EIoSession* session) THROWS(EException);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual sp<EObject> messageReceived(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) THROWS(EException);
+
+	/**
+	 *
+	 */
+	virtual EString toString();
+
+private:
+	class Event;
+	class SessionQueue;
+
+	static sp<ELogger> logger;
+
+	int queueCapacity;
+	EFiberChannel<EObject> slots; // a token per free slot of the queue.
+	Handler handler;
+	EArrayList<sp<EThread> > workers;
+
+	EReentrantLock lock;
+	ECondition* notEmpty;
+	ELinkedList<sp<SessionQueue> > ready; // sessions with messages and no worker.
+	boolean stopped;
+
+	EAtomicInteger queueSize;
+	EAtomicInteger largestQueueSize;
+	EAtomicLLong completedCount;
+	EAtomicLLong blockedCount;
+	EAtomicLLong waitNanos;
+	EAtomicLLong maxWaitNanos;
+
+	boolean schedule(sp<SessionQueue>& sq); // false if stopped.
+	void release(int count);
+	void work();
+	void process(sp<SessionQueue>& sq);
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* EEXECUTORFILTER_HH_ */
@@ -10,6 +10,12 @@
 
 #include "./ESocketAcceptor.hh"
 #include "./EHttpHandler.hh"
+#include "./EHttpRouter.hh"
+#include "./EHttpResponseCache.hh"
+
+#include "../http/include/codec.h"
+
+#include <map>
 
 namespace efc {
 namespace naf {
@@ -18,11 +24,19 @@ namespace naf {
  * {@link IoAcceptor} for http transport (HTTP&HTTP2).  This class
  * handles incoming http based socket connections.
  *
+ * Ssl services offer "h2" and "http/1.1" by ALPN and the codec follows
+ * the negotiated protocol, cleartext services detect h2c by the client
+ * connection preface.
  */
 
 class EHttpAcceptor: public ESocketAcceptor {
 public:
+	/**
+	 * The default min workers and the default queue capacity of each io
+	 * thread.
+	 */
 	static const int WORKERS = 10;
+	static const int QUEUE_CAPACITY = 100;
 
 public:
 	virtual ~EHttpAcceptor();
@@ -31,11 +45,117 @@ public:
 
 	virtual void listen() THROWS(EIOException);
 
+	using ESocketAcceptor::bind;
+
+	/**
+	 * Binds a service with its own HTTP/2 settings: the HPACK table size,
+	 * the max concurrent streams, the initial stream and connection
+	 * windows and the percent of a window received before it is given
+	 * back by one WINDOW_UPDATE. The other services use the defaults.
+	 *
+	 * Bulk transfers over links of a high bandwidth-delay product need
+	 * windows of at least the bandwidth times the round trip time.
+	 *
+	 * @throws EIllegalArgumentException if a setting is out of range.
+	 */
+	virtual void bind(int port, const Http::Http2Settings& http2, boolean ssl=false, const char* name=null, std::function<void(Service& service)> listener=null) THROWS(EIOException);
+	virtual void bind(const char* hostname, int port, const Http::Http2Settings& http2, boolean ssl=false, const char* name=null, std::function<void(Service& service)> listener=null) THROWS(EIOException);
+
+	/**
+	 * Returns the HTTP/2 settings of the service.
+	 */
+	const Http::Http2Settings& getHttp2Settings(Service* service);
+
 	/**
 	 *
 	 */
 	virtual void setHttpHandler(EHttpHandler* handler);
 
+	/**
+	 * Sets the router of the requests, its routes are added before
+	 * listening. A request without a route goes to the handler's method,
+	 * or is replied 404 or 405 if there is no handler. The handler's
+	 * service() is called before the routes.
+	 */
+	virtual void setHttpRouter(EHttpRouter* router);
+
+	/**
+	 * Sets the cache of the GET responses, a cached one is replied
+	 * without calling the handler or the router.
+	 */
+	virtual void setResponseCache(EHttpResponseCache* cache);
+
+	/**
+	 * Sets the request workers and the capacity of the request queue of
+	 * each io thread, before listening.
+	 *
+	 * A decoded request is queued to the io thread which decoded it and
+	 * the workers are spread over the queues, a worker takes requests
+	 * from its own queue first and steals from the others when it is
+	 * empty. A decoding fiber waits when its queue is full.
+	 *
+	 * @param workers the total workers, at least one per io thread.
+	 * @param queueCapacity the capacity of each queue.
+	 */
+	virtual void setWorkers(int workers, int queueCapacity=QUEUE_CAPACITY);
+
+	/**
+	 *
+	 */
+	int getWorkers();
+
+	/**
+	 * Returns the number of requests taken from other queues.
+	 */
+	llong getStolenRequestCount();
+
+	/**
+	 * Handles each request in the session fiber right after it is
+	 * decoded, without workers and channels, before listening. The
+	 * responses of the requests decoded from one read are written
+	 * together. Only for handlers which never block, a slow handler
+	 * stalls all sessions of the io thread.
+	 *
+	 * Not supported in the detached modes.
+	 */
+	virtual void setInlineHandling(boolean on);
+
+	/**
+	 *
+	 */
+	boolean isInlineHandling();
+
+	/**
+	 * Sets the max pipelined http/1.1 requests of a connection which are
+	 * handled at the same time, before listening. The responses are
+	 * written in the request order, the ones ready together by one write.
+	 * The connection is not read further while it is full.
+	 */
+	virtual void setMaxPipelineDepth(int depth);
+
+	/**
+	 *
+	 */
+	int getMaxPipelineDepth();
+
+	/**
+	 * Buffers the whole body of a request before the handler is called,
+	 * before listening. By default the handler is called once the headers
+	 * are decoded and reads the body by EHttpRequest::read(), which
+	 * bounds the memory of large uploads. Always on with inline handling.
+	 */
+	virtual void setRequestBuffering(boolean on);
+
+	/**
+	 *
+	 */
+	boolean isRequestBuffering();
+
+	/**
+	 * Returns true if the request bodies are streamed to the handlers.
+	 */
+	boolean isRequestStreaming();
+
 	/**
 	 *
 	 */
@@ -50,17 +170,42 @@ protected:
 	boolean rwIoDetached_;
 	boolean workerDetached_;
 	EHttpHandler* handler_;
+	EHttpRouter* router_;
+	EHttpResponseCache* cache_;
 
 private:
 	friend class ActiveStream;
 
-	EFiberChannel<EHttpRequest> requestChannel;
+	class RequestQueue;
+	class Worker;
+
+	boolean inline_;
+	boolean buffering_;
+	int pipelineDepth_;
+	int workers_;
+	int queueCapacity_;
+	EA<RequestQueue*> queues_;
+	EArrayList<sp<EThread> > workerThreads_; // of the detached workers.
+	volatile boolean stopping_;
+	EAtomicLLong stolenCount_;
+	Http::Http2Settings defaultHttp2Settings_;
+	std::map<Service*, Http::Http2Settings> http2Settings_; // by service, read only after bound.
+
+	/**
+	 *
+	 */
+	static void checkHttp2Settings(const Http::Http2Settings& http2);
 
 	/**
 	 * Override
 	 */
 	virtual sp<ESocketSession> newSession(EIoService *service, sp<ESocket>& socket);
 
+	/**
+	 * Override
+	 */
+	virtual void onServiceBound(Service* service);
+
 	/**
 	 * Override
 	 */
@@ -75,6 +220,23 @@ private:
 	 *
 	 */
 	void processRequest(sp<EHttpRequest> request);
+
+	/**
+	 * Queues a decoded request, called in the session fiber.
+	 */
+	void dispatchRequest(sp<EHttpRequest>& request);
+
+	/**
+	 * The loop of a worker of the queue.
+	 */
+	void work(int index, Worker* worker);
+	sp<EHttpRequest> pollRequest(int index);
+
+	/**
+	 * Wakes a sleeping worker of the queue.
+	 * @return false if all its workers are busy.
+	 */
+	boolean wakeWorker(int index);
 };
 
 } /* namespace naf */
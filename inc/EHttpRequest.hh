@@ -11,6 +11,7 @@
 #include "../http/include/buffer.h"
 #include "../http/include/header_map.h"
 #include "./EIoBuffer.hh"
+#include "./EWakeSignal.hh"
 
 namespace efc {
 namespace naf {
@@ -18,21 +19,108 @@ namespace naf {
 class ActiveStream;
 class HttpInputStream;
 
+/**
+ * A decoded request. Its body is buffered before the handler is called,
+ * or streamed: the handler is called once the headers are decoded and
+ * pulls the body by read(), the connection is not read further while
+ * too much of the body waits for it.
+ */
 class EHttpRequest: public efc::EObject {
 public:
-	EHttpRequest(ActiveStream* stream, Http::HeaderMapPtr headerMap);
+	/**
+	 * The streamed body bytes waiting for the reader which stop reading
+	 * of the connection, and the ones which resume it.
+	 */
+	static const int BODY_HIGH_WATERMARK = 1024 * 1024;
+	static const int BODY_LOW_WATERMARK = 256 * 1024;
+
+	/**
+	 * The path parameters captured at most by the router.
+	 */
+	static const int MAX_PATH_PARAMETERS = 8;
+
+	/**
+	 * A path parameter captured by the router, a view into the path of
+	 * the request which is valid as long as the request.
+	 */
+	struct PathParameter {
+		const char* name;
+		const char* value; // not null terminated.
+		int length;
+	};
+
+public:
+	EHttpRequest(ActiveStream* stream, Http::HeaderMapPtr headerMap, boolean streaming=false);
 
 	ActiveStream* getHttpStream();
 
-	Http::HeaderMapPtr getHeaderMap() { return headerMap; }
-	Http::Buffer::LinkedBuffer getBodyData() { return bodyData; }
+	Http::HeaderMapPtr& getHeaderMap() { return headerMap; }
+
+	/**
+	 * Returns the method, classified by the codec.
+	 */
+	Http::Method getMethod() { return headerMap->method(); }
+
+	/**
+	 * Returns the path parameter of the route, or null if none.
+	 */
+	const PathParameter* getPathParameter(const char* name);
+	const PathParameter* getPathParameter(int index);
+
+	/**
+	 *
+	 */
+	int getPathParameterCount();
+
+	/**
+	 * Returns the whole body, a streamed body is read to its end first.
+	 */
+	Http::Buffer::LinkedBuffer getBodyData();
+
+	/**
+	 * Reads the next chunk of the body, waits for it if streamed.
+	 *
+	 * @return the chunk, or null at the end of the body or if the
+	 *         stream was reset.
+	 */
+	sp<EIoBuffer> read();
+
+	/**
+	 *
+	 */
+	boolean isStreaming();
 
 private:
 	friend class ActiveStream;
+	friend class EHttpSession;
+	friend class EHttpRouter;
 
-	ActiveStream* stream;
+	ActiveStream* stream; // null after the stream is released.
 	Http::HeaderMapPtr headerMap;
+
+	ESpinLock bodyLock;
 	Http::Buffer::LinkedBuffer bodyData;
+	boolean streaming;
+	boolean bodyComplete;
+	boolean bodyPaused; // reading of the connection is disabled for it.
+	int bodyQueued;
+	EWakeSignal bodySignal; // wakes the reader on a chunk or the end.
+
+	PathParameter pathParameters[MAX_PATH_PARAMETERS];
+	int pathParameterCount;
+
+	/**
+	 * Queues a body chunk, called by the decoding stream.
+	 * @return true if the reading should be disabled.
+	 */
+	boolean offerBody(sp<EIoBuffer>& chunk);
+
+	/**
+	 * Ends the body, called by the decoding stream at the end or reset.
+	 * @param discard drops the chunks not read yet.
+	 * @return true if the reading should be resumed.
+	 */
+	boolean endBody(boolean discard);
 };
 
 } /* namespace naf */
@@ -9,8 +9,10 @@
 #define EHTTPRESPONSE_HH_
 
 #include "../inc/EIoBuffer.hh"
+#include "../inc/EWakeSignal.hh"
 #include "../http/include/header_map.h"
 #include "../http/source/header_map_impl.h"
+#include "../http/source/buffer_impl.h"
 
 namespace efc {
 namespace naf {
@@ -18,22 +20,99 @@ namespace naf {
 class ActiveStream;
 class EHttpSession;
 
+/**
+ * A response. The body written is sent when the handler returns, or
+ * earlier by flush(): the headers go first and the body follows in
+ * chunks, as DATA frames over HTTP/2 and chunk encoded over HTTP/1.1
+ * if there is no content-length. The handler waits in flush() while
+ * the connection holds too much of the response unsent.
+ */
 class EHttpResponse: public efc::EObject {
+public:
+	/**
+	 * The flushed body bytes not yet sent which make flush() wait.
+	 */
+	static const int FLUSH_HIGH_WATERMARK = 1024 * 1024;
+
 public:
 	EHttpResponse(ActiveStream* stream);
 
 	ActiveStream* getHttpStream();
 
+	/**
+	 * The headers, not to be changed once committed.
+	 */
 	Http::HeaderMap& getHeaderMap();
 
 	void write(const void* data, int len);
 
+	/**
+	 * Sends the headers if not yet and the body written so far, waits
+	 * while more than FLUSH_HIGH_WATERMARK bytes of it are unsent.
+	 */
+	void flush();
+
+	/**
+	 * Returns true once flushed, the headers are sent or being sent.
+	 */
+	boolean isCommitted();
+
 private:
 	friend class EHttpAcceptor;
+	friend class ActiveStream;
+	friend class EHttpResponseCache;
+
+	static const int CHUNK_SIZE = 4096;
 
 	ActiveStream* stream;
 	Http::HeaderMapImpl headerMap;
-	sp<EIoBuffer> bodyData;
+	sp<Http::HeaderMapImpl> sharedHeaders; // sent instead of headerMap, e.g. cached ones.
+
+	// written by the handler, not yet flushed.
+	Http::Buffer::OwnedImpl bodyData;
+	sp<EIoBuffer> bodyTail; // the chunk being written.
+
+	ESpinLock lock;
+	Http::Buffer::OwnedImpl pending; // flushed, not yet encoded.
+	uint64_t pendingBytes;
+	uint64_t heldBytes; // encoded and held by the codec, at the last send.
+	boolean committed;
+	boolean queued; // a send is on the way.
+	boolean headersSent;
+	boolean finished;
+	boolean ended;
+	EWakeSignal flushSignal; // wakes the handler in flush() when unsent bytes go out.
+
+	/**
+	 * Moves the written body to the pending one and has it sent.
+	 * @param finish ends the response.
+	 */
+	void commit(boolean finish);
+
+	/**
+	 * Ends the response when the handler returned.
+	 */
+	void finish();
+
+	/**
+	 * Encodes the pending body, called on the encoding side of the
+	 * session, its write fiber if read and write are detached.
+	 */
+	void send();
+
+	/**
+	 * Ends the response without sending the rest, e.g. its handler failed.
+	 * @return true if it was committed already.
+	 */
+	boolean cancel();
+
+	uint64_t unsentBytes();
+
+	/**
+	 * Returns true if nothing more is going to be sent, the response was
+	 * cancelled or the connection is closed.
+	 */
+	boolean isAborted();
 };
 
 class EndHttpResponse : public EHttpResponse {
@@ -41,6 +120,11 @@ public:
 	EndHttpResponse(): EHttpResponse(null) {}
 };
 
+class ResumeReadingHttpResponse : public EHttpResponse {
+public:
+	ResumeReadingHttpResponse(ActiveStream* stream): EHttpResponse(stream) {}
+};
+
 } /* namespace naf */
 } /* namespace efc */
 #endif /* EHTTPRESPONSE_HH_ */
@@ -0,0 +1,152 @@
+#ifndef EHTTPRESPONSECACHE_HH_
+#define EHTTPRESPONSECACHE_HH_
+
+#include "./EHttpRequest.hh"
+#include "./EHttpResponse.hh"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace efc {
+namespace naf {
+
+/**
+ * An in-memory cache of GET responses in front of the handlers, e.g.
+ *
+ *   EHttpResponseCache cache(64 * 1024 * 1024, 5000);
+ *   cache.addKeyHeader("accept-encoding");
+ *   acceptor.setResponseCache(&cache);
+ *
+ * A response is keyed by the host, the path and the key headers of its
+ * request. It is stored once replied with 200, unless flushed, larger
+ * than a quarter of the cache or marked "cache-control: no-store",
+ * "no-cache" or "private", or if it sets a cookie or varies on a header
+ * which is not a key header. The reply of a request with Authorization
+ * is stored only if marked "public" or "s-maxage". It lives for the
+ * ttl, or the "max-age" of its cache-control, and the least recently
+ * used ones are evicted when the cache is full.
+ *
+ * A request with "cache-control: no-cache" or "no-store" goes to the
+ * handler, the reply of a no-store one is not stored.
+ *
+ * A hit is replied without the handler: the headers and body stored
+ * are shared by all replies without a copy. The headers are kept as a
+ * map and encoded per reply, not as wire bytes: HTTP/2 encodes them by
+ * HPACK against the dynamic table of each connection, so encoded bytes
+ * can not be shared across connections or protocols. The body, most of
+ * the bytes, is sent as stored. Each stored response has
+ * an ETag, the handler's or a hash of the body, and a request whose
+ * If-None-Match has it is replied 304.
+ *
+ * Hits, misses and 304s are counted per io thread.
+ */
+
+class EHttpResponseCache: public EObject {
+public:
+	virtual ~EHttpResponseCache();
+
+	/**
+	 * @param maxBytes the memory bound of the stored responses.
+	 * @param ttl the time to live of a response in milliseconds.
+	 */
+	EHttpResponseCache(llong maxBytes, int ttl);
+
+	/**
+	 * Adds a request header to the key, e.g. one the response varies on,
+	 * responses which vary on other headers are not stored. Before
+	 * listening.
+	 */
+	void addKeyHeader(const char* name);
+
+	/**
+	 * Returns the replies from the cache, 304s not included.
+	 */
+	llong getHitCount();
+
+	/**
+	 * Returns the requests passed to the handlers.
+	 */
+	llong getMissCount();
+
+	/**
+	 * Returns the 304 replies.
+	 */
+	llong getNotModifiedCount();
+
+	/**
+	 * Returns the number of stored responses.
+	 */
+	int size();
+
+	/**
+	 * Returns the bytes of the stored responses.
+	 */
+	llong getBytes();
+
+	/**
+	 * Removes all responses.
+	 */
+	void clear();
+
+private:
+	friend class EHttpAcceptor;
+
+	struct Entry: public EObject {
+		std::string key;
+		sp<Http::HeaderMapImpl> headers;
+		sp<Http::HeaderMapImpl> notModified; // the 304 reply.
+		sp<EIoBuffer> body; // read only, null if empty.
+		std::string etag;
+		llong expires;
+		llong bytes;
+
+		// in the lru list, most recent first.
+		Entry* prev;
+		Entry* next;
+	};
+
+	struct ThreadCounters: public EObject {
+		EAtomicLLong hits;
+		EAtomicLLong misses;
+		EAtomicLLong notModified;
+	};
+
+	llong maxBytes_;
+	int ttl_;
+	std::vector<Http::LowerCaseString> keyHeaders_;
+
+	ESpinLock lock_;
+	std::unordered_map<std::string, sp<Entry> > entries_;
+	Entry* head_;
+	Entry* tail_;
+	llong bytes_;
+
+	EA<ThreadCounters*> counters_;
+
+	/**
+	 * Replies the request from the cache.
+	 * @return false if not cached, the handler replies it.
+	 */
+	boolean serve(sp<EHttpRequest>& request, sp<EHttpResponse>& response);
+
+	/**
+	 * Stores the response of the handler if it is cacheable.
+	 */
+	void store(sp<EHttpRequest>& request, sp<EHttpResponse>& response);
+
+	boolean keyOf(EHttpRequest* request, std::string& key);
+	boolean keyedOn(const Http::HeaderEntry* vary); // all varied headers are key headers.
+	ThreadCounters* counters();
+	void unlink(Entry* entry); // under the lock.
+	void remove(Entry* entry); // under the lock.
+
+	static const char* directiveOf(const Http::HeaderEntry* cacheControl, const char* directive); // its value, or null.
+	static boolean hasDirective(const Http::HeaderEntry* cacheControl, const char* directive);
+	static int maxAgeOf(const Http::HeaderEntry* cacheControl);
+	static boolean matches(const Http::HeaderEntry* ifNoneMatch, const std::string& etag);
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* EHTTPRESPONSECACHE_HH_ */
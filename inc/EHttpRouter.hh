@@ -0,0 +1,122 @@
+#ifndef EHTTPROUTER_HH_
+#define EHTTPROUTER_HH_
+
+#include "./EHttpSession.hh"
+#include "./EHttpRequest.hh"
+#include "./EHttpResponse.hh"
+
+#include "../http/include/codes.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace efc {
+namespace naf {
+
+/**
+ * Routes requests by method and path to their handlers, e.g.
+ *
+ *   router.add(Http::Method::Get, "/users/:id/posts/:post", getPost);
+ *   router.add(Http::Method::Get, "/static/*file", getFile);
+ *
+ * A pattern has static segments, parameter segments ":name" which
+ * match one segment, and a wildcard "*name" as the last segment which
+ * matches the rest of the path. The matched segments are captured as
+ * path parameters of the request, views into its path. Static segments
+ * take precedence over parameters and parameters over wildcards, a
+ * path falls back to the next candidate if the preferred one has no
+ * route of the method.
+ *
+ * The routes are kept in a compressed radix tree, a node only exists
+ * at a branch point or a parameter, and each node has a handler table
+ * indexed by method. Lookup is O(path length) whatever the number of
+ * routes and does not allocate.
+ *
+ * Not thread safe: routes must be added before listening.
+ */
+
+class EHttpRouter: public EObject {
+public:
+	typedef std::function<void(sp<EHttpSession>& session, sp<EHttpRequest>& request,
+			sp<EHttpResponse>& response)> Handler;
+
+public:
+	virtual ~EHttpRouter();
+
+	EHttpRouter();
+
+	/**
+	 * Adds the route.
+	 * @throws EIllegalArgumentException if the pattern is malformed or
+	 *         the route of the method exists already.
+	 */
+	void add(Http::Method method, const char* pattern, Handler handler);
+
+	/**
+	 * Calls the handler of the route of the request, its path parameters
+	 * captured.
+	 * @return Code::OK if routed, Code::NotFound if no route of the path,
+	 *         Code::MethodNotAllowed if the path only has routes of other
+	 *         methods.
+	 */
+	Http::Code route(sp<EHttpSession>& session, sp<EHttpRequest>& request, sp<EHttpResponse>& response);
+
+	/**
+	 * Returns the handler of the route of the method and path, or null if
+	 * none; the path parameters are stored in the request if not null.
+	 * The path may have a query, it is not matched.
+	 */
+	const Handler* find(Http::Method method, const char* path, int length, EHttpRequest* request=null);
+
+	/**
+	 * Returns the number of routes.
+	 */
+	int size();
+
+	/**
+	 * Removes all routes.
+	 */
+	void clear();
+
+private:
+	struct Route {
+		Handler handler;
+		std::vector<std::string> names; // of the parameters in the path order.
+	};
+
+	struct Node {
+		std::string prefix; // static part, empty for a parameter or wildcard.
+		std::vector<Node*> children; // static, by the first char of their prefix.
+		Node* param; // ":name" child.
+		Node* wildcard; // "*name" child, a leaf.
+		Route* routes[Http::NumMethods];
+		boolean terminal; // has a route.
+
+		Node(const std::string& prefix);
+		~Node();
+	};
+
+	struct Capture {
+		const char* value;
+		int length;
+	};
+
+	Node* root_;
+	int size_;
+
+	/**
+	 * Returns the node of the path with a route of the method, or null if
+	 * none; matched is set if a node of the path has a route of another
+	 * method.
+	 */
+	Node* lookup(Http::Method method, const char* path, int length, Capture* captures, int& count, boolean& matched);
+
+	static Node* match(int method, Node* node, const char* path, const char* end, Capture* captures, int& count, boolean& matched);
+	static Node* accept(int method, Node* node, boolean& matched);
+	static void capture(Route* route, Capture* captures, int count, EHttpRequest* request);
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* EHTTPROUTER_HH_ */
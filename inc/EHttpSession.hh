@@ -20,15 +20,37 @@ namespace naf {
 
 using namespace Http;
 
+/**
+ * A request and its response. It is complete when the request is fully
+ * decoded and the response fully encoded, or when the codec reset it and
+ * no worker is handling it any more; then the session takes it back to
+ * its free list for the next stream.
+ */
 class ActiveStream: public EObject,
 		public Http::StreamDecoder,
-		public Http::StreamEncoder {
+		public Http::StreamEncoder,
+		public Http::StreamCallbacks {
 public:
-	ActiveStream(EHttpSession* session, Http::StreamEncoder& encoder): session(session), response_encoder(&encoder) {}
+	ActiveStream(EHttpSession* session): session(session), id(0), response_encoder(null),
+			prev(null), next(null), remoteComplete(false), localComplete(false),
+			dispatched(false), reset(false) {}
 	virtual ~ActiveStream() {}
 
 	sp<EHttpSession> getHttpSession();
 
+	/**
+	 * Resets a stream whose response is never going to be finished, e.g.
+	 * its handler failed: replies 500, or resets it if the response is
+	 * committed already.
+	 */
+	void abort();
+
+	/**
+	 * Resumes reading of the connection, disabled while too much of the
+	 * streamed request body waits for the reader.
+	 */
+	void resumeReading();
+
 	// Http::StreamDecoder
 	virtual void decode100ContinueHeaders(HeaderMapPtr&& headers);
 	virtual void decodeHeaders(HeaderMapPtr&& headers, bool end_stream);
@@ -40,13 +62,45 @@ public:
 	virtual void encodeHeaders(const HeaderMap& headers, bool end_stream);
 	virtual void encodeData(Buffer::Instance& data, bool end_stream);
 	virtual void encodeTrailers(const HeaderMap& trailers);
+	virtual Http::Stream& getStream();
+
+	// Http::StreamCallbacks
+	virtual void onResetStream(StreamResetReason reason);
+	virtual void onStreamDestroyed();
+	virtual void onBufferedDataSent();
 
 private:
+	friend class EHttpSession;
+	friend class EHttpAcceptor;
+	friend class EHttpResponse;
+
 	EHttpSession* session;
-	Http::StreamEncoder* response_encoder;
+	llong id; // in the order of the session, recycled objects get a new one.
+	Http::StreamEncoder* response_encoder; // null once the codec has let go of its stream.
 
 	sp<EHttpRequest> request;
 	sp<EHttpResponse> response;
+
+	// in the active streams of the session.
+	ActiveStream* prev;
+	ActiveStream* next;
+
+	ESpinLock lock;
+	boolean remoteComplete;
+	boolean localComplete;
+	boolean dispatched; // handed to a worker, which ends the local side.
+	boolean reset;
+
+	Http::StreamEncoder* encoder();
+	void dispatch(boolean complete);
+	void readDisable(boolean disable);
+	boolean isDetached();
+	void sendResponse(); // has the flushed part of the response encoded.
+	uint64_t bufferedBytes(); // of the response held by the codec, 0 once reset.
+	void wakeResponse(); // a handler waiting in flush() checks its unsent bytes again.
+	void onRemoteComplete();
+	void onLocalComplete();
+	boolean isComplete(); // under the lock.
 };
 
 //=============================================================================
@@ -88,9 +142,21 @@ protected:
 
 	virtual void onGoAway();
 
+	/**
+	 * Returns the protocol selected by ALPN in the TLS handshake,
+	 * "h2" or "http/1.1", or null if none negotiated.
+	 */
+	const char* getNegotiatedProtocol();
+
 	EHttpAcceptor* acceptor;
 
-	ELinkedList<ActiveStream*> streams_;
+	// streams in use and recycled ones, released by workers too.
+	ESpinLock streamsLock_;
+	ActiveStream* streams_;
+	ELinkedList<ActiveStream*> freeStreams_;
+	llong streamIds_; // the last id of a stream.
+
+	static const int MAX_FREE_STREAMS = 128;
 
 
 	boolean isFirstRequest;
@@ -100,6 +166,17 @@ protected:
 
 	Http::Http1Settings hs1;
 	Http::Http2Settings hs2;
+
+	boolean corked;
+	sp<EIoBuffer> corkBuffer;
+
+	void createCodec(boolean http2);
+	void releaseStream(ActiveStream* stream);
+	sp<EIoBuffer> copyOf(sp<EByteBuffer>& data);
+	void dispatch(sp<EIoBuffer>& buf);
+	void cork();
+	void uncork();
+	void flushCork();
 };
 
 } /* namespace naf */
@@ -0,0 +1,70 @@
+#ifndef EIOBUFFERCHAIN_HH_
+#define EIOBUFFERCHAIN_HH_
+
+#include "./EIoBuffer.hh"
+
+namespace efc {
+namespace naf {
+
+/**
+ * An ordered list of {@link EIoBuffer}s written as one message.
+ *
+ * {@link ESocketSession} writes the remaining bytes of all buffers by one
+ * gather write (writev), so a header can be sent in front of a payload
+ * without copying them together. Ssl sessions coalesce a small chain into
+ * one record instead.
+ */
+
+class EIoBufferChain: public EObject {
+public:
+	virtual ~EIoBufferChain();
+
+	EIoBufferChain();
+
+	/**
+	 * Appends the buffer, its remaining bytes are written.
+	 */
+	EIoBufferChain* add(sp<EIoBuffer> buffer);
+
+	/**
+	 * Returns the buffer at <code>index</code>.
+	 */
+	sp<EIoBuffer> get(int index);
+
+	/**
+	 * Returns the number of buffers.
+	 */
+	int size();
+
+	/**
+	 * Returns the total remaining bytes of all buffers.
+	 */
+	llong remaining();
+
+	/**
+	 *
+	 */
+	boolean hasRemaining();
+
+	/**
+	 * Removes all buffers.
+	 */
+	void clear();
+
+	/**
+	 * Copies the remaining bytes of all buffers into a new one.
+	 */
+	sp<EIoBuffer> flatten();
+
+	/**
+	 *
+	 */
+	virtual EString toString();
+
+private:
+	EArrayList<sp<EIoBuffer> > buffers;
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* EIOBUFFERCHAIN_HH_ */
@@ -137,9 +137,86 @@ public:
 	 */
 	void setThroughputCalculationInterval(int throughputCalculationInterval);
 
+	/**
+	 * Returns the number of times a fiber was detected to block an io
+	 * thread longer than the watchdog threshold.
+	 *
+	 * @see ESocketAcceptor#setBlockedFiberThreshold(int,boolean)
+	 */
+	llong getBlockedFiberCount();
+
+	/**
+	 * Returns the number of bytes fed to the compressor, and the number of
+	 * compressed bytes it produced.
+	 *
+	 * @see ECompressionFilter
+	 */
+	llong getCompressionInputBytes();
+	llong getCompressionOutputBytes();
+
+	/**
+	 * Returns the compressed size against the original size, 1.0 if
+	 * nothing compressed.
+	 */
+	double getCompressionRatio();
+
+	/**
+	 * Returns the time in millis spent on compressing.
+	 */
+	llong getCompressionTime();
+
+	/**
+	 * Returns the number of compressed bytes fed to the decompressor, and
+	 * the number of bytes it produced.
+	 */
+	llong getDecompressionInputBytes();
+	llong getDecompressionOutputBytes();
+
+	/**
+	 * Returns the time in millis spent on decompressing.
+	 */
+	llong getDecompressionTime();
+
+	/**
+	 * Returns the number of TLS handshakes completed, and the number of
+	 * them resumed from a cached session or a ticket.
+	 *
+	 * @see ESocketAcceptor#setSSLHandshakeThreads(int,int)
+	 */
+	llong getHandshakeCount();
+	llong getResumedHandshakeCount();
+
+	/**
+	 * Returns the resumed handshakes against all completed ones.
+	 */
+	double getHandshakeResumptionRate();
+
+	/**
+	 * Returns the number of TLS handshakes failed or rejected.
+	 */
+	llong getFailedHandshakeCount();
+
+	/**
+	 * Returns the average handshake latency in millis.
+	 */
+	double getAverageHandshakeTime();
+
+	/**
+	 * Returns the number of TLS sessions whose record crypto is offloaded
+	 * to the kernel, and the number of them left in user space because
+	 * the kernel or the negotiated cipher does not support it.
+	 *
+	 * @see ESocketAcceptor#setSSLKernelOffload(boolean)
+	 */
+	llong getKernelTLSCount();
+	llong getKernelTLSFallbackCount();
+
 protected:
 	friend class ESocketAcceptor;
 	friend class EIoSession;
+	friend class EFiberWatchdog;
+	friend class ECompressionFilter;
+	friend class ESSLHandshaker;
 
 	EAtomicDouble readBytesThroughput;
 	EAtomicDouble writtenBytesThroughput;
@@ -166,6 +243,19 @@ protected:
 	/** A global counter to count the number of sessions managed since the start */
 	EAtomicLLong cumulativeManagedSessionCount;// = 0;
 
+	/** A counter of the blocked fiber events */
+	EAtomicLLong blockedFiberCount;
+
+	/** TLS handshake counters and the total nanos of the completed ones */
+	EAtomicLLong handshakeCount;
+	EAtomicLLong resumedHandshakeCount;
+	EAtomicLLong failedHandshakeCount;
+	EAtomicLLong handshakeNanos;
+
+	/** kTLS offloaded sessions and the ones left in user space */
+	EAtomicLLong kernelTLSCount;
+	EAtomicLLong kernelTLSFallbackCount;
+
 	/**
 	 * Increases the count of read bytes by <code>increment</code> and sets
 	 * the last read time to <code>currentTime</code>.
@@ -197,6 +287,16 @@ protected:
 	 */
 	void updateThroughput(llong currentTime);
 
+	/**
+	 * Increases the compression counters of current thread.
+	 */
+	void increaseCompression(llong inBytes, llong outBytes, llong nanos);
+
+	/**
+	 * Increases the decompression counters of current thread.
+	 */
+	void increaseDecompression(llong inBytes, llong outBytes, llong nanos);
+
 private:
 	struct ThreadThroughput: public EObject {
 		/** The number of bytes read per second */
@@ -240,12 +340,22 @@ private:
 
 		/** The time the last write operation occurred */
 		EAtomicLLong lastWriteTime;
+		/** The bytes in and out of the compressor and the nanos it took */
+		EAtomicLLong compressionInputBytes;
+		EAtomicLLong compressionOutputBytes;
+		EAtomicLLong compressionNanos;
+		/** The bytes in and out of the decompressor and the nanos it took */
+		EAtomicLLong decompressionInputBytes;
+		EAtomicLLong decompressionOutputBytes;
+		EAtomicLLong decompressionNanos;
 	};
 
 	EIoService* service;
 	int workThreads;
 	EA<ThreadThroughput*> threadThroughput;
 
+	llong sumThreads(EAtomicLLong ThreadThroughput::* field);
+
 	llong lastThroughputCalculationTime;
 	llong lastReadBytes;
 	llong lastWrittenBytes;
@@ -0,0 +1,123 @@
+#ifndef EIOTRACE_HH_
+#define EIOTRACE_HH_
+
+#include "Efc.hh"
+
+namespace efc {
+namespace naf {
+
+/**
+ * Per-thread binary event trace for post-mortem latency analysis.
+ *
+ * Every thread owns a fixed-size ring of compact events, the owner thread
+ * is the only writer so recording takes no lock; the oldest events are
+ * overwritten when the ring wraps. Tracing is disabled by default and
+ * costs one branch per hot path call until {@link #enable(int)}.
+ *
+ * The rings are dumped to a binary file by {@link #dump(const char*)}
+ * or by the signal installed with {@link #installSignal(int,const char*)},
+ * test/tracedecode converts the dump to Chrome trace JSON
+ * (chrome://tracing, ui.perfetto.dev).
+ *
+ * Dump file layout (host byte order):
+ * <pre>
+ *   char   magic[8] = "NAFTRACE"
+ *   uint32 version
+ *   uint32 nameCount
+ *   { uint16 length, char name[length] } * nameCount
+ *   uint32 ringCount
+ *   { uint64 threadId, uint32 capacity, uint64 head, Event events[capacity] } * ringCount
+ * </pre>
+ */
+
+class EIoTrace {
+public:
+	enum Type {
+		ACCEPT = 1,
+		SESSION_CREATED,
+		SESSION_CLOSED,
+		READ,
+		WRITE,
+		FILTER_ENTER,
+		FILTER_EXIT,
+		STREAM_START,
+		STREAM_END
+	};
+
+	struct Event {
+		/** Monotonic timestamp in nanos */
+		llong time;
+		/** Duration in nanos for READ and WRITE, 0 otherwise */
+		llong duration;
+		/** Bytes for READ and WRITE, stream id counted per session for STREAM_*, fd for ACCEPT */
+		llong arg;
+		/** The session id */
+		int session;
+		/** Event type */
+		short type;
+		/** Interned name id for FILTER_*, 0 otherwise */
+		short name;
+	};
+
+	static const int VERSION = 1;
+	static const int MAX_NAMES = 256;
+	static const int MAX_NAME_LENGTH = 64;
+
+	/**
+	 * Enables tracing with <code>capacity</code> events per thread ring,
+	 * the capacity is rounded up to a power of two. The rings keep the
+	 * capacity of the first call, they are written without lock.
+	 * @throws EIllegalStateException if enabled before with another
+	 *         capacity.
+	 */
+	static void enable(int capacity=65536);
+
+	/**
+	 * Stops recording, recorded events are kept for dumping.
+	 */
+	static void disable();
+
+	static inline boolean isEnabled() {
+		return enabled;
+	}
+
+	/**
+	 * Interns the name and returns its id for {@link #record}, names are
+	 * meant to be long-lived such as filter names.
+	 */
+	static short intern(const char* name);
+
+	/**
+	 * Records an event into the ring of current thread.
+	 */
+	static inline void record(Type type, long session, llong arg=0, llong duration=0, short name=0) {
+		if (enabled) {
+			record0(type, session, arg, duration, name);
+		}
+	}
+
+	/**
+	 * Returns the monotonic time in nanos used by the event timestamps.
+	 */
+	static llong now();
+
+	/**
+	 * Dumps all thread rings to file.
+	 */
+	static boolean dump(const char* path);
+
+	/**
+	 * Installs a signal handler which dumps the rings to <code>path</code>.
+	 */
+	static void installSignal(int signo, const char* path);
+
+private:
+	static volatile boolean enabled;
+
+	static void record0(Type type, long session, llong arg, llong duration, short name);
+	static boolean dump(int fd);
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* EIOTRACE_HH_ */
@@ -0,0 +1,105 @@
+#ifndef ELENGTHFIELDCODECFILTER_HH_
+#define ELENGTHFIELDCODECFILTER_HH_
+
+#include "./EIoFilterAdapter.hh"
+#include "./EIoBuffer.hh"
+
+namespace efc {
+namespace naf {
+
+/**
+ * An {@link IoFilter} which splits the received data into frames by a
+ * length field in front of each frame, and prepends the length field to
+ * each {@link EIoBuffer} sent.
+ *
+ * The length field is 1, 2, 4 or 8 bytes in big or little endian, or an
+ * unsigned varint (base 128, least significant group first). The value
+ * plus the length adjustment is the payload length, e.g. an adjustment
+ * of -4 for a 4 bytes field which counts itself.
+ *
+ * A frame which lies inside one read is delivered as a slice of the read
+ * buffer without copy, it is only valid until the next
+ * {@link EIoSession#read()}, copy it to keep it longer. A frame which
+ * spans reads is assembled into a new buffer.
+ *
+ * A sent buffer is encoded to an {@link EIoBufferChain} of the length
+ * field and the payload, written by one gather write, so no filter after
+ * this one may transform the outbound data.
+ *
+ * <pre>
+ *   ELengthFieldCodecFilter codec(4, true, 1024 * 1024);
+ *   acceptor.getFilterChainBuilder()->addLast("codec", &codec);
+ * </pre>
+ *
+ * @see: LengthFieldBasedFrameDecoder.java
+ */
+
+class ELengthFieldCodecFilter: public EIoFilterAdapter {
+public:
+	/**
+	 * The length field length of a varint field.
+	 */
+	static const int VARINT = 0;
+
+public:
+	virtual ~ELengthFieldCodecFilter();
+
+	/**
+	 * Creates a new instance.
+	 *
+	 * @param lengthFieldLength 1, 2, 4, 8 or {@link #VARINT}.
+	 * @param bigEndian the byte order of a fixed length field.
+	 * @param maxFrameSize the max payload length, a longer frame fails the session.
+	 */
+	ELengthFieldCodecFilter(int lengthFieldLength=4, boolean bigEndian=true, int maxFrameSize=1024*1024);
+
+	/**
+	 * Sets the value added to the length field to get the payload length,
+	 * default is 0.
+	 */
+	ELengthFieldCodecFilter* setLengthAdjustment(int adjustment);
+
+	/**
+	 * Sets whether the length field is kept in front of the delivered
+	 * frames, default is false.
+	 */
+	ELengthFieldCodecFilter* setKeepLengthField(boolean keep);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual void sessionClosed(EIoFilter::NextFilter* nextFilter, EIoSession* session) THROWS(EException);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual sp<EObject> messageReceived(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) THROWS(EException);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual sp<EObject> messageSend(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) THROWS(EException);
+
+	/**
+	 *
+	 */
+	virtual EString toString();
+
+private:
+	class Context;
+
+	int lengthFieldLength;
+	boolean bigEndian;
+	int maxFrameSize;
+	int lengthAdjustment;
+	boolean keepLengthField;
+
+	Context* contextOf(EIoSession* session);
+	sp<EIoBuffer> decode(Context* ctx) THROWS(EIOException);
+	boolean decodeLength(const byte* data, int size, int* fieldLength, int* payloadLength) THROWS(EIOException);
+	int encodeLength(llong value, byte* out);
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* ELENGTHFIELDCODECFILTER_HH_ */
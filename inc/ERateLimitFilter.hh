@@ -0,0 +1,162 @@
+#ifndef ERATELIMITFILTER_HH_
+#define ERATELIMITFILTER_HH_
+
+#include "ELog.hh"
+
+#include "./EIoFilterAdapter.hh"
+
+namespace efc {
+namespace naf {
+
+/**
+ * A {@link IoFilter} which limits the concurrent connections and the
+ * request rate of every source address (or subnet, see
+ * {@link #setSubnetMask(int)}).
+ *
+ * A connection over the limit is rejected in <code>sessionCreated</code>
+ * before any decode work. The request rate is a token bucket refilled at
+ * <code>requestsPerSecond</code> up to <code>burst</code> tokens:
+ * <ul>
+ *   <li>for HTTP sessions a request is one stream, the stream over the
+ *   limit is answered with "429 Too Many Requests" by the codec and the
+ *   connection stays open;</li>
+ *   <li>for other sessions a request is one message received from the
+ *   previous filter, the input of the session is shutdown when the
+ *   bucket is empty.</li>
+ * </ul>
+ *
+ * The states of the sources are sharded by address hash, one shard per
+ * worker thread by default, each shard has its own lock; the getters
+ * aggregate all shards. The sessions of one source may run on any io
+ * thread, so the states are not kept per thread: that would multiply the
+ * limits by the thread count. {@link #getLockContentions()} tells how
+ * often a shard lock was found held.
+ */
+
+class ERateLimitFilter: public EIoFilterAdapter {
+public:
+	virtual ~ERateLimitFilter();
+
+	/**
+	 * @param maxConnections max concurrent connections per source, 0 means no limit.
+	 * @param requestsPerSecond max request rate per source, 0 means no limit.
+	 * @param burst the token bucket size, 0 means same as requestsPerSecond.
+	 * @param shards shards of the source states, 0 means the processor count.
+	 */
+	ERateLimitFilter(int maxConnections, int requestsPerSecond, int burst=0, int shards=0);
+
+	/**
+	 * Sets the IPv4 prefix length which sources are grouped by, default
+	 * is 32: every address is a source.
+	 */
+	ERateLimitFilter* setSubnetMask(int bits);
+
+	/**
+	 * Returns the current connections of all sources.
+	 */
+	llong getConnectionCount();
+
+	/**
+	 * Returns the current connections of the source which the address
+	 * belongs to.
+	 */
+	int getConnectionCount(EInetAddress* address);
+
+	/**
+	 * Returns the number of tracked sources.
+	 */
+	int getSourceCount();
+
+	/**
+	 * Returns the number of connections rejected.
+	 */
+	llong getRejectedConnections();
+
+	/**
+	 * Returns the number of requests rejected.
+	 */
+	llong getRejectedRequests();
+
+	/**
+	 * Returns the number of times a shard lock was held by another
+	 * thread when taken.
+	 */
+	llong getLockContentions();
+
+	/**
+	 * Takes a request token for the session, used by the HTTP codec per
+	 * stream.
+	 *
+	 * @return false if the source of the session is over its rate,
+	 *         true if allowed or the session is not limited.
+	 */
+	static boolean tryAcquire(EIoSession* session);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual boolean sessionCreated(EIoFilter::NextFilter* nextFilter, EIoSession* session) THROWS(EException);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual void sessionClosed(EIoFilter::NextFilter* nextFilter, EIoSession* session) THROWS(EException);
+
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual sp<EObject> messageReceived(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) THROWS(EException);
+
+private:
+	struct Source {
+		int connections;
+		double tokens;
+		llong refillTime; // nanos
+	};
+
+	/**
+	 * A spin lock which counts the contended acquisitions.
+	 */
+	struct CountingLock: public ESpinLock {
+		EAtomicLLong contentions;
+		virtual void lock() {
+			if (!ESpinLock::tryLock()) {
+				contentions.incrementAndGet();
+				ESpinLock::lock();
+			}
+		}
+	};
+
+	struct Shard: public EObject {
+		CountingLock lock;
+		EHashMap<int, Source*> sources;
+		llong lastSweep; // nanos
+		EAtomicLLong connections;
+		EAtomicLLong rejectedConnections;
+		EAtomicLLong rejectedRequests;
+		Shard(): sources(1024, false), lastSweep(0) {
+		}
+		virtual ~Shard();
+	};
+
+	class Ticket;
+
+	static sp<ELogger> LOGGER;
+
+	int maxConnections;
+	int requestsPerSecond;
+	int burst;
+	int subnetMask;
+	EA<Shard*> shards;
+
+	int keyOf(EIoSession* session);
+	int keyOf(EInetAddress* address);
+	Shard* shardOf(int key);
+	boolean acquire(Shard* shard, Source* source, llong now);
+	void sweep(Shard* shard, llong now);
+	void release(Ticket* ticket);
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* ERATELIMITFILTER_HH_ */
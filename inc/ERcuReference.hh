@@ -0,0 +1,111 @@
+#ifndef ERCUREFERENCE_HH_
+#define ERCUREFERENCE_HH_
+
+#include "Efc.hh"
+
+namespace efc {
+namespace naf {
+
+/**
+ * A read-copy-update reference of an immutable object.
+ *
+ * Readers take no lock: {@link #read()} increases the reader counter of the
+ * current epoch and loads the pointer. A writer swaps the pointer, then
+ * waits a grace period and deletes the old object. A grace period flips
+ * the epoch twice and waits the readers of both epochs to drain; a reader
+ * which loaded the old pointer always holds one of the waited counters, so
+ * reclamation is safe.
+ *
+ * The swap takes no lock. The grace periods are run one at a time and
+ * counted: a writer which finds that a whole grace period started and
+ * completed after its swap skips its own, so concurrent writers share
+ * the waits instead of queueing behind each other.
+ *
+ * Writers may wait for a grace period, so never publish while holding a
+ * {@link ReadGuard}, nor hold a guard across a yield.
+ */
+
+template<typename T>
+class ERcuReference: public EObject {
+public:
+	class ReadGuard {
+	public:
+		ReadGuard(ReadGuard&& other): object(other.object), counter(other.counter) {
+			other.counter = null;
+		}
+		~ReadGuard() {
+			if (counter) {
+				__sync_fetch_and_sub(counter, 1);
+			}
+		}
+		T* get() { return object; }
+		T* operator->() { return object; }
+
+	private:
+		friend class ERcuReference;
+		ReadGuard(T* o, volatile int* c): object(o), counter(c) {}
+		ReadGuard(const ReadGuard&);
+		ReadGuard& operator=(const ReadGuard&);
+
+		T* object;
+		volatile int* counter;
+	};
+
+public:
+	virtual ~ERcuReference() {
+		delete current;
+	}
+
+	ERcuReference(T* initial=null): current(initial), epoch(0), completed(0) {
+		readers[0] = readers[1] = 0;
+	}
+
+	/**
+	 * Pins current object until the guard is destroyed.
+	 */
+	ReadGuard read() {
+		volatile int* counter = &readers[epoch & 1];
+		__sync_fetch_and_add(counter, 1); // full barrier
+		return ReadGuard(current, counter);
+	}
+
+	/**
+	 * Publishes the new object and deletes the old one after all readers
+	 * of it have gone.
+	 */
+	void publish(T* object) {
+		T* old = __sync_lock_test_and_set(&current, object);
+		__sync_synchronize();
+
+		// a grace period in progress may have flipped before the swap, only
+		// the second one completed from now surely started after it.
+		llong target = completed + 2;
+
+		SYNCBLOCK(&graceLock) {
+			if (completed < target) {
+				// two flips: each counter is seen drained once after the swap.
+				for (int i = 0; i < 2; i++) {
+					int e = epoch & 1;
+					epoch = e ^ 1;
+					__sync_synchronize();
+					while (readers[e] != 0) {
+						usleep(100);
+					}
+				}
+				completed = completed + 1;
+			}
+		}}
+		delete old;
+	}
+
+private:
+	T* volatile current;
+	volatile int epoch;
+	volatile int readers[2];
+	volatile llong completed; // grace periods, written under graceLock
+	EReentrantLock graceLock;
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* ERCUREFERENCE_HH_ */
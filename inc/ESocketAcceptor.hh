@@ -16,6 +16,8 @@ namespace efc {
 namespace naf {
 
 class EManagedSession;
+class EFiberWatchdog;
+class ESSLHandshaker;
 
 /**
  * {@link IoAcceptor} for socket transport (TCP/IP).  This class
@@ -131,6 +133,72 @@ public:
 	 */
 	virtual int getSessionIdleTime(EIdleStatus status);
 
+	/**
+	 * Enables the blocked fiber watchdog, a fiber which holds an io thread
+	 * longer than <code>millis</code> without yielding is logged with its
+	 * session, remote address and a stack sample, and counted in the
+	 * {@link EIoServiceStatistics#getBlockedFiberCount() statistics}.
+	 *
+	 * @param millis the blocked threshold in millis, 0 to disable.
+	 * @param degrade if <code>true</code> new sessions will not be balanced
+	 *        to a blocked io thread until it comes back.
+	 */
+	virtual void setBlockedFiberThreshold(int millis, boolean degrade=false);
+
+	/**
+	 *
+	 */
+	virtual int getBlockedFiberThreshold();
+
+	/**
+	 * Offloads the TLS handshakes of ssl services to <code>threads</code>
+	 * dedicated crypto threads, so a handshake storm does not stall the
+	 * established sessions of the io threads. At most
+	 * <code>maxPending</code> handshakes are in flight, a connection over
+	 * it is closed at once and counted as a failed handshake.
+	 *
+	 * @param threads the crypto threads, 0 to handshake on the io thread
+	 *        of the session.
+	 */
+	virtual void setSSLHandshakeThreads(int threads, int maxPending=1024);
+
+	/**
+	 *
+	 */
+	virtual int getSSLHandshakeThreads();
+
+	/**
+	 * Sets the server side TLS session cache of the ssl services.
+	 *
+	 * @param size max cached sessions, 0 to keep the OpenSSL default.
+	 * @param timeoutSeconds session (and ticket) lifetime, 0 to keep the
+	 *        OpenSSL default.
+	 */
+	virtual void setSSLSessionCache(int size, int timeoutSeconds);
+
+	/**
+	 * Rotates the session ticket keys of the ssl services every
+	 * <code>seconds</code>, tickets sealed by the previous key are still
+	 * resumed and renewed.
+	 */
+	virtual void setSSLTicketKeyRotation(int seconds);
+
+	/**
+	 * Offloads the record encryption of the ssl sessions to the kernel
+	 * (kTLS) after the handshake, for the ciphers the kernel supports, so
+	 * that an {@link EFile} response is sent by sendfile. A session falls
+	 * back to OpenSSL in user space if the kernel tls module or the cipher
+	 * is not available.
+	 *
+	 * @see EIoServiceStatistics#getKernelTLSCount()
+	 */
+	virtual void setSSLKernelOffload(boolean on);
+
+	/**
+	 *
+	 */
+	virtual boolean isSSLKernelOffload();
+
 	/**
 	 *
 	 */
@@ -216,6 +284,15 @@ protected:
 	int workThreads_;
 	EManagedSession* managedSessions_;
 
+	int blockedThreshold_;
+	boolean blockedDegrade_;
+	EFiberWatchdog* watchdog_;
+
+	int cryptoThreads_;
+	int cryptoMaxPending_;
+	EAtomicCounter cryptoPending_;
+	ESSLHandshaker* handshaker_;
+
 	EIoFilterChainBuilder defaultFilterChain;
 
 	EIoServiceStatistics stats_;
@@ -224,10 +301,14 @@ protected:
 	std::function<void(sp<ESocketSession>& session, Service* service)> connectionCallback_;
 
 	void startAccept(EFiberScheduler& scheduler, Service* service) THROWS(EIOException);
+	void startSession(EFiberScheduler& scheduler, sp<ESocketSession>& session, Service* service, boolean handshaked);
+	void startHandshake(EFiberScheduler& scheduler, sp<ESocketSession>& session, Service* service);
 	void startClean(EFiberScheduler& scheduler, int tag) THROWS(EIOException);
 	void startStatistics(EFiberScheduler& scheduler);
 	void signalAccept();
 
+	// runs after the bind listener, once the ssl parameters of the service are set.
+	virtual void onServiceBound(Service* service);
 	virtual void onListeningHandle();
 	virtual void onConnectionHandle(sp<ESocketSession>& session, Service* service);
 };
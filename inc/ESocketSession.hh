@@ -16,6 +16,9 @@
 namespace efc {
 namespace naf {
 
+class EFiberWatchdog;
+class EIoBufferChain;
+
 class ESocketSession: public EIoSession, public enable_shared_from_this<ESocketSession> {
 public:
 	virtual ~ESocketSession();
@@ -66,11 +69,16 @@ public:
 	int bufferLimit() { return ioBufferLimit; }
 
 private:
+	friend class ESocketAcceptor;
+
 	sp<ESocket> socket_;
 	boolean closed_;
+	EFiberWatchdog* watchdog_;
 
 	sp<EIoBuffer> ioBuffer;
 	uint ioBufferLimit;
+
+	void writev(EIoBufferChain* chain) THROWS(EIOException);
 };
 
 //=============================================================================
@@ -13,8 +13,10 @@
 namespace efc {
 namespace naf {
 
+class EIoSession;
+
 /**
- * A IP subnet using the CIDR notation. Currently, only IP version 4
+ * A IP subnet using the CIDR notation, both IP version 4 and IP version 6
  * address are supported.
  *
  */
@@ -32,6 +34,21 @@ public:
 	 */
 	ESubnet(EInetAddress* subnet, int mask);
 
+	/**
+	 * Creates a subnet from CIDR text, such as "192.168.0.0/24" or
+	 * "2001:db8::/32", a plain address is a host subnet.
+	 * @param cidr The CIDR text
+	 */
+	ESubnet(const char* cidr);
+
+	/**
+	 * Creates a subnet from raw address bytes in network order.
+	 * @param address 4 bytes for IPv4 or 16 bytes for IPv6
+	 * @param length The length of address, 4 or 16
+	 * @param mask The mask
+	 */
+	ESubnet(const byte* address, int length, int mask);
+
 	/**
 	 * Checks if the {@link InetAddress} is within this subnet
 	 * @param address The {@link InetAddress} to check
@@ -40,52 +57,66 @@ public:
 	boolean inSubnet(EInetAddress* address);
 
 	/**
-	 * {@inheritDoc}
+	 * Checks if the raw address is within this subnet
+	 * @param address The address bytes in network order
+	 * @param length The length of address, 4 or 16
 	 */
-	virtual EString toString();
+	boolean inSubnet(const byte* address, int length);
 
 	/**
-	 * {@inheritDoc}
+	 * Returns the subnet address bytes in network order, the host bits are
+	 * cleared.
 	 */
-	virtual boolean equals(ESubnet* obj);
-
-private:
-	static const int IP_MASK_V4 = 0x80000000;
-
-	static const llong IP_MASK_V6 = 0x8000000000000000L;
-
-	static const int BYTE_MASK = 0xFF;
-
-	EInetAddress subnet;
+	const byte* getAddress();
 
-	/** An int representation of a subnet for IPV4 addresses */
-	int subnetInt;
+	/**
+	 * Returns 4 for IPv4 subnet and 16 for IPv6 subnet.
+	 */
+	int getAddressLength();
 
-	/** An long representation of a subnet for IPV6 addresses */
-	long subnetLong;
+	/**
+	 * Returns the mask length.
+	 */
+	int getMask();
 
-	long subnetMask;
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual EString toString();
 
-	int suffix;
+	/**
+	 * {@inheritDoc}
+	 */
+	virtual boolean equals(ESubnet* obj);
 
 	/**
-	 * Converts an IP address into an integer
+	 * Converts an IPv4 {@link InetAddress} into 4 bytes in network order,
+	 * {@link InetAddress} has no IPv6 form.
 	 */
-	int toInt(EInetAddress* inetAddress);
+	static void toBytes(EInetAddress* address, byte bytes[4]);
 
 	/**
-	 * Converts an IP address into a long
+	 * Gets the remote address of the session into bytes in network order,
+	 * IPv4 or IPv6 as the peer of the socket; an IPv4-mapped IPv6 address
+	 * is returned as IPv4.
+	 * @return The length of address, 4 or 16, or 0 if unknown
 	 */
-	long toLong(EInetAddress* inetAddress);
+	static int toBytes(EIoSession* session, byte bytes[16]);
 
 	/**
-	 * Converts an IP address to a subnet using the provided mask
-	 *
-	 * @param address
-	 *            The address to convert into a subnet
-	 * @return The subnet as an integer
+	 * Parses a textual IPv4 or IPv6 address into bytes in network order.
+	 * @return The length of address, 4 or 16, or 0 if not an address
 	 */
-	long toSubnet(EInetAddress* address);
+	static int parseAddress(const char* text, byte bytes[16]);
+
+private:
+	byte address_[16];
+
+	int length_;
+
+	int suffix_;
+
+	void init(const byte* address, int length, int mask);
 };
 
 } /* namespace naf */
@@ -0,0 +1,67 @@
+#ifndef ESUBNETFILEWATCHER_HH_
+#define ESUBNETFILEWATCHER_HH_
+
+#include "ELog.hh"
+
+#include "./ESubnetTrie.hh"
+
+namespace efc {
+namespace naf {
+
+/**
+ * Watches a CIDR file and reloads it when the file changed.
+ *
+ * The file has one subnet per line, e.g. "10.0.0.0/8", "2001:db8::/32"
+ * or a single address; blank lines and text after '#' are ignored, and
+ * malformed lines are logged and skipped.
+ *
+ * A daemon thread polls the modification time and size of the file, the
+ * file is parsed into a new {@link ESubnetTrie} off the io threads and
+ * handed to the listener, which takes ownership of it.
+ */
+
+class ESubnetFileWatcher: public EObject {
+public:
+	typedef std::function<void(ESubnetTrie* subnets)> Listener;
+
+public:
+	virtual ~ESubnetFileWatcher();
+
+	ESubnetFileWatcher(const char* path, int intervalMillis, Listener listener);
+
+	/**
+	 * Loads the file once and starts watching.
+	 *
+	 * @throws EIOException if the file can not be read.
+	 */
+	void start() THROWS(EIOException);
+
+	/**
+	 * Stops watching and waits the watcher thread to exit.
+	 */
+	void stop();
+
+	/**
+	 * Parses the CIDR file into a new trie.
+	 *
+	 * @throws EIOException if the file can not be read.
+	 */
+	static ESubnetTrie* load(const char* path) THROWS(EIOException);
+
+private:
+	static sp<ELogger> logger;
+
+	EString path;
+	int interval;
+	Listener listener;
+	llong lastModified;
+	llong lastLength;
+	volatile boolean stopped;
+	sp<EThread> watcher;
+
+	boolean changed();
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* ESUBNETFILEWATCHER_HH_ */
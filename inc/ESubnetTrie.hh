@@ -0,0 +1,96 @@
+#ifndef ESUBNETTRIE_HH_
+#define ESUBNETTRIE_HH_
+
+#include "./ESubnet.hh"
+
+namespace efc {
+namespace naf {
+
+/**
+ * A path compressed binary radix trie of {@link ESubnet} for longest
+ * prefix match, IPv4 and IPv6 subnets are kept in separated trees.
+ *
+ * Lookup is O(prefix length) whatever the number of subnets, a node
+ * only exists at a subnet or at a branch point.
+ *
+ * Not thread safe: the trie must not be modified while being looked up,
+ * share it as an immutable snapshot with {@link ERcuReference} instead.
+ */
+
+class ESubnetTrie: public EObject {
+public:
+	virtual ~ESubnetTrie();
+
+	ESubnetTrie();
+
+	/**
+	 * Adds the subnet.
+	 * @return false if the subnet already exists.
+	 */
+	boolean add(ESubnet* subnet);
+
+	/**
+	 * Removes the subnet.
+	 * @return false if the subnet not exists.
+	 */
+	boolean remove(ESubnet* subnet);
+
+	/**
+	 * Checks if the address is within any subnet.
+	 */
+	boolean contains(EInetAddress* address);
+	boolean contains(const byte* address, int length);
+
+	/**
+	 * Checks if the remote address of the session, IPv4 or IPv6, is
+	 * within any subnet.
+	 */
+	boolean contains(EIoSession* session);
+
+	/**
+	 * Returns the mask of the longest subnet which contains the address,
+	 * or -1 if not found.
+	 */
+	int longestMatch(const byte* address, int length);
+
+	/**
+	 * Returns the number of subnets.
+	 */
+	int size();
+
+	/**
+	 * Removes all subnets.
+	 */
+	void clear();
+
+	/**
+	 * Returns a deep copy of this trie.
+	 */
+	ESubnetTrie* clone();
+
+private:
+	struct Node {
+		byte key[16];
+		unsigned short bits;
+		boolean terminal;
+		Node* child[2];
+	};
+
+	Node* roots[2]; // 0: IPv4, 1: IPv6
+	int size_;
+
+	static Node* newNode(const byte* key, int bits, boolean terminal);
+	static void freeTree(Node* node);
+	static Node* copyTree(Node* node);
+	static inline int bitAt(const byte* key, int index) {
+		return (key[index >> 3] >> (7 - (index & 7))) & 1;
+	}
+	static int commonBits(const byte* a, const byte* b, int maxBits);
+
+	boolean add(const byte* key, int length, int bits);
+	boolean remove(const byte* key, int length, int bits);
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* ESUBNETTRIE_HH_ */
@@ -0,0 +1,74 @@
+#ifndef EWAKESIGNAL_HH_
+#define EWAKESIGNAL_HH_
+
+#include "Efc.hh"
+#include "Eco.hh"
+
+namespace efc {
+namespace naf {
+
+/**
+ * Wakes one fiber which waits for a condition changed by other fibers or
+ * threads, e.g. a reader waiting for data to be decoded:
+ *
+ *   signal.await([this]() { return available() || ended; });  // reader
+ *   ...
+ *   ended = true;
+ *   signal.signal();                                            // writer
+ *
+ * The waiter sleeps in a channel, it is never woken by polling. A waker
+ * claims the waiting flag before writing its token, so at most one token
+ * is pending and {@link #signal()} never waits.
+ *
+ * Only one fiber may wait at a time.
+ */
+
+class EWakeSignal {
+public:
+	EWakeSignal() : channel(1) {
+	}
+
+	/**
+	 * Waits until the condition is true, it is checked again after every
+	 * signal and once after the waiting flag is set, so a signal sent in
+	 * between is not lost.
+	 */
+	template<typename Condition>
+	void await(Condition ready) {
+		while (!ready()) {
+			waiting.set(1);
+			if (ready()) {
+				if (!waiting.compareAndSet(1, 0)) {
+					channel.read(); // claimed, the token is being written.
+				}
+				return;
+			}
+			channel.read();
+		}
+	}
+
+	/**
+	 * Wakes the waiter, if any.
+	 * @return true if a waiter was woken.
+	 */
+	boolean signal() {
+		if (waiting.get() == 1 && waiting.compareAndSet(1, 0)) {
+			channel.write(token());
+			return true;
+		}
+		return false;
+	}
+
+private:
+	EAtomicInteger waiting;
+	EFiberChannel<EObject> channel;
+
+	static sp<EObject>& token() {
+		static sp<EObject> t(new EObject());
+		return t;
+	}
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* EWAKESIGNAL_HH_ */
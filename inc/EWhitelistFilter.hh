@@ -11,7 +11,9 @@
 #include "ELog.hh"
 
 #include "./EIoFilterAdapter.hh"
-#include "./ESubnet.hh"
+#include "./ESubnetTrie.hh"
+#include "./ESubnetFileWatcher.hh"
+#include "./ERcuReference.hh"
 
 namespace efc {
 namespace naf {
@@ -25,6 +27,10 @@ namespace naf {
 
 class EWhitelistFilter: public EIoFilterAdapter {
 public:
+	virtual ~EWhitelistFilter();
+
+	EWhitelistFilter();
+
 	/**
 	 * Sets the addresses to be whitelisted.
 	 *
@@ -64,9 +70,36 @@ public:
 	 */
 	EWhitelistFilter* setSubnetWhitelist(EIterable<ESubnet*>* subnets);
 
+	/**
+	 * Sets the subnets trie to be whitelisted, the filter takes the
+	 * ownership of it.
+	 *
+	 * The trie is published as an immutable snapshot: it's better to be
+	 * built off the io threads, sessions being checked keep using the old
+	 * one until they finished and the old one is freed after that.
+	 *
+	 * @param subnets a trie of subnets to be whitelisted.
+	 */
+	EWhitelistFilter* setSubnetWhitelist(ESubnetTrie* subnets);
+
+	/**
+	 * Loads the whitelist from a CIDR file and reloads it when the file
+	 * changed, see {@link ESubnetFileWatcher}.
+	 *
+	 * NOTE: this call will remove any previously whitelisted subnets.
+	 *
+	 * @param path the CIDR file.
+	 * @param intervalMillis the interval to check the file.
+	 * @throws EIOException if the file can not be read.
+	 */
+	EWhitelistFilter* watchWhitelistFile(const char* path, int intervalMillis=5000);
+
 	/**
 	 * Allows the specified endpoint.
 	 *
+	 * NOTE: every single update copies the whole whitelist, use
+	 * {@link #setSubnetWhitelist(ESubnetTrie*)} for bulk updates.
+	 *
 	 * @param address The address to allow
 	 */
 	EWhitelistFilter* allow(EInetAddress* address);
@@ -102,8 +135,12 @@ public:
 private:
 	static sp<ELogger> LOGGER;// = LoggerFactory.getLogger(WhitelistFilter.class);
 
-	/** The list of allowed addresses */
-	ECopyOnWriteArrayList<ESubnet> whitelist;
+	/** The longest prefix match trie of allowed subnets, copy on write */
+	ERcuReference<ESubnetTrie> whitelist;
+	EReentrantLock updateLock;
+	sp<ESubnetFileWatcher> watcher;
+
+	void update(ESubnet* subnet, boolean add);
 
 	boolean isAllowed(EIoSession* session);
 };
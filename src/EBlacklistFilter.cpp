@@ -12,19 +12,36 @@ namespace naf {
 
 sp<ELogger> EBlacklistFilter::LOGGER = ELoggerManager::getLogger("EBlacklistFilter");
 
+EBlacklistFilter::~EBlacklistFilter() {
+	if (watcher != null) {
+		watcher->stop();
+	}
+}
+
+EBlacklistFilter::EBlacklistFilter() : blacklist(new ESubnetTrie()) {
+}
+
 EBlacklistFilter* EBlacklistFilter::setBlacklist(EA<EInetAddress*>* addresses) {
 	if (addresses == null) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "addresses");
 	}
 
-	blacklist.clear();
-
-	for (int i = 0; i < addresses->length(); i++) {
-		EInetAddress* addr = (*addresses)[i];
-		block(addr);
+	ESubnetTrie* trie = new ESubnetTrie();
+	try {
+		for (int i = 0; i < addresses->length(); i++) {
+			EInetAddress* addr = (*addresses)[i];
+			if (addr == null) {
+				throw EIllegalArgumentException(__FILE__, __LINE__, "Adress to block can not be null");
+			}
+			ESubnet subnet(addr, 32);
+			trie->add(&subnet);
+		}
+	} catch (...) {
+		delete trie;
+		throw;
 	}
 
-	return this;
+	return setSubnetBlacklist(trie);
 }
 
 EBlacklistFilter* EBlacklistFilter::setSubnetBlacklist(EA<ESubnet*>* subnets) {
@@ -32,14 +49,17 @@ EBlacklistFilter* EBlacklistFilter::setSubnetBlacklist(EA<ESubnet*>* subnets) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnets must not be null");
 	}
 
-	blacklist.clear();
-
-	for (int i = 0; i < subnets->length(); i++) {
-		ESubnet* subnet = (*subnets)[i];
-		block(subnet);
+	ESubnetTrie* trie = new ESubnetTrie();
+	try {
+		for (int i = 0; i < subnets->length(); i++) {
+			trie->add((*subnets)[i]);
+		}
+	} catch (...) {
+		delete trie;
+		throw;
 	}
 
-	return this;
+	return setSubnetBlacklist(trie);
 }
 
 EBlacklistFilter* EBlacklistFilter::setBlacklist(EIterable<EInetAddress*>* addresses) {
@@ -47,14 +67,23 @@ EBlacklistFilter* EBlacklistFilter::setBlacklist(EIterable<EInetAddress*>* addre
 		throw EIllegalArgumentException(__FILE__, __LINE__, "addresses");
 	}
 
-	blacklist.clear();
-
-	sp<EIterator<EInetAddress*> > iter = addresses->iterator();
-	while (iter->hasNext()) {
-		block(iter->next());
+	ESubnetTrie* trie = new ESubnetTrie();
+	try {
+		sp<EIterator<EInetAddress*> > iter = addresses->iterator();
+		while (iter->hasNext()) {
+			EInetAddress* addr = iter->next();
+			if (addr == null) {
+				throw EIllegalArgumentException(__FILE__, __LINE__, "Adress to block can not be null");
+			}
+			ESubnet subnet(addr, 32);
+			trie->add(&subnet);
+		}
+	} catch (...) {
+		delete trie;
+		throw;
 	}
 
-	return this;
+	return setSubnetBlacklist(trie);
 }
 
 EBlacklistFilter* EBlacklistFilter::setSubnetBlacklist(EIterable<ESubnet*>* subnets) {
@@ -62,12 +91,42 @@ EBlacklistFilter* EBlacklistFilter::setSubnetBlacklist(EIterable<ESubnet*>* subn
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnets must not be null");
 	}
 
-	blacklist.clear();
+	ESubnetTrie* trie = new ESubnetTrie();
+	try {
+		sp<EIterator<ESubnet*> > iter = subnets->iterator();
+		while (iter->hasNext()) {
+			trie->add(iter->next());
+		}
+	} catch (...) {
+		delete trie;
+		throw;
+	}
 
-	sp<EIterator<ESubnet*> > iter = subnets->iterator();
-	while (iter->hasNext()) {
-		block(iter->next());
+	return setSubnetBlacklist(trie);
+}
+
+EBlacklistFilter* EBlacklistFilter::setSubnetBlacklist(ESubnetTrie* subnets) {
+	if (subnets == null) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnets must not be null");
+	}
+
+	SYNCBLOCK(&updateLock) {
+		blacklist.publish(subnets);
+    }}
+
+	return this;
+}
+
+EBlacklistFilter* EBlacklistFilter::watchBlacklistFile(const char* path, int intervalMillis) {
+	ESubnetFileWatcher* fw = new ESubnetFileWatcher(path, intervalMillis, [this](ESubnetTrie* subnets){
+		this->setSubnetBlacklist(subnets);
+	});
+	sp<ESubnetFileWatcher> old = watcher;
+	watcher = fw;
+	if (old != null) {
+		old->stop();
 	}
+	fw->start();
 
 	return this;
 }
@@ -77,7 +136,8 @@ EBlacklistFilter* EBlacklistFilter::block(EInetAddress* address) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Adress to block can not be null");
 	}
 
-	blacklist.add(new ESubnet(address, 32));
+	ESubnet subnet(address, 32);
+	update(&subnet, true);
 
 	return this;
 }
@@ -92,7 +152,7 @@ EBlacklistFilter* EBlacklistFilter::block(ESubnet* subnet) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnet can not be null");
 	}
 
-	blacklist.add(new ESubnet(*subnet));
+	update(subnet, true);
 
 	return this;
 }
@@ -103,7 +163,7 @@ EBlacklistFilter* EBlacklistFilter::unblock(EInetAddress* address) {
 	}
 
 	ESubnet subnet(address, 32);
-	blacklist.remove(&subnet);
+	update(&subnet, false);
 
 	return this;
 }
@@ -118,7 +178,7 @@ EBlacklistFilter* EBlacklistFilter::unblock(ESubnet* subnet) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnet can not be null");
 	}
 
-	blacklist.remove(subnet);
+	update(subnet, false);
 
 	return this;
 }
@@ -136,24 +196,22 @@ boolean EBlacklistFilter::sessionCreated(EIoFilter::NextFilter* nextFilter, EIoS
 	}
 }
 
-boolean EBlacklistFilter::isBlocked(EIoSession* session) {
-	EInetSocketAddress* remoteAddress = session->getRemoteAddress();
-
-	//if (remoteAddress instanceof InetSocketAddress)
-	{
-		EInetAddress* address = remoteAddress->getAddress();
-
-		// check all subnets
-		sp<EIterator<sp<ESubnet> > > iter = blacklist.iterator();
-		while (iter->hasNext()) {
-			sp<ESubnet> subnet = iter->next();
-			if (subnet->inSubnet(address)) {
-				return true;
-			}
+void EBlacklistFilter::update(ESubnet* subnet, boolean add) {
+	// copy on write, readers keep the old snapshot until they finished.
+	SYNCBLOCK(&updateLock) {
+		ESubnetTrie* trie = blacklist.read()->clone();
+		if (add) {
+			trie->add(subnet);
+		} else {
+			trie->remove(subnet);
 		}
-	}
+		blacklist.publish(trie);
+    }}
+}
 
-	return false;
+boolean EBlacklistFilter::isBlocked(EIoSession* session) {
+	// longest prefix match of the peer, IPv4 or IPv6, on current snapshot, lock free.
+	return blacklist.read()->contains(session);
 }
 
 } /* namespace naf */
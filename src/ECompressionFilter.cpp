@@ -0,0 +1,367 @@
+#include "../inc/ECompressionFilter.hh"
+#include "../inc/EIoBufferChain.hh"
+#include "../inc/EIoService.hh"
+#include "../inc/EIoServiceStatistics.hh"
+
+#include <zlib.h>
+#include <vector>
+
+namespace efc {
+namespace naf {
+
+#define ZPOOL_MAX_PER_KIND 64
+#define ZFILE_CHUNK_SIZE   16384
+
+static const char* SESSION_COMPRESSION_CONTEXT = "session_compression_context";
+
+//=============================================================================
+
+/**
+ * A zlib stream with its current compression level.
+ */
+struct ZStream {
+	z_stream strm;
+	int level;
+	int kind;
+};
+
+/**
+ * Per-thread free list of the zlib streams, by kind:
+ * 0: zlib deflater, 1: gzip deflater, 2: inflater.
+ */
+struct ZPool {
+	std::vector<ZStream*> free[3];
+
+	~ZPool() {
+		for (int i = 0; i < 3; i++) {
+			for (ZStream* zs : free[i]) {
+				destroy(zs);
+			}
+		}
+	}
+
+	ZStream* acquire(int kind, int level) {
+		if (!free[kind].empty()) {
+			ZStream* zs = free[kind].back();
+			free[kind].pop_back();
+			return zs;
+		}
+
+		ZStream* zs = new ZStream();
+		memset(&zs->strm, 0, sizeof(zs->strm));
+		zs->kind = kind;
+		zs->level = level;
+		int ret;
+		if (kind == 2) {
+			ret = ::inflateInit2(&zs->strm, 15 + 32); // zlib or gzip, detected.
+		} else {
+			ret = ::deflateInit2(&zs->strm, level, Z_DEFLATED, (kind == 1) ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY);
+		}
+		if (ret != Z_OK) {
+			delete zs;
+			throw EIllegalStateException(__FILE__, __LINE__, EString::formatOf("zlib init failed: %d", ret).c_str());
+		}
+		return zs;
+	}
+
+	void release(ZStream* zs) {
+		if (free[zs->kind].size() >= ZPOOL_MAX_PER_KIND) {
+			destroy(zs);
+			return;
+		}
+		if (zs->kind == 2) {
+			::inflateReset(&zs->strm);
+		} else {
+			::deflateReset(&zs->strm);
+		}
+		free[zs->kind].push_back(zs);
+	}
+
+	static void destroy(ZStream* zs) {
+		if (zs->kind == 2) {
+			::inflateEnd(&zs->strm);
+		} else {
+			::deflateEnd(&zs->strm);
+		}
+		delete zs;
+	}
+};
+
+static thread_local ZPool zpool;
+
+/**
+ * The streaming contexts of a session.
+ */
+class ECompressionFilter::Context: public EObject {
+public:
+	ZStream* deflater;
+	ZStream* inflater;
+
+	Context(): deflater(null), inflater(null) {
+	}
+
+	virtual ~Context() {
+		// back to the pool of the thread which closes the session.
+		if (deflater) zpool.release(deflater);
+		if (inflater) zpool.release(inflater);
+	}
+};
+
+//=============================================================================
+
+ECompressionFilter::~ECompressionFilter() {
+	//
+}
+
+ECompressionFilter::ECompressionFilter(boolean compressInbound, boolean compressOutbound,
+		int compressionLevel, Format format) :
+		compressInbound(compressInbound),
+		compressOutbound(compressOutbound),
+		compressionLevel(compressionLevel),
+		format(format),
+		minCompressSize(64),
+		maxInflateSize(4 * 1024 * 1024) {
+	if (compressionLevel < COMPRESSION_NONE || compressionLevel > COMPRESSION_MAX) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal compression level: %d", compressionLevel).c_str());
+	}
+}
+
+ECompressionFilter* ECompressionFilter::setMinCompressSize(int size) {
+	minCompressSize = size;
+	return this;
+}
+
+ECompressionFilter* ECompressionFilter::setMaxInflateSize(int size) {
+	if (size <= 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Max inflate size must be positive");
+	}
+	maxInflateSize = size;
+	return this;
+}
+
+boolean ECompressionFilter::sessionCreated(EIoFilter::NextFilter* nextFilter, EIoSession* session) {
+	sp<Context> ctx(new Context());
+	if (compressOutbound) {
+		ctx->deflater = zpool.acquire((format == GZIP) ? 1 : 0, compressionLevel);
+	}
+	if (compressInbound) {
+		ctx->inflater = zpool.acquire(2, 0);
+	}
+	session->attributes.put((llong)SESSION_COMPRESSION_CONTEXT, ctx);
+
+	return nextFilter->sessionCreated(session);
+}
+
+void ECompressionFilter::sessionClosed(EIoFilter::NextFilter* nextFilter, EIoSession* session) {
+	session->attributes.remove((llong)SESSION_COMPRESSION_CONTEXT);
+
+	nextFilter->sessionClosed(session);
+}
+
+sp<EObject> ECompressionFilter::messageReceived(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) {
+	sp<EIoBuffer> buf = dynamic_pointer_cast<EIoBuffer>(message);
+	if (!compressInbound || buf == null) {
+		return nextFilter->messageReceived(session, message);
+	}
+
+	Context* ctx = contextOf(session);
+
+	llong t0 = ESystem::nanoTime();
+	int inBytes = buf->remaining();
+	sp<EIoBuffer> out = inflate(ctx, buf.get());
+	session->getService()->getStatistics()->increaseDecompression(inBytes, out->remaining(), ESystem::nanoTime() - t0);
+
+	if (!out->hasRemaining()) {
+		// a partial block, read more.
+		return nextFilter->messageReceived(session, null);
+	}
+	return nextFilter->messageReceived(session, out);
+}
+
+sp<EObject> ECompressionFilter::messageSend(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) {
+	// sends pass the chain from head to tail too: the filters behind encode
+	// the message first, the bytes they return are compressed on the way out.
+	sp<EObject> encoded = nextFilter->messageSend(session, message);
+	if (!compressOutbound || encoded == null) {
+		return encoded;
+	}
+
+	sp<EIoBuffer> buf = dynamic_pointer_cast<EIoBuffer>(encoded);
+	sp<EIoBufferChain> chain;
+	sp<EFile> file;
+	if (buf == null && (chain = dynamic_pointer_cast<EIoBufferChain>(encoded)) == null
+			&& (file = dynamic_pointer_cast<EFile>(encoded)) == null) {
+		return encoded;
+	}
+
+	Context* ctx = contextOf(session);
+	llong t0 = ESystem::nanoTime();
+	llong inBytes = 0;
+	sp<EIoBuffer> out;
+
+	if (buf != null) {
+		int n = buf->remaining();
+		out = EIoBuffer::allocate(::deflateBound(&ctx->deflater->strm, n) + 16);
+
+		int level = (n < minCompressSize || isCompressed(buf->current(), n)) ? COMPRESSION_NONE : compressionLevel;
+		setLevel(ctx, level, out.get());
+
+		// one sync flush per message, the peer can decode it at once.
+		deflate(ctx, buf->current(), n, Z_SYNC_FLUSH, out.get());
+		inBytes = n;
+	} else if (chain != null) {
+		// e.g. a frame header and its payload, one stream block for both.
+		llong n = chain->remaining();
+		out = EIoBuffer::allocate(::deflateBound(&ctx->deflater->strm, n) + 16);
+
+		for (int i = 0; i < chain->size(); i++) {
+			sp<EIoBuffer> b = chain->get(i);
+			int size = b->remaining();
+			if (size == 0) {
+				continue;
+			}
+			if (inBytes == 0) {
+				int level = (n < minCompressSize || isCompressed(b->current(), size)) ? COMPRESSION_NONE : compressionLevel;
+				setLevel(ctx, level, out.get());
+			}
+			deflate(ctx, b->current(), size, Z_NO_FLUSH, out.get());
+			inBytes += size;
+		}
+		deflate(ctx, null, 0, Z_SYNC_FLUSH, out.get());
+	} else {
+		// stream the file content through the deflater.
+		EFileInputStream fis(file.get());
+		EA<byte> chunk(ZFILE_CHUNK_SIZE);
+		out = EIoBuffer::allocate(ES_MIN(file->length(), ZFILE_CHUNK_SIZE) + 64);
+
+		int n;
+		while ((n = fis.read(chunk.address(), chunk.length())) > 0) {
+			if (inBytes == 0) {
+				int level = (file->length() < minCompressSize || isCompressed(chunk.address(), n)) ? COMPRESSION_NONE : compressionLevel;
+				setLevel(ctx, level, out.get());
+			}
+			deflate(ctx, chunk.address(), n, Z_NO_FLUSH, out.get());
+			inBytes += n;
+		}
+		deflate(ctx, null, 0, Z_SYNC_FLUSH, out.get());
+	}
+
+	out->flip();
+	session->getService()->getStatistics()->increaseCompression(inBytes, out->remaining(), ESystem::nanoTime() - t0);
+
+	return out;
+}
+
+boolean ECompressionFilter::isCompressed(const void* data, int size) {
+	const ubyte* p = (const ubyte*)data;
+	if (size < 4) {
+		return false;
+	}
+	if ((p[0] == 0x1F && p[1] == 0x8B)                                 // gzip
+			|| (p[0] == 'P' && p[1] == 'K' && p[2] == 0x03 && p[3] == 0x04) // zip, jar, docx
+			|| (p[0] == 0x89 && p[1] == 'P' && p[2] == 'N' && p[3] == 'G')  // png
+			|| (p[0] == 0xFF && p[1] == 0xD8 && p[2] == 0xFF)             // jpeg
+			|| (p[0] == 'G' && p[1] == 'I' && p[2] == 'F' && p[3] == '8')   // gif
+			|| (p[0] == 0x28 && p[1] == 0xB5 && p[2] == 0x2F && p[3] == 0xFD) // zstd
+			|| (p[0] == 0xFD && p[1] == '7' && p[2] == 'z' && p[3] == 'X')  // xz
+			|| (p[0] == '7' && p[1] == 'z' && p[2] == 0xBC && p[3] == 0xAF) // 7z
+			|| (p[0] == 'B' && p[1] == 'Z' && p[2] == 'h')) {             // bzip2
+		return true;
+	}
+	if (size >= 12) {
+		if ((p[0] == 'R' && p[1] == 'I' && p[2] == 'F' && p[3] == 'F' && memcmp(p + 8, "WEBP", 4) == 0) // webp
+				|| memcmp(p + 4, "ftyp", 4) == 0) {                                                     // mp4, heic
+			return true;
+		}
+	}
+	return false;
+}
+
+ECompressionFilter::Context* ECompressionFilter::contextOf(EIoSession* session) {
+	sp<Context> ctx = dynamic_pointer_cast<Context>(session->attributes.get((llong)SESSION_COMPRESSION_CONTEXT));
+	if (ctx == null) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Compression context not found");
+	}
+	return ctx.get(); // owned by the session attributes.
+}
+
+void ECompressionFilter::setLevel(Context* ctx, int level, EIoBuffer* out) {
+	ZStream* zs = ctx->deflater;
+	if (zs->level == level) {
+		return;
+	}
+
+	// the last message was flushed, nothing pending to be output here.
+	zs->strm.next_out = (Bytef*)out->current();
+	zs->strm.avail_out = out->remaining();
+	int ret = ::deflateParams(&zs->strm, level, Z_DEFAULT_STRATEGY);
+	if (ret != Z_OK) {
+		throw EIOException(__FILE__, __LINE__, EString::formatOf("deflateParams failed: %d", ret).c_str());
+	}
+	out->position(out->limit() - zs->strm.avail_out);
+	zs->level = level;
+}
+
+void ECompressionFilter::deflate(Context* ctx, const void* data, int size, int flush, EIoBuffer* out) {
+	z_stream* strm = &ctx->deflater->strm;
+	strm->next_in = (Bytef*)data;
+	strm->avail_in = size;
+
+	do {
+		if (out->remaining() < 64) {
+			out->expand(ES_MAX(out->capacity(), 1024));
+		}
+		strm->next_out = (Bytef*)out->current();
+		strm->avail_out = out->remaining();
+		int ret = ::deflate(strm, flush);
+		if (ret == Z_STREAM_ERROR) {
+			throw EIOException(__FILE__, __LINE__, "deflate stream error");
+		}
+		out->position(out->limit() - strm->avail_out);
+	} while (strm->avail_out == 0);
+}
+
+sp<EIoBuffer> ECompressionFilter::inflate(Context* ctx, EIoBuffer* in) {
+	z_stream* strm = &ctx->inflater->strm;
+	int n = in->remaining();
+	sp<EIoBuffer> out(EIoBuffer::allocate(ES_MIN(ES_MAX(n * 4, 4096), maxInflateSize)));
+
+	strm->next_in = (Bytef*)in->current();
+	strm->avail_in = n;
+
+	while (true) {
+		if (!out->hasRemaining()) {
+			if (out->position() >= maxInflateSize) {
+				throw EIOException(__FILE__, __LINE__, EString::formatOf("Inflated data exceeds %d bytes", maxInflateSize).c_str());
+			}
+			out->expand(ES_MIN(out->capacity(), maxInflateSize - out->position()));
+		}
+		strm->next_out = (Bytef*)out->current();
+		strm->avail_out = out->remaining();
+		int ret = ::inflate(strm, Z_SYNC_FLUSH);
+		out->position(out->limit() - strm->avail_out);
+
+		if (ret == Z_STREAM_END) {
+			// the peer finished a stream (or a gzip member), a new one may follow.
+			::inflateReset(strm);
+			if (strm->avail_in == 0) break;
+			continue;
+		}
+		if (ret == Z_BUF_ERROR && strm->avail_in == 0) {
+			break; // no more input.
+		}
+		if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			throw EIOException(__FILE__, __LINE__, EString::formatOf("inflate failed: %d, %s", ret, strm->msg ? strm->msg : "").c_str());
+		}
+		if (strm->avail_in == 0 && strm->avail_out != 0) {
+			break;
+		}
+	}
+
+	in->position(in->limit());
+	out->flip();
+	return out;
+}
+
+} /* namespace naf */
+} /* namespace efc */
@@ -0,0 +1,381 @@
+#include "../inc/EExecutorFilter.hh"
+#include "../inc/ESocketAcceptor.hh"
+
+namespace efc {
+namespace naf {
+
+#define EVENTS_PER_TURN 16 // then yield the worker to other sessions.
+
+static const char* SESSION_EXECUTOR_QUEUE = "session_executor_queue";
+
+class QueueSlot: public EObject {
+};
+
+static sp<EObject> QUEUE_SLOT(new QueueSlot());
+
+sp<ELogger> EExecutorFilter::logger = ELoggerManager::getLogger("EExecutorFilter");
+
+class EExecutorFilter::Event: public EObject {
+public:
+	sp<EObject> message;
+	llong queued;
+
+	Event(sp<EObject> message, llong queued) : message(message), queued(queued) {
+	}
+};
+
+/**
+ * The last reply of a session, stops its writer fiber.
+ */
+class EndOfReplies: public EObject {
+};
+
+/**
+ * The messages of a session. It is owned by at most one worker while
+ * <code>scheduled</code>, which keeps the session order.
+ */
+class EExecutorFilter::SessionQueue: public EObject {
+public:
+	ESpinLock lock;
+	sp<ESocketSession> session; // null after closed.
+	ELinkedList<sp<Event> > events;
+	boolean scheduled;
+	boolean closed;
+
+	// accessed by the session fiber only.
+	boolean draining;
+	boolean pulled;
+
+	// handler replies to the writer fiber, the last one is EndOfReplies.
+	EFiberChannel<EObject> replies;
+
+	SessionQueue(sp<ESocketSession> session) :
+			session(session), scheduled(false), closed(false), draining(false), pulled(false) {
+	}
+};
+
+EExecutorFilter::~EExecutorFilter() {
+	shutdown();
+	delete notEmpty;
+}
+
+EExecutorFilter::EExecutorFilter(int threads, int queueCapacity) :
+		queueCapacity(queueCapacity),
+		slots(ES_MAX(queueCapacity, 1)),
+		stopped(false) {
+	if (threads < 0 || queueCapacity <= 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal threads: %d or capacity: %d", threads, queueCapacity).c_str());
+	}
+	if (threads == 0) {
+		threads = EOS::active_processor_count();
+	}
+
+	for (int i = 0; i < queueCapacity; i++) {
+		slots.write(QUEUE_SLOT);
+	}
+
+	notEmpty = lock.newCondition();
+
+	for (int i = 0; i < threads; i++) {
+		sp<EThread> worker = new EEThreadTarget([this](){
+			this->work();
+		});
+		worker->setName(EString::formatOf("executor-%d", i).c_str());
+		EThread::setDaemon(worker, true);
+		worker->start();
+		workers.add(worker);
+	}
+}
+
+void EExecutorFilter::setHandler(Handler handler) {
+	this->handler = handler;
+}
+
+void EExecutorFilter::shutdown() {
+	boolean first = false;
+	SYNCBLOCK(&lock) {
+		if (!stopped) {
+			stopped = true;
+			notEmpty->signalAll();
+			first = true;
+		}
+    }}
+	if (!first) {
+		return;
+	}
+
+	for (int i = 0; i < workers.size(); i++) {
+		workers.getAt(i)->join();
+	}
+}
+
+int EExecutorFilter::getThreads() {
+	return workers.size();
+}
+
+int EExecutorFilter::getQueueSize() {
+	return queueSize.get();
+}
+
+int EExecutorFilter::getLargestQueueSize() {
+	return largestQueueSize.get();
+}
+
+double EExecutorFilter::getAverageQueueWaitTime() {
+	llong count = completedCount.get();
+	return (count > 0) ? waitNanos.get() / 1000000.0 / count : 0.0;
+}
+
+double EExecutorFilter::getMaxQueueWaitTime() {
+	return maxWaitNanos.get() / 1000000.0;
+}
+
+llong EExecutorFilter::getCompletedCount() {
+	return completedCount.get();
+}
+
+llong EExecutorFilter::getBlockedCount() {
+	return blockedCount.get();
+}
+
+boolean EExecutorFilter::sessionCreated(EIoFilter::NextFilter* nextFilter, EIoSession* session) {
+	ESocketSession* socketSession = dynamic_cast<ESocketSession*>(session);
+	ESocketAcceptor* acceptor = dynamic_cast<ESocketAcceptor*>(session->getService());
+	if (!socketSession || !acceptor) {
+		throw EIllegalStateException(__FILE__, __LINE__, "EExecutorFilter needs a socket acceptor session");
+	}
+
+	sp<ESocketSession> ss = socketSession->shared_from_this();
+	sp<SessionQueue> sq(new SessionQueue(ss));
+	session->attributes.put((llong)SESSION_EXECUTOR_QUEUE, sq);
+
+	// write the replies in order on the io thread of the session.
+	acceptor->getFiberScheduler().scheduleInheritThread([sq, ss](){
+		while (true) {
+			try {
+				sp<EObject> reply = sq->replies.read();
+				if (dynamic_pointer_cast<EndOfReplies>(reply) != null) {
+					break;
+				}
+				if (!ss->isClosed()) {
+					ss->write(reply);
+				}
+			} catch (EInterruptedException& e) {
+				break;
+			} catch (EIOException& e) {
+				// closed by peer, drain to the end.
+			}
+		}
+	});
+
+	return nextFilter->sessionCreated(session);
+}
+
+void EExecutorFilter::sessionClosed(EIoFilter::NextFilter* nextFilter, EIoSession* session) {
+	sp<SessionQueue> sq = dynamic_pointer_cast<SessionQueue>(session->attributes.remove((llong)SESSION_EXECUTOR_QUEUE));
+	if (sq != null) {
+		boolean idle;
+		int dropped;
+		SYNCBLOCK(&sq->lock) {
+			sq->closed = true;
+			sq->session = null;
+			dropped = sq->events.size();
+			sq->events.clear();
+			idle = !sq->scheduled;
+		}}
+		release(dropped);
+		// else the owner worker ends it.
+		if (idle) {
+			sq->replies.write(new EndOfReplies());
+		}
+	}
+
+	nextFilter->sessionClosed(session);
+}
+
+sp<EObject> EExecutorFilter::messageReceived(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) {
+	sp<SessionQueue> sq = dynamic_pointer_cast<SessionQueue>(session->attributes.get((llong)SESSION_EXECUTOR_QUEUE));
+	if (message == null || sq == null) {
+		return nextFilter->messageReceived(session, message);
+	}
+
+	// the read buffer is reused by the next read, keep a copy.
+	sp<EIoBuffer> buf = dynamic_pointer_cast<EIoBuffer>(message);
+	if (buf != null) {
+		sp<EIoBuffer> copy = EIoBuffer::allocate(buf->remaining());
+		copy->put(buf->current(), buf->remaining());
+		copy->flip();
+		message = copy;
+	}
+
+	if (stopped) {
+		logger->warn__(__FILE__, __LINE__, "session %ld: executor stopped, message dropped", session->getId());
+		return null;
+	}
+
+	// take a free slot of the queue, the fiber waits in the channel if none.
+	if (queueSize.get() >= queueCapacity) {
+		blockedCount.incrementAndGet();
+	}
+	slots.read();
+
+	int size = queueSize.incrementAndGet();
+	int largest;
+	while (size > (largest = largestQueueSize.get())) {
+		if (largestQueueSize.compareAndSet(largest, size)) {
+			break;
+		}
+	}
+
+	boolean idle;
+	SYNCBLOCK(&sq->lock) {
+		sq->events.add(new Event(message, ESystem::nanoTime()));
+		idle = !sq->scheduled;
+		sq->scheduled = true;
+    }}
+	if (idle && !schedule(sq)) {
+		// stopped meanwhile, no worker takes it any more.
+		int dropped;
+		boolean ended;
+		SYNCBLOCK(&sq->lock) {
+			dropped = sq->events.size();
+			sq->events.clear();
+			sq->scheduled = false;
+			ended = sq->closed;
+		}}
+		release(dropped);
+		if (ended) {
+			sq->replies.write(new EndOfReplies());
+		}
+		return null;
+	}
+
+	// a decoder before may keep more messages of the same read, pull them
+	// all before the next read overwrites the buffer.
+	sq->pulled = true;
+	if (!sq->draining) {
+		sq->draining = true;
+		ON_SCOPE_EXIT(
+			sq->draining = false;
+		);
+		while (sq->pulled) {
+			sq->pulled = false;
+			session->getFilterChain()->fireMessageReceived(null);
+		}
+	}
+
+	return null; // read more.
+}
+
+EString EExecutorFilter::toString() {
+	return EString::formatOf("EExecutorFilter[threads=%d, capacity=%d]", workers.size(), queueCapacity);
+}
+
+boolean EExecutorFilter::schedule(sp<SessionQueue>& sq) {
+	boolean scheduled = false;
+	SYNCBLOCK(&lock) {
+		if (!stopped) {
+			ready.add(sq);
+			notEmpty->signal();
+			scheduled = true;
+		}
+    }}
+	return scheduled;
+}
+
+void EExecutorFilter::release(int count) {
+	if (count > 0) {
+		queueSize.addAndGet(-count);
+		for (int i = 0; i < count; i++) {
+			slots.write(QUEUE_SLOT); // never full: one per taken slot.
+		}
+	}
+}
+
+void EExecutorFilter::work() {
+	while (true) {
+		sp<SessionQueue> sq;
+		SYNCBLOCK(&lock) {
+			while (ready.isEmpty() && !stopped) {
+				notEmpty->await();
+			}
+			sq = ready.poll();
+        }}
+		if (sq == null) {
+			break; // stopped.
+		}
+
+		while (sq != null) {
+			try {
+				process(sq);
+				sq = null;
+			} catch (...) {
+				// still scheduled, the next turn goes on with it; stopped: here.
+				logger->error__(__FILE__, __LINE__, "executor worker: unexpected error");
+				if (schedule(sq)) {
+					sq = null;
+				}
+			}
+		}
+	}
+}
+
+void EExecutorFilter::process(sp<SessionQueue>& sq) {
+	while (true) {
+		for (int i = 0; i < EVENTS_PER_TURN; i++) {
+			sp<Event> event;
+			sp<ESocketSession> session;
+			boolean ended = false;
+			SYNCBLOCK(&sq->lock) {
+				event = sq->events.poll();
+				if (event == null) {
+					sq->scheduled = false;
+					ended = sq->closed;
+				}
+				session = sq->session;
+			}}
+
+			if (event == null) {
+				if (ended) {
+					sq->replies.write(new EndOfReplies());
+				}
+				return;
+			}
+
+			release(1);
+			llong now = ESystem::nanoTime();
+			llong wait = now - event->queued;
+			waitNanos.addAndGet(wait);
+			llong max;
+			while (wait > (max = maxWaitNanos.get())) {
+				if (maxWaitNanos.compareAndSet(max, wait)) {
+					break;
+				}
+			}
+
+			sp<EObject> reply;
+			try {
+				if (handler != null) {
+					reply = handler(session, event->message);
+				}
+			} catch (EThrowable& t) {
+				logger->error__(__FILE__, __LINE__, "session %ld handler: %s", session->getId(), t.toString().c_str());
+			} catch (...) {
+				logger->error__(__FILE__, __LINE__, "session %ld handler: unknown error", session->getId());
+			}
+			completedCount.incrementAndGet();
+
+			if (reply != null) {
+				sq->replies.write(reply);
+			}
+		}
+
+		// more messages, go to the tail; stopped: finish them here.
+		if (schedule(sq)) {
+			return;
+		}
+	}
+}
+
+} /* namespace naf */
+} /* namespace efc */
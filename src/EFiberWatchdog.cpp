@@ -0,0 +1,214 @@
+#include "./EFiberWatchdog.hh"
+
+#include <signal.h>
+#if defined(__linux__) || defined(__APPLE__)
+#include <execinfo.h>
+#define HAVE_BACKTRACE 1
+#endif
+
+namespace efc {
+namespace naf {
+
+#define WATCHDOG_SAMPLE_SIGNAL SIGUSR2
+#define WATCHDOG_SAMPLE_FRAMES 32
+
+sp<ELogger> EFiberWatchdog::logger = ELoggerManager::getLogger("EFiberWatchdog");
+
+#ifdef HAVE_BACKTRACE
+// only one sample at a time, the checker thread is the single requester.
+static void* sampleFrames[WATCHDOG_SAMPLE_FRAMES];
+static volatile int sampleDepth = -1;
+
+static void onSampleSignal(int sig) {
+	sampleDepth = ::backtrace(sampleFrames, WATCHDOG_SAMPLE_FRAMES);
+}
+#endif
+
+EFiberWatchdog::~EFiberWatchdog() {
+	stop();
+	for (int i=0; i<threadSlots.length(); i++) {
+		delete threadSlots[i];
+	}
+}
+
+EFiberWatchdog::EFiberWatchdog(EIoService* service, int thresholdMillis, boolean degrade) :
+		service(service),
+		threshold(thresholdMillis),
+		degrade(degrade),
+		workThreads(service->getWorkThreads()),
+		threadSlots(workThreads),
+		stopped(false),
+		signalInstalled(false) {
+	if (thresholdMillis <= 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal threshold: %d", thresholdMillis).c_str());
+	}
+	for (int i=0; i<workThreads; i++) {
+		threadSlots[i] = new ThreadSlot();
+	}
+}
+
+void EFiberWatchdog::start(EFiberScheduler& scheduler) {
+#ifdef HAVE_BACKTRACE
+	// an application handler of the signal is kept, reports go without stack then.
+	if (sigaction(WATCHDOG_SAMPLE_SIGNAL, NULL, &oldAction) == 0
+			&& !(oldAction.sa_flags & SA_SIGINFO) && oldAction.sa_handler == SIG_DFL) {
+		// backtrace() may allocate at the first call, warm it up out of signal context.
+		void* warmup[1];
+		::backtrace(warmup, 1);
+
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = onSampleSignal;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		signalInstalled = (sigaction(WATCHDOG_SAMPLE_SIGNAL, &sa, NULL) == 0);
+	} else {
+		logger->warn__(__FILE__, __LINE__, "sample signal in use, no stack in reports");
+	}
+#endif
+
+	llong currentTime = ESystem::currentTimeMillis();
+	for (int i=0; i<workThreads; i++) {
+		threadSlots[i]->heartbeat.set(currentTime);
+		this->startHeartbeat(scheduler, i);
+	}
+
+	checker = new EEThreadTarget([this](){
+		int interval = ES_MAX(threshold / 4, 10);
+		try {
+			while (!stopped && (!service->isDisposed() || service->getManagedSessionCount() > 0)) {
+				EThread::sleep(interval);
+				if (!stopped) {
+					this->check(ESystem::currentTimeMillis());
+				}
+			}
+		} catch (EInterruptedException& e) {
+			logger->info__(__FILE__, __LINE__, "interrupted");
+		} catch (EThrowable& t) {
+			logger->error__(__FILE__, __LINE__, t.toString().c_str());
+		}
+	});
+	EThread::setDaemon(checker, true);
+	checker->start();
+}
+
+void EFiberWatchdog::stop() {
+	if (stopped) {
+		return;
+	}
+	stopped = true;
+
+	if (checker != null) {
+		checker->interrupt();
+		try {
+			checker->join();
+		} catch (EInterruptedException& e) {
+			//
+		}
+	}
+
+#ifdef HAVE_BACKTRACE
+	if (signalInstalled) {
+		sigaction(WATCHDOG_SAMPLE_SIGNAL, &oldAction, NULL);
+		signalInstalled = false;
+	}
+#endif
+}
+
+void EFiberWatchdog::startHeartbeat(EFiberScheduler& scheduler, int tag) {
+	sp<EFiber> heartbeatFiber = new EFiberTarget([tag,this](){
+		ThreadSlot* slot = threadSlots[tag];
+		slot->thread = pthread_self();
+		slot->threadKnown = true;
+
+		int interval = ES_MAX(threshold / 4, 10);
+		try {
+			while (!service->isDisposed() || service->getManagedSessionCount() > 0) {
+				slot->heartbeat.set(ESystem::currentTimeMillis());
+				if (slot->degraded.value() != 0) {
+					slot->degraded = 0; // thread come back.
+				}
+
+				usleep(interval * 1000); //!
+			}
+		} catch (EInterruptedException& e) {
+			logger->info__(__FILE__, __LINE__, "interrupted");
+		} catch (EThrowable& t) {
+			logger->error__(__FILE__, __LINE__, t.toString().c_str());
+		}
+		slot->threadKnown = false; // the thread may exit, no sample any more.
+	});
+	heartbeatFiber->setTag(tag); //tag: 0-N
+
+	scheduler.schedule(heartbeatFiber);
+}
+
+void EFiberWatchdog::check(llong currentTime) {
+	for (int i=0; i<threadSlots.length(); i++) {
+		ThreadSlot* slot = threadSlots[i];
+		llong beat = slot->heartbeat.get();
+		llong blocked = currentTime - beat;
+		if (blocked > threshold && slot->reportedBeat != beat) {
+			slot->reportedBeat = beat; // report once per stall.
+			if (degrade && i > 0) {
+				slot->degraded = 1;
+			}
+			service->getStatistics()->blockedFiberCount.incrementAndGet();
+			this->report(i, slot, blocked);
+		}
+	}
+}
+
+void EFiberWatchdog::report(int threadIndex, ThreadSlot* slot, llong blockedMillis) {
+	EString msg = EString::formatOf("fiber blocked io thread %d for %lld ms", threadIndex, blockedMillis);
+
+	long sessionId;
+	EString remote;
+	SYNCBLOCK(&slot->lock) {
+		sessionId = slot->sessionId;
+		remote = slot->remote;
+	}}
+	if (sessionId >= 0) {
+		msg.append(", session=").append(sessionId);
+		msg.append(", remote=").append(remote);
+	}
+
+	msg.append(sampleStack(slot));
+
+	logger->warn__(__FILE__, __LINE__, msg.c_str());
+}
+
+EString EFiberWatchdog::sampleStack(ThreadSlot* slot) {
+	EString sb;
+#ifdef HAVE_BACKTRACE
+	if (!signalInstalled || !slot->threadKnown) {
+		return sb;
+	}
+
+	sampleDepth = -1;
+	if (pthread_kill(slot->thread, WATCHDOG_SAMPLE_SIGNAL) != 0) {
+		return sb;
+	}
+	for (int i=0; i<50 && sampleDepth < 0; i++) {
+		EThread::sleep(1);
+	}
+	int depth = sampleDepth;
+	if (depth <= 0) {
+		return sb;
+	}
+
+	char** symbols = ::backtrace_symbols(sampleFrames, depth);
+	if (symbols) {
+		sb.append(", stack:");
+		// skip the signal handler frames.
+		for (int i=2; i<depth; i++) {
+			sb.append("\n\t").append(symbols[i]);
+		}
+		free(symbols);
+	}
+#endif
+	return sb;
+}
+
+} /* namespace naf */
+} /* namespace efc */
@@ -0,0 +1,126 @@
+#ifndef EFIBERWATCHDOG_HH_
+#define EFIBERWATCHDOG_HH_
+
+#include "../inc/EIoService.hh"
+#include "../inc/EIoSession.hh"
+
+#include <pthread.h>
+#include <signal.h>
+
+namespace efc {
+namespace naf {
+
+/**
+ * Detects fibers which occupy an io thread for too long.
+ *
+ * Every io thread runs a heartbeat fiber which stamps the thread slot
+ * periodically, a daemon thread checks the slots and reports a thread
+ * whose heartbeat was not updated in <code>threshold</code> millis:
+ * the session which resumed last on that thread, its remote address
+ * and a stack sample of the blocked thread are logged.
+ *
+ * Sessions mark themselves active on the slot of the current thread
+ * every time the session fiber resumed from socket io.
+ */
+
+class EFiberWatchdog: public EObject {
+public:
+	virtual ~EFiberWatchdog();
+
+	EFiberWatchdog(EIoService* service, int thresholdMillis, boolean degrade);
+
+	/**
+	 * Starts the heartbeat fibers and the checker thread, and installs
+	 * the stack sample signal unless the application handles it.
+	 */
+	void start(EFiberScheduler& scheduler);
+
+	/**
+	 * Stops and joins the checker thread and restores the sample signal,
+	 * the service must not be used by the watchdog any more. Idempotent.
+	 */
+	void stop();
+
+	/**
+	 * Marks the session as the running one of current io thread.
+	 */
+	void active(EIoSession* session) {
+		EFiber* fiber = EFiber::currentFiber();
+		if (fiber) {
+			ThreadSlot* slot = threadSlots[fiber->getThreadIndex()];
+			long id = session->getId();
+			if (slot->sessionId != id) {
+				// a copy for the checker, the session may be freed before a report.
+				EInetSocketAddress* address = session->getRemoteAddress();
+				EString remote = address ? address->toString() : EString("unknown");
+				SYNCBLOCK(&slot->lock) {
+					slot->sessionId = id;
+					slot->remote = remote;
+				}}
+			}
+		}
+	}
+
+	/**
+	 * Clears the session mark of current io thread.
+	 */
+	void inactive(EIoSession* session) {
+		EFiber* fiber = EFiber::currentFiber();
+		if (fiber) {
+			ThreadSlot* slot = threadSlots[fiber->getThreadIndex()];
+			if (slot->sessionId == session->getId()) {
+				SYNCBLOCK(&slot->lock) {
+					slot->sessionId = -1;
+				}}
+			}
+		}
+	}
+
+	/**
+	 * Returns <code>true</code> if the io thread is blocked now and
+	 * marked as degraded.
+	 */
+	boolean isDegraded(int threadIndex) {
+		return degrade && (threadIndex < threadSlots.length())
+				&& threadSlots[threadIndex]->degraded.value() != 0;
+	}
+
+	int getThreshold() {
+		return threshold;
+	}
+
+private:
+	struct ThreadSlot: public EObject {
+		EAtomicLLong heartbeat;
+		EAtomicCounter degraded;
+		ESpinLock lock; // of the session snapshot.
+		volatile long sessionId; // -1 if none.
+		EString remote; // formatted by the socket address, any family.
+		pthread_t thread;
+		volatile boolean threadKnown;
+		llong reportedBeat;
+		ThreadSlot(): sessionId(-1), threadKnown(false), reportedBeat(-1) {
+		}
+	};
+
+	static sp<ELogger> logger;
+
+	EIoService* service;
+	int threshold;
+	boolean degrade;
+	int workThreads;
+	EA<ThreadSlot*> threadSlots;
+	sp<EThread> checker;
+	volatile boolean stopped;
+	boolean signalInstalled;
+	struct sigaction oldAction;
+
+	void startHeartbeat(EFiberScheduler& scheduler, int tag);
+	void check(llong currentTime);
+	void report(int threadIndex, ThreadSlot* slot, llong blockedMillis);
+	EString sampleStack(ThreadSlot* slot);
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* EFIBERWATCHDOG_HH_ */
@@ -8,46 +8,217 @@
 #include "../inc/EHttpAcceptor.hh"
 #include "../inc/EHttpSession.hh"
 
+#include <vector>
+
 namespace efc {
 namespace naf {
 
+/**
+ * A request worker. It sleeps in its own wake channel while no queue has
+ * a request; a waker claims the asleep flag before writing, so at most
+ * one wake token is pending and the write never waits.
+ */
+class EHttpAcceptor::Worker {
+public:
+	EAtomicInteger asleep;
+	EFiberChannel<EObject> wake;
+
+	Worker() : wake(1) {
+	}
+};
+
+/**
+ * The requests decoded by one io thread. The signal channel carries one
+ * token per queued request, taken by whoever polls the request, so it
+ * bounds the queue.
+ */
+class EHttpAcceptor::RequestQueue {
+public:
+	ESpinLock lock;
+	ELinkedList<sp<EHttpRequest> > requests;
+	EFiberChannel<EObject> signals;
+	std::vector<Worker*> workers; // spread to this queue, fixed after listen.
+
+	RequestQueue(int capacity) : signals(capacity) {
+	}
+
+	~RequestQueue() {
+		for (Worker* worker : workers) {
+			delete worker;
+		}
+	}
+};
+
+class RequestSignal: public EObject {
+};
+
+static sp<EObject> REQUEST_SIGNAL(new RequestSignal());
+
 EHttpAcceptor::~EHttpAcceptor() {
+	// the detached workers out of the scheduler, the fiber ones are joined.
+	stopping_ = true;
+	for (int i=0; i<queues_.length(); i++) {
+		while (queues_[i] && wakeWorker(i)) {
+			// all the sleeping ones.
+		}
+	}
+	for (int i=0; i<workerThreads_.size(); i++) {
+		workerThreads_.getAt(i)->join();
+	}
 
+	for (int i=0; i<queues_.length(); i++) {
+		delete queues_[i];
+	}
 }
 
 EHttpAcceptor::EHttpAcceptor(boolean rwIoDetached, boolean workerDetached) :
-		rwIoDetached_(rwIoDetached), workerDetached_(workerDetached), handler_(null), requestChannel(100) {
+		rwIoDetached_(rwIoDetached), workerDetached_(workerDetached), handler_(null), router_(null), cache_(null),
+		inline_(false), buffering_(false), pipelineDepth_(Http::Http1Settings::DEFAULT_MAX_PIPELINE_DEPTH), workers_(WORKERS), queueCapacity_(QUEUE_CAPACITY),
+		queues_(ES_MAX(EOS::active_processor_count() - 1, 1)), // io threads but the accept one.
+		stopping_(false) {
 	if (workerDetached) {
 		rwIoDetached_ = true; //! unsupport (false, true) mode.
 	}
 }
 
+void EHttpAcceptor::setWorkers(int workers, int queueCapacity) {
+	if (workers <= 0 || queueCapacity <= 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal workers: %d, %d", workers, queueCapacity).c_str());
+	}
+	if (status_ != INITED) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Acceptor is already listening.");
+	}
+	workers_ = workers;
+	queueCapacity_ = queueCapacity;
+}
+
+int EHttpAcceptor::getWorkers() {
+	return ES_MAX(workers_, queues_.length());
+}
+
+llong EHttpAcceptor::getStolenRequestCount() {
+	return stolenCount_.get();
+}
+
+void EHttpAcceptor::setInlineHandling(boolean on) {
+	if (status_ != INITED) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Acceptor is already listening.");
+	}
+	if (on && rwIoDetached_) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Inline handling is not supported in the detached modes.");
+	}
+	inline_ = on;
+}
+
+boolean EHttpAcceptor::isInlineHandling() {
+	return inline_;
+}
+
+void EHttpAcceptor::setMaxPipelineDepth(int depth) {
+	if (depth < (int)Http::Http1Settings::MIN_MAX_PIPELINE_DEPTH) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal pipeline depth: %d", depth).c_str());
+	}
+	if (status_ != INITED) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Acceptor is already listening.");
+	}
+	pipelineDepth_ = depth;
+}
+
+int EHttpAcceptor::getMaxPipelineDepth() {
+	return pipelineDepth_;
+}
+
+void EHttpAcceptor::setRequestBuffering(boolean on) {
+	if (status_ != INITED) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Acceptor is already listening.");
+	}
+	buffering_ = on;
+}
+
+boolean EHttpAcceptor::isRequestBuffering() {
+	return buffering_;
+}
+
+boolean EHttpAcceptor::isRequestStreaming() {
+	// an inline handler would wait for the body in the fiber which decodes it.
+	return !buffering_ && !inline_;
+}
+
+void EHttpAcceptor::bind(int port, const Http::Http2Settings& http2, boolean ssl, const char* name, std::function<void(Service& service)> listener) {
+	checkHttp2Settings(http2);
+	ESocketAcceptor::bind(port, ssl, name, [this, &http2, listener](Service& service) {
+		http2Settings_[&service] = http2;
+		if (listener != null) { listener(service); }
+	});
+}
+
+void EHttpAcceptor::bind(const char* hostname, int port, const Http::Http2Settings& http2, boolean ssl, const char* name, std::function<void(Service& service)> listener) {
+	checkHttp2Settings(http2);
+	ESocketAcceptor::bind(hostname, port, ssl, name, [this, &http2, listener](Service& service) {
+		http2Settings_[&service] = http2;
+		if (listener != null) { listener(service); }
+	});
+}
+
+const Http::Http2Settings& EHttpAcceptor::getHttp2Settings(Service* service) {
+	auto it = http2Settings_.find(service);
+	return (it != http2Settings_.end()) ? it->second : defaultHttp2Settings_;
+}
+
+void EHttpAcceptor::checkHttp2Settings(const Http::Http2Settings& http2) {
+	typedef Http::Http2Settings S;
+	// any hpack table size is valid.
+	if (http2.max_concurrent_streams_ < S::MIN_MAX_CONCURRENT_STREAMS
+			|| http2.max_concurrent_streams_ > S::MAX_MAX_CONCURRENT_STREAMS) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal max concurrent streams: %u", http2.max_concurrent_streams_).c_str());
+	}
+	if (http2.initial_stream_window_size_ < S::MIN_INITIAL_STREAM_WINDOW_SIZE
+			|| http2.initial_stream_window_size_ > S::MAX_INITIAL_STREAM_WINDOW_SIZE) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal initial stream window size: %u", http2.initial_stream_window_size_).c_str());
+	}
+	if (http2.initial_connection_window_size_ < S::MIN_INITIAL_CONNECTION_WINDOW_SIZE
+			|| http2.initial_connection_window_size_ > S::MAX_INITIAL_CONNECTION_WINDOW_SIZE) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal initial connection window size: %u", http2.initial_connection_window_size_).c_str());
+	}
+	if (http2.window_update_threshold_ < S::MIN_WINDOW_UPDATE_THRESHOLD
+			|| http2.window_update_threshold_ > S::MAX_WINDOW_UPDATE_THRESHOLD) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal window update threshold: %u", http2.window_update_threshold_).c_str());
+	}
+}
+
 void EHttpAcceptor::listen() {
-	if (!workerDetached_) {
-		for (int i=0; i<WORKERS; i++) {
-			this->getFiberScheduler().schedule([this](){
-				while (true) {
-					try {
-						processRequest(this->requestChannel.read());
-					} catch (...) {
-						//...
-					}
-				}
-			});
-		}
-	} else {
-		for (int i=0; i<WORKERS; i++) {
-			sp<EThread> worker = new EEThreadTarget([this](){
-				while (true) {
-					try {
-						processRequest(this->requestChannel.read());
-					} catch (...) {
-						//...
-					}
-				}
-			});
-			EThread::setDaemon(worker, true);
-			worker->start();
+	if (inline_) {
+		ESocketAcceptor::listen(); //!!!
+		return;
+	}
+
+	for (int i=0; i<queues_.length(); i++) {
+		queues_[i] = new RequestQueue(queueCapacity_);
+	}
+
+	// every queue needs its own worker.
+	int workers = getWorkers();
+	for (int i=0; i<workers; i++) {
+		queues_[i % queues_.length()]->workers.push_back(new Worker());
+	}
+
+	for (int i=0; i<queues_.length(); i++) {
+		for (Worker* w : queues_[i]->workers) {
+			int index = i;
+			if (!workerDetached_) {
+				sp<EFiber> worker = new EFiberTarget([this, index, w](){
+					this->work(index, w);
+				});
+				worker->setTag(index + 1); // on the io thread of the queue.
+				this->getFiberScheduler().schedule(worker);
+			} else {
+				sp<EThread> worker = new EEThreadTarget([this, index, w](){
+					this->work(index, w);
+				});
+				EThread::setDaemon(worker, true);
+				worker->start();
+				workerThreads_.add(worker);
+			}
 		}
 	}
 
@@ -58,11 +229,20 @@ sp<ESocketSession> EHttpAcceptor::newSession(EIoService *service, sp<ESocket>& s
 	return dynamic_cast<ESocketSession*>(new EHttpSession(service, socket));
 }
 
+void EHttpAcceptor::onServiceBound(Service* service) {
+	if (service->sslActive) {
+		// the bind listener has applied the ssl parameters, which may reset the context.
+		sp<ESSLServerSocket> sss = dynamic_pointer_cast<ESSLServerSocket>(service->ss);
+		sss->setNegotiatedProtocols("h2", "http/1.1", NULL);
+	}
+}
+
 void EHttpAcceptor::onConnectionHandle(sp<ESocketSession>& session, ESocketAcceptor::Service* service) {
 	// supper call
 	ESocketAcceptor::onConnectionHandle(session, service);
 
 	sp<EHttpSession> hs = dynamic_pointer_cast<EHttpSession>(session);
+	hs->hs2 = getHttp2Settings(service);
 
 	// let write message in another fiber.
 	if (rwIoDetached_) {
@@ -90,6 +270,14 @@ void EHttpAcceptor::setHttpHandler(EHttpHandler* handler) {
 	handler_ = handler;
 }
 
+void EHttpAcceptor::setHttpRouter(EHttpRouter* router) {
+	router_ = router;
+}
+
+void EHttpAcceptor::setResponseCache(EHttpResponseCache* cache) {
+	cache_ = cache;
+}
+
 boolean EHttpAcceptor::isRWIoDetached() {
 	return rwIoDetached_;
 }
@@ -98,50 +286,167 @@ boolean EHttpAcceptor::isWorkerDetached() {
 	return workerDetached_;
 }
 
+/**
+ * The handler method of each Http::Method, indexed by it.
+ */
+typedef void (EHttpHandler::*HandlerMethod)(sp<EHttpSession>& session,
+		sp<EHttpRequest>& request, sp<EHttpResponse>& response);
+
+static const HandlerMethod METHOD_HANDLERS[Http::NumMethods] = {
+	&EHttpHandler::doGet,     // Get
+	&EHttpHandler::doHead,    // Head
+	&EHttpHandler::doPost,    // Post
+	&EHttpHandler::doPut,     // Put
+	&EHttpHandler::doDelete,  // Delete
+	&EHttpHandler::doOptions, // Options
+	&EHttpHandler::doTrace,   // Trace
+	&EHttpHandler::doPatch,   // Patch
+	null,                     // Connect
+	null                      // Other
+};
+
 void EHttpAcceptor::processRequest(sp<EHttpRequest> request) {
-	HeaderMapPtr headers = request->getHeaderMap();
-	HeaderEntry* he = headers->Method();
-	EString method = he->value().c_str();
+	HandlerMethod doMethod = METHOD_HANDLERS[static_cast<int>(request->getMethod())];
 
 	ActiveStream* stream = request->getHttpStream();
 	sp<EHttpSession> session = stream->getHttpSession();
 	sp<EHttpResponse> response(new EHttpResponse(stream));
+	SYNCBLOCK(&stream->lock) {
+		stream->response = response; // woken by the codec.
+	}}
+
+	// a hit is replied without the handler.
+	if (cache_ && cache_->serve(request, response)) {
+		response->finish();
+		return;
+	}
+
+	try {
+		// service
+		if (handler_) {
+			handler_->service(session, request, response);
+		}
 
-	// service
-	handler_->service(session, request, response);
-
-	if (method.equalsIgnoreCase("GET")) {
-		handler_->doGet(session, request, response);
-	} else if (method.equalsIgnoreCase("HEAD")) {
-		handler_->doHead(session, request, response);
-	} else if (method.equalsIgnoreCase("POST")) {
-		handler_->doPost(session, request, response);
-	} else if (method.equalsIgnoreCase("PUT")) {
-		handler_->doPut(session, request, response);
-	} else if (method.equalsIgnoreCase("DELETE")) {
-		handler_->doDelete(session, request, response);
-	} else if (method.equalsIgnoreCase("OPTIONS")) {
-		handler_->doOptions(session, request, response);
-	} else if (method.equalsIgnoreCase("TRACE")) {
-		handler_->doTrace(session, request, response);
-	} else if (method.equalsIgnoreCase("PATCH")) {
-		handler_->doPatch(session, request, response);
-	}
-
-	// response.
-	if (isRWIoDetached()) {
-		session->responseChannel.write(response);
-	} else {
-		stream->encodeHeaders(response->getHeaderMap(), (response->bodyData == null));
-
-		if (response->bodyData != null) {
-			Http::Buffer::OwnedImpl buffer;
-			buffer.add(response->bodyData);
-			stream->encodeData(buffer, false);
-			buffer.clear();
-			stream->encodeData(buffer, true);
+		Http::Code routed = router_ ? router_->route(session, request, response) : Http::Code::NotFound;
+		if (routed != Http::Code::OK) {
+			if (handler_) {
+				if (doMethod) {
+					(handler_->*doMethod)(session, request, response);
+				}
+			} else {
+				response->getHeaderMap().Status()->value(static_cast<uint64_t>(routed));
+			}
 		}
+	} catch (...) {
+		// end the stream, or it is never recycled.
+		stream->abort();
+		throw;
 	}
+
+	if (cache_) {
+		cache_->store(request, response);
+	}
+
+	// response, the rest of it if flushed.
+	response->finish();
+}
+
+void EHttpAcceptor::dispatchRequest(sp<EHttpRequest>& request) {
+	if (inline_) {
+		try {
+			processRequest(request);
+		} catch (...) {
+			//...
+		}
+		return;
+	}
+
+	EFiber* fiber = EFiber::currentFiber();
+	int index = fiber ? (fiber->getThreadIndex() - 1) : 0;
+	if (index < 0 || index >= queues_.length()) {
+		index = 0;
+	}
+
+	RequestQueue* queue = queues_[index];
+	queue->signals.write(REQUEST_SIGNAL); // waits if full.
+	SYNCBLOCK(&queue->lock) {
+		queue->requests.add(request);
+	}}
+
+	if (!wakeWorker(index) && queues_.length() > 1) {
+		// own workers are busy, wake a sleeping neighbor to steal it.
+		int start = index + 1 + (int)(((ullong)request.get() >> 6) % (queues_.length() - 1));
+		for (int i=0; i<queues_.length() - 1; i++) {
+			int next = (start + i) % queues_.length();
+			if (next != index && wakeWorker(next)) {
+				break;
+			}
+		}
+	}
+}
+
+void EHttpAcceptor::work(int index, Worker* worker) {
+	while (!stopping_) {
+		try {
+			sp<EHttpRequest> request;
+			while ((request = pollRequest(index)) != null) {
+				try {
+					processRequest(request);
+				} catch (...) {
+					//...
+				}
+			}
+
+			// sleep, unless a request came before the flag was seen.
+			worker->asleep.set(1);
+			request = pollRequest(index);
+			if (request == null && !stopping_) {
+				worker->wake.read();
+				continue;
+			}
+			if (!worker->asleep.compareAndSet(1, 0)) {
+				worker->wake.read(); // claimed, the token is being written.
+			}
+			if (request != null) {
+				try {
+					processRequest(request);
+				} catch (...) {
+					//...
+				}
+			}
+		} catch (EInterruptedException& e) {
+			break;
+		}
+	}
+}
+
+sp<EHttpRequest> EHttpAcceptor::pollRequest(int index) {
+	// own queue first, then steal from the others.
+	for (int i=0; i<queues_.length(); i++) {
+		RequestQueue* queue = queues_[(index + i) % queues_.length()];
+		sp<EHttpRequest> request;
+		SYNCBLOCK(&queue->lock) {
+			request = queue->requests.poll();
+		}}
+		if (request != null) {
+			queue->signals.read(); // its token, written before it was queued.
+			if (i > 0) {
+				stolenCount_.incrementAndGet();
+			}
+			return request;
+		}
+	}
+	return null;
+}
+
+boolean EHttpAcceptor::wakeWorker(int index) {
+	for (Worker* worker : queues_[index]->workers) {
+		if (worker->asleep.get() == 1 && worker->asleep.compareAndSet(1, 0)) {
+			worker->wake.write(REQUEST_SIGNAL);
+			return true;
+		}
+	}
+	return false;
 }
 
 void EHttpAcceptor::detachWriteRoutine(sp<EHttpSession>& session) {
@@ -154,16 +459,12 @@ void EHttpAcceptor::detachWriteRoutine(sp<EHttpSession>& session) {
 				}
 
 				ActiveStream* stream = response->stream;
-
-				stream->encodeHeaders(response->headerMap, (response->bodyData == null));
-
-				if (response->bodyData != null) {
-					Http::Buffer::OwnedImpl buffer;
-					buffer.add(response->bodyData);
-					stream->encodeData(buffer, false);
-					buffer.clear();
-					stream->encodeData(buffer, true);
+				if (dynamic_pointer_cast<ResumeReadingHttpResponse>(response) != null) {
+					stream->readDisable(false);
+					continue;
 				}
+
+				response->send();
 			} catch (EInterruptedException& e) {
 				break;
 			}
@@ -11,7 +11,9 @@
 namespace efc {
 namespace naf {
 
-EHttpRequest::EHttpRequest(ActiveStream* as, Http::HeaderMapPtr hm) : stream(as), headerMap(hm) {
+EHttpRequest::EHttpRequest(ActiveStream* as, Http::HeaderMapPtr hm, boolean streaming) :
+		stream(as), headerMap(hm), streaming(streaming), bodyComplete(false),
+		bodyPaused(false), bodyQueued(0), pathParameterCount(0) {
 	//
 }
 
@@ -19,5 +21,117 @@ ActiveStream* EHttpRequest::getHttpStream() {
 	return stream;
 }
 
+const EHttpRequest::PathParameter* EHttpRequest::getPathParameter(const char* name) {
+	for (int i = 0; i < pathParameterCount; i++) {
+		if (strcmp(pathParameters[i].name, name) == 0) {
+			return &pathParameters[i];
+		}
+	}
+	return null;
+}
+
+const EHttpRequest::PathParameter* EHttpRequest::getPathParameter(int index) {
+	return (index >= 0 && index < pathParameterCount) ? &pathParameters[index] : null;
+}
+
+int EHttpRequest::getPathParameterCount() {
+	return pathParameterCount;
+}
+
+boolean EHttpRequest::isStreaming() {
+	return streaming;
+}
+
+Http::Buffer::LinkedBuffer EHttpRequest::getBodyData() {
+	if (streaming) {
+		Http::Buffer::LinkedBuffer all;
+		sp<EIoBuffer> chunk;
+		while ((chunk = read()) != null) {
+			all.add(chunk);
+		}
+		SYNCBLOCK(&bodyLock) {
+			bodyData = all;
+			streaming = false;
+		}}
+	}
+	return bodyData;
+}
+
+sp<EIoBuffer> EHttpRequest::read() {
+	while (true) {
+		sp<EIoBuffer> chunk;
+		boolean end;
+		boolean resume = false;
+		ActiveStream* as;
+		SYNCBLOCK(&bodyLock) {
+			chunk = bodyData.poll();
+			if (chunk != null) {
+				bodyQueued -= chunk->remaining();
+				if (bodyPaused && bodyQueued <= BODY_LOW_WATERMARK) {
+					bodyPaused = false;
+					resume = true;
+				}
+			}
+			end = bodyComplete;
+			as = stream;
+		}}
+
+		if (resume && as) {
+			as->resumeReading();
+		}
+		if (chunk != null || end) {
+			return chunk;
+		}
+
+		// wait for the decoding fiber, it signals each chunk and the end.
+		bodySignal.await([this]() {
+			boolean ready;
+			SYNCBLOCK(&bodyLock) {
+				ready = !bodyData.isEmpty() || bodyComplete;
+			}}
+			return ready;
+		});
+	}
+}
+
+boolean EHttpRequest::offerBody(sp<EIoBuffer>& chunk) {
+	boolean queued = false;
+	boolean pause = false;
+	SYNCBLOCK(&bodyLock) {
+		if (!bodyComplete) { // else discarded.
+			bodyData.add(chunk);
+			queued = true;
+			if (streaming) {
+				bodyQueued += chunk->remaining();
+				if (!bodyPaused && bodyQueued > BODY_HIGH_WATERMARK) {
+					bodyPaused = true;
+					pause = true;
+				}
+			}
+		}
+	}}
+	if (queued) {
+		bodySignal.signal();
+	}
+	return pause;
+}
+
+boolean EHttpRequest::endBody(boolean discard) {
+	boolean resume = false;
+	SYNCBLOCK(&bodyLock) {
+		bodyComplete = true;
+		if (discard) {
+			bodyData.clear();
+			bodyQueued = 0;
+		}
+		if (bodyPaused) {
+			bodyPaused = false;
+			resume = true;
+		}
+	}}
+	bodySignal.signal();
+	return resume;
+}
+
 } /* namespace naf */
 } /* namespace efc */
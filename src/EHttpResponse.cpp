@@ -6,16 +6,18 @@
  */
 
 #include "../inc/EHttpResponse.hh"
+#include "../inc/EHttpSession.hh"
 
 #include "../http/include/codes.h"
 #include "../http/source/headers.h"
-#include "../http/source/buffer_impl.h"
 
 namespace efc {
 namespace naf {
 
 EHttpResponse::EHttpResponse(ActiveStream* as) :
-		stream(as), headerMap{{Http::Headers::get().Status, std::to_string((int)Http::Code::OK)}} {
+		stream(as), headerMap{{Http::Headers::get().Status, std::to_string((int)Http::Code::OK)}},
+		pendingBytes(0), heldBytes(0), committed(false), queued(false), headersSent(false),
+		finished(false), ended(false) {
 	//
 }
 
@@ -28,10 +30,139 @@ Http::HeaderMap& EHttpResponse::getHeaderMap() {
 }
 
 void EHttpResponse::write(const void* data, int len) {
-	if (bodyData == null) {
-		bodyData = EIoBuffer::allocate(256);
+	const char* p = (const char*)data;
+	while (len > 0) {
+		if (bodyTail == null || !bodyTail->hasRemaining()) {
+			if (bodyTail != null) {
+				bodyData.add(bodyTail);
+			}
+			bodyTail = EIoBuffer::allocate(ES_MAX(len, CHUNK_SIZE));
+		}
+		int n = ES_MIN(len, bodyTail->remaining());
+		bodyTail->put(p, n);
+		p += n;
+		len -= n;
 	}
-	bodyData->put(data, len);
+}
+
+void EHttpResponse::flush() {
+	commit(false);
+
+	// the handler is slowed down to the peer, woken when the codec sends data of the stream, on
+	// a reset and when the connection is closed.
+	flushSignal.await([this]() {
+		return unsentBytes() <= FLUSH_HIGH_WATERMARK || isAborted();
+	});
+}
+
+boolean EHttpResponse::isCommitted() {
+	boolean r;
+	SYNCBLOCK(&lock) {
+		r = committed;
+	}}
+	return r;
+}
+
+void EHttpResponse::finish() {
+	commit(true);
+}
+
+void EHttpResponse::commit(boolean finish) {
+	boolean post;
+	SYNCBLOCK(&lock) {
+		if (finished || ended) {
+			return;
+		}
+		if (bodyTail != null && bodyTail->position() > 0) {
+			bodyData.add(bodyTail);
+		}
+		bodyTail = null;
+		pendingBytes += bodyData.length();
+		pending.move(bodyData);
+
+		committed = true;
+		finished = finish;
+		post = !queued;
+		queued = true;
+	}}
+
+	if (post) {
+		stream->sendResponse();
+	}
+}
+
+void EHttpResponse::send() {
+	Http::Buffer::OwnedImpl data;
+	boolean headers;
+	boolean end;
+	SYNCBLOCK(&lock) {
+		queued = false;
+		if (ended) {
+			return;
+		}
+		data.move(pending);
+		pendingBytes = 0;
+		headers = !headersSent;
+		headersSent = true;
+		end = finished;
+		ended = finished;
+	}}
+
+	// the stream may be recycled once ended, do not touch it after.
+	boolean empty = (data.length() == 0);
+	if (headers) {
+		stream->encodeHeaders(sharedHeaders != null ? *sharedHeaders : headerMap, end && empty);
+	}
+	if (!empty || (end && !headers)) {
+		stream->encodeData(data, end);
+	}
+
+	if (!end) {
+		uint64_t held = stream->bufferedBytes();
+		SYNCBLOCK(&lock) {
+			heldBytes = held;
+		}}
+		flushSignal.signal(); // counted again, see unsentBytes().
+	}
+}
+
+boolean EHttpResponse::cancel() {
+	boolean r;
+	SYNCBLOCK(&lock) {
+		ended = true;
+		r = committed;
+	}}
+	return r;
+}
+
+boolean EHttpResponse::isAborted() {
+	boolean r;
+	SYNCBLOCK(&lock) {
+		r = ended;
+	}}
+	return r || stream->session->isClosed();
+}
+
+uint64_t EHttpResponse::unsentBytes() {
+	if (!stream->isDetached()) {
+		// sent at once by the handler.
+		return stream->bufferedBytes();
+	}
+
+	// the codec is used by the write fiber of the session only, it has the held
+	// bytes counted again by a send with nothing pending.
+	boolean post = false;
+	uint64_t unsent;
+	SYNCBLOCK(&lock) {
+		unsent = pendingBytes + heldBytes;
+		if (!queued && heldBytes > 0 && !ended) {
+			post = queued = true;
+		}
+	}}
+	if (post) {
+		stream->sendResponse();
+	}
+	return unsent;
 }
 
 } /* namespace naf */
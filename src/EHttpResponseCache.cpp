@@ -0,0 +1,444 @@
+#include "../inc/EHttpResponseCache.hh"
+
+#include "../http/include/codes.h"
+#include "../http/source/headers.h"
+
+#include <strings.h>
+
+namespace efc {
+namespace naf {
+
+/**
+ * A read only view of a stored body, which keeps it alive until the
+ * view is written.
+ */
+class CachedBodyView: public EIoBuffer {
+public:
+	CachedBodyView(sp<EIoBuffer>& body) :
+			EIoBuffer(body->current(), body->remaining()), body(body) {
+	}
+
+private:
+	sp<EIoBuffer> body;
+};
+
+EHttpResponseCache::~EHttpResponseCache() {
+	clear();
+}
+
+EHttpResponseCache::EHttpResponseCache(llong maxBytes, int ttl) :
+		maxBytes_(maxBytes), ttl_(ttl), head_(null), tail_(null), bytes_(0),
+		counters_(EOS::active_processor_count() + 1) {
+	if (maxBytes <= 0 || ttl <= 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal cache: %lld, %d", maxBytes, ttl).c_str());
+	}
+	for (int i = 0; i < counters_.length(); i++) {
+		counters_[i] = new ThreadCounters();
+	}
+}
+
+void EHttpResponseCache::addKeyHeader(const char* name) {
+	if (!name || !*name) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Header name can not be empty");
+	}
+	keyHeaders_.push_back(Http::LowerCaseString(std::string(name)));
+}
+
+#define SUM_COUNTERS(field) \
+	llong sum = 0; \
+	for (int i = 0; i < counters_.length(); i++) { \
+		sum += counters_[i]->field.get(); \
+	} \
+	return sum;
+
+llong EHttpResponseCache::getHitCount() {
+	SUM_COUNTERS(hits)
+}
+
+llong EHttpResponseCache::getMissCount() {
+	SUM_COUNTERS(misses)
+}
+
+llong EHttpResponseCache::getNotModifiedCount() {
+	SUM_COUNTERS(notModified)
+}
+
+int EHttpResponseCache::size() {
+	int n;
+	SYNCBLOCK(&lock_) {
+		n = entries_.size();
+	}}
+	return n;
+}
+
+llong EHttpResponseCache::getBytes() {
+	llong n;
+	SYNCBLOCK(&lock_) {
+		n = bytes_;
+	}}
+	return n;
+}
+
+void EHttpResponseCache::clear() {
+	SYNCBLOCK(&lock_) {
+		entries_.clear();
+		head_ = tail_ = null;
+		bytes_ = 0;
+	}}
+}
+
+boolean EHttpResponseCache::serve(sp<EHttpRequest>& request, sp<EHttpResponse>& response) {
+	std::string key;
+	if (!keyOf(request.get(), key)) {
+		return false;
+	}
+
+	// the client asks for a fresh response.
+	const Http::HeaderEntry* requestCacheControl = request->getHeaderMap()->CacheControl();
+	if (hasDirective(requestCacheControl, "no-cache") || hasDirective(requestCacheControl, "no-store")) {
+		counters()->misses.incrementAndGet();
+		return false;
+	}
+
+	sp<Entry> entry;
+	llong now = ESystem::currentTimeMillis();
+	SYNCBLOCK(&lock_) {
+		auto it = entries_.find(key);
+		if (it != entries_.end()) {
+			Entry* e = it->second.get();
+			if (e->expires > now) {
+				entry = it->second;
+				// most recent first.
+				unlink(e);
+				e->next = head_;
+				if (head_) {
+					head_->prev = e;
+				} else {
+					tail_ = e;
+				}
+				head_ = e;
+			} else {
+				remove(e);
+			}
+		}
+	}}
+
+	if (entry == null) {
+		counters()->misses.incrementAndGet();
+		return false;
+	}
+
+	// the headers and body are shared, nothing is copied.
+	if (matches(request->getHeaderMap()->get(Http::Headers::get().IfNoneMatch), entry->etag)) {
+		response->sharedHeaders = entry->notModified;
+		counters()->notModified.incrementAndGet();
+		return true;
+	}
+
+	response->sharedHeaders = entry->headers;
+	if (entry->body != null) {
+		sp<EIoBuffer> view(new CachedBodyView(entry->body));
+		response->bodyData.buffer().add(view);
+	}
+	counters()->hits.incrementAndGet();
+	return true;
+}
+
+void EHttpResponseCache::store(sp<EHttpRequest>& request, sp<EHttpResponse>& response) {
+	if (response->isCommitted() || response->sharedHeaders != null) {
+		return;
+	}
+
+	Http::HeaderMapImpl& headers = response->headerMap;
+	const Http::HeaderEntry* status = headers.Status();
+	if (!status || !(status->value() == "200") || headers.get(Http::Headers::get().SetCookie)) {
+		return;
+	}
+	const Http::HeaderEntry* cacheControl = headers.CacheControl();
+	if (hasDirective(cacheControl, "no-store") || hasDirective(cacheControl, "no-cache")
+			|| hasDirective(cacheControl, "private")) {
+		return;
+	}
+
+	// a shared cache stores the reply of an authorized request only if it is marked so.
+	Http::HeaderMapPtr& requestHeaders = request->getHeaderMap();
+	if (hasDirective(requestHeaders->CacheControl(), "no-store")
+			|| (requestHeaders->Authorization() && !hasDirective(cacheControl, "public")
+					&& !hasDirective(cacheControl, "s-maxage"))) {
+		return;
+	}
+
+	// the variants must be told apart by the key.
+	if (!keyedOn(headers.Vary())) {
+		return;
+	}
+	int maxAge = maxAgeOf(cacheControl);
+	llong ttl = (maxAge >= 0) ? (llong)maxAge * 1000 : ttl_;
+	if (ttl <= 0) {
+		return;
+	}
+
+	std::string key;
+	if (!keyOf(request.get(), key)) {
+		return;
+	}
+
+	// the body in one read only buffer, the response still sends its own.
+	if (response->bodyTail != null && response->bodyTail->position() > 0) {
+		response->bodyData.add(response->bodyTail);
+	}
+	response->bodyTail = null;
+	llong length = response->bodyData.length();
+	if (length > maxBytes_ / 4) {
+		return;
+	}
+
+	sp<Entry> entry(new Entry());
+	if (length > 0) {
+		entry->body = EIoBuffer::allocate(length);
+		for (auto buf : response->bodyData.buffer()) {
+			entry->body->put(buf->current(), buf->remaining());
+		}
+		entry->body->flip();
+	}
+
+	entry->headers = new Http::HeaderMapImpl(static_cast<const Http::HeaderMap&>(headers));
+	if (headers.Etag()) {
+		entry->etag.assign(headers.Etag()->value().c_str(), headers.Etag()->value().size());
+	} else {
+		// FNV-1a of the body.
+		ullong hash = 14695981039346656037ULL;
+		const byte* p = entry->body != null ? (const byte*)entry->body->current() : null;
+		for (llong i = 0; i < length; i++) {
+			hash = (hash ^ p[i]) * 1099511628211ULL;
+		}
+		entry->etag = EString::formatOf("\"%016llx\"", hash).c_str();
+		entry->headers->insertEtag().value(entry->etag);
+		headers.insertEtag().value(entry->etag); // the reply of the miss has it too.
+	}
+	if (!headers.ContentLength()) {
+		entry->headers->insertContentLength().value((uint64_t)length);
+	}
+
+	entry->notModified = new Http::HeaderMapImpl{
+		{Http::Headers::get().Status, std::to_string((int)Http::Code::NotModified)},
+		{Http::Headers::get().Etag, entry->etag}};
+
+	entry->key = key;
+	entry->expires = ESystem::currentTimeMillis() + ttl;
+	entry->bytes = sizeof(Entry) + key.size() + length + entry->headers->byteSize()
+			+ entry->notModified->byteSize();
+	entry->prev = entry->next = null;
+
+	SYNCBLOCK(&lock_) {
+		auto it = entries_.find(key);
+		if (it != entries_.end()) {
+			remove(it->second.get());
+		}
+
+		Entry* e = entry.get();
+		entries_[key] = entry;
+		e->next = head_;
+		if (head_) {
+			head_->prev = e;
+		} else {
+			tail_ = e;
+		}
+		head_ = e;
+		bytes_ += e->bytes;
+
+		// evict the least recently used ones.
+		while (bytes_ > maxBytes_ && tail_ != e) {
+			remove(tail_);
+		}
+	}}
+}
+
+boolean EHttpResponseCache::keyOf(EHttpRequest* request, std::string& key) {
+	if (request->getMethod() != Http::Method::Get) {
+		return false;
+	}
+	Http::HeaderMapPtr& headers = request->getHeaderMap();
+	const Http::HeaderEntry* path = headers->Path();
+	if (!path) {
+		return false;
+	}
+
+	// the host first, a service may be bound to several.
+	const Http::HeaderEntry* host = headers->Host();
+	if (host) {
+		key.assign(host->value().c_str(), host->value().size());
+	}
+	key.push_back('\n');
+	key.append(path->value().c_str(), path->value().size());
+	for (auto& name : keyHeaders_) {
+		key.push_back('\n');
+		const Http::HeaderEntry* header = headers->get(name);
+		if (header) {
+			key.append(header->value().c_str(), header->value().size());
+		}
+	}
+	return true;
+}
+
+boolean EHttpResponseCache::keyedOn(const Http::HeaderEntry* vary) {
+	if (!vary) {
+		return true;
+	}
+
+	// each listed header, case insensitive, must be a key header.
+	const char* p = vary->value().c_str();
+	const char* end = p + vary->value().size();
+	while (p < end) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+			p++;
+		}
+		const char* q = p;
+		while (q < end && *q != ',' && *q != ' ' && *q != '\t') {
+			q++;
+		}
+		if (q > p) {
+			boolean keyed = false;
+			for (auto& name : keyHeaders_) {
+				if (name.get().size() == (size_t)(q - p) && strncasecmp(name.get().c_str(), p, q - p) == 0) {
+					keyed = true;
+					break;
+				}
+			}
+			if (!keyed) {
+				return false; // "*" too.
+			}
+		}
+		p = q;
+	}
+	return true;
+}
+
+EHttpResponseCache::ThreadCounters* EHttpResponseCache::counters() {
+	// a caller out of fiber schedule uses the first slot.
+	EFiber* fiber = EFiber::currentFiber();
+	return counters_[fiber ? fiber->getThreadIndex() % counters_.length() : 0];
+}
+
+void EHttpResponseCache::unlink(Entry* entry) {
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		head_ = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		tail_ = entry->prev;
+	}
+	entry->prev = entry->next = null;
+}
+
+void EHttpResponseCache::remove(Entry* entry) {
+	unlink(entry);
+	bytes_ -= entry->bytes;
+	entries_.erase(entries_.find(entry->key)); // frees the entry unless being replied.
+}
+
+const char* EHttpResponseCache::directiveOf(const Http::HeaderEntry* cacheControl, const char* directive) {
+	if (!cacheControl) {
+		return null;
+	}
+
+	// comma separated tokens, each "name" or "name=value", the value may be quoted.
+	size_t directiveLength = strlen(directive);
+	const char* p = cacheControl->value().c_str();
+	const char* end = p + cacheControl->value().size();
+	while (p < end) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+			p++;
+		}
+		const char* name = p;
+		while (p < end && *p != '=' && *p != ',' && *p != ' ' && *p != '\t') {
+			p++;
+		}
+		boolean found = ((size_t)(p - name) == directiveLength
+				&& strncasecmp(name, directive, directiveLength) == 0);
+		while (p < end && (*p == ' ' || *p == '\t')) {
+			p++;
+		}
+		const char* value = (p < end && *p == '=') ? p + 1 : p;
+		if (found) {
+			return value;
+		}
+
+		// skip the value.
+		boolean quoted = false;
+		while (p < end && (quoted || *p != ',')) {
+			if (*p == '"') {
+				quoted = !quoted;
+			}
+			p++;
+		}
+	}
+	return null;
+}
+
+boolean EHttpResponseCache::hasDirective(const Http::HeaderEntry* cacheControl, const char* directive) {
+	return directiveOf(cacheControl, directive) != null;
+}
+
+int EHttpResponseCache::maxAgeOf(const Http::HeaderEntry* cacheControl) {
+	const char* p = directiveOf(cacheControl, "max-age");
+	if (!p || p[-1] != '=') {
+		return -1;
+	}
+	if (*p < '0' || *p > '9') {
+		return -1;
+	}
+	int age = 0;
+	while (*p >= '0' && *p <= '9' && age < 100000000) {
+		age = age * 10 + (*p++ - '0');
+	}
+	return age;
+}
+
+boolean EHttpResponseCache::matches(const Http::HeaderEntry* ifNoneMatch, const std::string& etag) {
+	if (!ifNoneMatch) {
+		return false;
+	}
+
+	// weak comparison, W/ is ignored.
+	const char* tag = etag.c_str();
+	size_t tagLength = etag.size();
+	if (tagLength >= 2 && tag[0] == 'W' && tag[1] == '/') {
+		tag += 2;
+		tagLength -= 2;
+	}
+
+	const char* p = ifNoneMatch->value().c_str();
+	const char* end = p + ifNoneMatch->value().size();
+	while (p < end) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+			p++;
+		}
+		const char* q = p;
+		while (q < end && *q != ',') {
+			q++;
+		}
+		const char* e = q;
+		while (e > p && (e[-1] == ' ' || e[-1] == '\t')) {
+			e--;
+		}
+
+		if (e - p == 1 && *p == '*') {
+			return true;
+		}
+		if (e - p >= 2 && p[0] == 'W' && p[1] == '/') {
+			p += 2;
+		}
+		if ((size_t)(e - p) == tagLength && memcmp(p, tag, tagLength) == 0) {
+			return true;
+		}
+		p = q;
+	}
+	return false;
+}
+
+} /* namespace naf */
+} /* namespace efc */
@@ -0,0 +1,249 @@
+#include "../inc/EHttpRouter.hh"
+
+namespace efc {
+namespace naf {
+
+EHttpRouter::Node::Node(const std::string& prefix) :
+		prefix(prefix), param(null), wildcard(null), terminal(false) {
+	memset(routes, 0, sizeof(routes));
+}
+
+EHttpRouter::Node::~Node() {
+	for (Node* child : children) {
+		delete child;
+	}
+	delete param;
+	delete wildcard;
+	for (Route* route : routes) {
+		delete route;
+	}
+}
+
+EHttpRouter::~EHttpRouter() {
+	delete root_;
+}
+
+EHttpRouter::EHttpRouter(): root_(new Node("")), size_(0) {
+}
+
+void EHttpRouter::add(Http::Method method, const char* pattern, Handler handler) {
+	if (!pattern || pattern[0] != '/') {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal route pattern: %s", pattern ? pattern : "null").c_str());
+	}
+	if (!handler) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Handler can not be null");
+	}
+
+	std::vector<std::string> names;
+	Node* node = root_;
+	const char* p = pattern;
+	while (*p) {
+		if ((*p == ':' || *p == '*') && p[-1] == '/') {
+			// a parameter or wildcard segment.
+			const char* q = p + 1;
+			while (*q && *q != '/') {
+				q++;
+			}
+			if (q == p + 1 || (*p == '*' && *q)
+					|| (int)names.size() == EHttpRequest::MAX_PATH_PARAMETERS) {
+				throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal route pattern: %s", pattern).c_str());
+			}
+			names.push_back(std::string(p + 1, q - p - 1));
+
+			Node*& child = (*p == ':') ? node->param : node->wildcard;
+			if (!child) {
+				child = new Node("");
+			}
+			node = child;
+			p = q;
+			continue;
+		}
+
+		// a static run, up to the next parameter or wildcard segment.
+		const char* q = p + 1;
+		while (*q && !((*q == ':' || *q == '*') && q[-1] == '/')) {
+			q++;
+		}
+		std::string run(p, q - p);
+		p = q;
+
+		while (!run.empty()) {
+			size_t i = 0;
+			while (i < node->children.size() && node->children[i]->prefix[0] != run[0]) {
+				i++;
+			}
+			if (i == node->children.size()) {
+				Node* child = new Node(run);
+				node->children.push_back(child);
+				node = child;
+				break;
+			}
+
+			Node* child = node->children[i];
+			size_t common = 0;
+			while (common < run.size() && common < child->prefix.size()
+					&& run[common] == child->prefix[common]) {
+				common++;
+			}
+			if (common < child->prefix.size()) {
+				// split the child at the common prefix.
+				Node* parent = new Node(child->prefix.substr(0, common));
+				child->prefix.erase(0, common);
+				parent->children.push_back(child);
+				node->children[i] = parent;
+				child = parent;
+			}
+			node = child;
+			run.erase(0, common);
+		}
+	}
+
+	Route*& route = node->routes[static_cast<int>(method)];
+	if (route) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Route exists: %s", pattern).c_str());
+	}
+	route = new Route();
+	route->handler = handler;
+	route->names = names;
+	node->terminal = true;
+	size_++;
+}
+
+Http::Code EHttpRouter::route(sp<EHttpSession>& session, sp<EHttpRequest>& request, sp<EHttpResponse>& response) {
+	const Http::HeaderEntry* path = request->getHeaderMap()->Path();
+	if (!path) {
+		return Http::Code::NotFound;
+	}
+
+	Capture captures[EHttpRequest::MAX_PATH_PARAMETERS];
+	int count = 0;
+	boolean matched = false;
+	Node* node = lookup(request->getMethod(), path->value().c_str(), path->value().size(), captures, count, matched);
+	if (!node) {
+		return matched ? Http::Code::MethodNotAllowed : Http::Code::NotFound;
+	}
+	Route* route = node->routes[static_cast<int>(request->getMethod())];
+
+	capture(route, captures, count, request.get());
+	route->handler(session, request, response);
+	return Http::Code::OK;
+}
+
+const EHttpRouter::Handler* EHttpRouter::find(Http::Method method, const char* path, int length, EHttpRequest* request) {
+	Capture captures[EHttpRequest::MAX_PATH_PARAMETERS];
+	int count = 0;
+	boolean matched = false;
+	Node* node = lookup(method, path, length, captures, count, matched);
+	if (!node) {
+		return null;
+	}
+	Route* route = node->routes[static_cast<int>(method)];
+
+	if (request) {
+		capture(route, captures, count, request);
+	}
+	return &route->handler;
+}
+
+int EHttpRouter::size() {
+	return size_;
+}
+
+void EHttpRouter::clear() {
+	delete root_;
+	root_ = new Node("");
+	size_ = 0;
+}
+
+EHttpRouter::Node* EHttpRouter::lookup(Http::Method method, const char* path, int length, Capture* captures, int& count, boolean& matched) {
+	if (!path || length <= 0) {
+		return null;
+	}
+	const char* end = (const char*)memchr(path, '?', length);
+	return match(static_cast<int>(method), root_, path, end ? end : path + length, captures, count, matched);
+}
+
+EHttpRouter::Node* EHttpRouter::match(int method, Node* node, const char* path, const char* end, Capture* captures, int& count, boolean& matched) {
+	// the prefix of the node is matched, go on with its children.
+	if (path == end) {
+		Node* found = accept(method, node, matched);
+		if (found) {
+			return found;
+		}
+		if (node->wildcard && count < EHttpRequest::MAX_PATH_PARAMETERS) {
+			captures[count].value = path;
+			captures[count].length = 0;
+			found = accept(method, node->wildcard, matched);
+			if (found) {
+				count++;
+			}
+		}
+		return found;
+	}
+
+	// static first, at most one child starts with the char.
+	for (Node* child : node->children) {
+		if (child->prefix[0] == *path) {
+			size_t length = child->prefix.size();
+			if ((size_t)(end - path) >= length && memcmp(path, child->prefix.data(), length) == 0) {
+				Node* found = match(method, child, path + length, end, captures, count, matched);
+				if (found) {
+					return found;
+				}
+			}
+			break;
+		}
+	}
+
+	// a parameter takes the segment.
+	if (node->param && *path != '/' && count < EHttpRequest::MAX_PATH_PARAMETERS) {
+		const char* q = path;
+		while (q < end && *q != '/') {
+			q++;
+		}
+		captures[count].value = path;
+		captures[count++].length = q - path;
+		Node* found = match(method, node->param, q, end, captures, count, matched);
+		if (found) {
+			return found;
+		}
+		count--;
+	}
+
+	// a wildcard takes the rest.
+	if (node->wildcard && count < EHttpRequest::MAX_PATH_PARAMETERS) {
+		captures[count].value = path;
+		captures[count].length = end - path;
+		Node* found = accept(method, node->wildcard, matched);
+		if (found) {
+			count++;
+		}
+		return found;
+	}
+	return null;
+}
+
+EHttpRouter::Node* EHttpRouter::accept(int method, Node* node, boolean& matched) {
+	// the path ends at the node: backtrack unless it has a route of the method.
+	if (!node->terminal) {
+		return null;
+	}
+	if (!node->routes[method]) {
+		matched = true;
+		return null;
+	}
+	return node;
+}
+
+void EHttpRouter::capture(Route* route, Capture* captures, int count, EHttpRequest* request) {
+	for (int i = 0; i < count; i++) {
+		EHttpRequest::PathParameter& param = request->pathParameters[i];
+		param.name = route->names[i].c_str();
+		param.value = captures[i].value;
+		param.length = captures[i].length;
+	}
+	request->pathParameterCount = count;
+}
+
+} /* namespace naf */
+} /* namespace efc */
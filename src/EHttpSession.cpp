@@ -7,14 +7,21 @@
 
 #include "../inc/EHttpSession.hh"
 #include "../inc/EHttpAcceptor.hh"
+#include "../inc/EIoTrace.hh"
+#include "../inc/EIoBufferChain.hh"
+#include "../inc/ERateLimitFilter.hh"
 
 #include "../http/source/enum_to_int.h"
 
+#include <openssl/ssl.h>
+
 namespace efc {
 namespace naf {
 
 #define ARRLEN(x) (sizeof(x) / sizeof(x[0]))
 
+#define CORK_SIZE 16384 // max held bytes in inline mode.
+
 #define MAKE_NV(NAME, VALUE)                                                   \
   {                                                                            \
     (uint8_t *)NAME, (uint8_t *)VALUE, sizeof(NAME) - 1, sizeof(VALUE) - 1,    \
@@ -44,7 +51,10 @@ void ActiveStream::decodeHeaders(HeaderMapPtr&& headers, bool end_stream) {
 	if (headers->byteSize() > (60 * 1024)) {
 		HeaderMapImpl headers{
 			{Headers::get().Status, std::to_string(enumToInt(Code::RequestHeaderFieldsTooLarge))}};
-		response_encoder->encodeHeaders(headers, true);
+		if (end_stream) {
+			onRemoteComplete();
+		}
+		encodeHeaders(headers, true);
 		return;
 	}
 
@@ -55,31 +65,64 @@ void ActiveStream::decodeHeaders(HeaderMapPtr&& headers, bool end_stream) {
 	// don't support that currently.
 	if (!headers->Path() || headers->Path()->value().c_str()[0] != '/') {
 		HeaderMapImpl headers{{Headers::get().Status, std::to_string(enumToInt(Code::NotFound))}};
-		response_encoder->encodeHeaders(headers, true);
+		if (end_stream) {
+			onRemoteComplete();
+		}
+		encodeHeaders(headers, true);
 		return;
 	}
 
-	// Create a new http request.
-	request = new EHttpRequest(this, headers);
-	if (end_stream) {
-		session->getHttpAcceptor()->requestChannel.write(request);
+	// Per source request rate, the connection is kept.
+	if (!ERateLimitFilter::tryAcquire(session)) {
+		HeaderMapImpl headers{{Headers::get().Status, std::to_string(enumToInt(Code::TooManyRequests))}};
+		if (end_stream) {
+			onRemoteComplete();
+		}
+		encodeHeaders(headers, true);
+		return;
+	}
+
+	// Create a new http request, a streamed one is handled while its body arrives.
+	EHttpAcceptor* acceptor = session->getHttpAcceptor();
+	boolean streaming = !end_stream && acceptor->isRequestStreaming();
+	request = new EHttpRequest(this, headers, streaming);
+	if (end_stream || streaming) {
+		dispatch(end_stream);
 	}
 }
 
 void ActiveStream::decodeData(Buffer::Instance& data, bool end_stream) {
 //	printf("decodeData(), data.length=%llu\n", data.length());
 
-	ES_ASSERT(request != null && request->getHttpStream() == this);
+	if (request == null) {
+		// rejected in decodeHeaders, drop the body.
+		if (end_stream) {
+			onRemoteComplete();
+		}
+		return;
+	}
+	ES_ASSERT(request->getHttpStream() == this);
 
 	Http::Buffer::OwnedImpl& oi = dynamic_cast<Http::Buffer::OwnedImpl&>(data);
 	Http::Buffer::LinkedBuffer& lb = oi.buffer();
 
+	boolean pause = false;
 	for (auto buffer : lb) {
-		request->bodyData.add(buffer);
+		pause |= request->offerBody(buffer);
+	}
+	if (pause) {
+		readDisable(true);
 	}
 
 	if (end_stream) {
-		session->getHttpAcceptor()->requestChannel.write(request);
+		if (!request->isStreaming()) {
+			dispatch(true);
+		} else {
+			if (request->endBody(false)) {
+				readDisable(false);
+			}
+			onRemoteComplete();
+		}
 	}
 }
 
@@ -89,30 +132,230 @@ void ActiveStream::decodeTrailers(HeaderMapPtr&& trailers) {
 }
 
 void ActiveStream::encode100ContinueHeaders(const HeaderMap& headers) {
-	response_encoder->encode100ContinueHeaders(headers);
+	Http::StreamEncoder* encoder = this->encoder();
+	if (encoder) {
+		encoder->encode100ContinueHeaders(headers);
+	}
 }
 
 void ActiveStream::encodeHeaders(const HeaderMap& headers, bool end_stream) {
-	response_encoder->encodeHeaders(headers, end_stream);
+	Http::StreamEncoder* encoder = this->encoder();
+	if (encoder) {
+		encoder->encodeHeaders(headers, end_stream);
+	}
+	if (end_stream) {
+		onLocalComplete();
+	}
 }
 
 void ActiveStream::encodeData(Buffer::Instance& data, bool end_stream) {
-	response_encoder->encodeData(data, end_stream);
+	Http::StreamEncoder* encoder = this->encoder();
+	if (encoder) {
+		encoder->encodeData(data, end_stream);
+	}
+	if (end_stream) {
+		onLocalComplete();
+	}
 }
 
 void ActiveStream::encodeTrailers(const HeaderMap& trailers) {
-	response_encoder->encodeTrailers(trailers);
+	Http::StreamEncoder* encoder = this->encoder();
+	if (encoder) {
+		encoder->encodeTrailers(trailers);
+	}
+	onLocalComplete();
+}
+
+Http::Stream& ActiveStream::getStream() {
+	return response_encoder->getStream();
+}
+
+void ActiveStream::onResetStream(StreamResetReason reason) {
+	// called by the codec, which is going to free its stream. A streamed body ends, its reader
+	// gets null.
+	if (request != null) {
+		request->endBody(true);
+	}
+
+	boolean complete;
+	SYNCBLOCK(&lock) {
+		reset = true;
+		response_encoder = null;
+		complete = isComplete();
+	}}
+	wakeResponse();
+	if (complete) {
+		session->releaseStream(this);
+	}
+}
+
+void ActiveStream::onStreamDestroyed() {
+	// called by the codec before it frees its stream, the encoder is gone.
+	boolean complete;
+	SYNCBLOCK(&lock) {
+		response_encoder = null;
+		complete = isComplete();
+	}}
+	wakeResponse();
+	if (complete) {
+		session->releaseStream(this);
+	}
+}
+
+void ActiveStream::onBufferedDataSent() {
+	wakeResponse();
+}
+
+void ActiveStream::wakeResponse() {
+	sp<EHttpResponse> r;
+	SYNCBLOCK(&lock) {
+		r = response;
+	}}
+	if (r != null) {
+		r->flushSignal.signal();
+	}
+}
+
+void ActiveStream::abort() {
+	if (response != null && response->cancel()) {
+		// the headers may be out, only a reset tells the peer.
+		Http::StreamEncoder* encoder = this->encoder();
+		if (encoder) {
+			encoder->getStream().resetStream(StreamResetReason::LocalReset);
+		}
+		onLocalComplete();
+		return;
+	}
+
+	// nothing is encoded yet, the codec replies the error.
+	HeaderMapImpl headers{{Headers::get().Status, std::to_string(enumToInt(Code::InternalServerError))}};
+	encodeHeaders(headers, true);
+}
+
+Http::StreamEncoder* ActiveStream::encoder() {
+	Http::StreamEncoder* encoder;
+	SYNCBLOCK(&lock) {
+		encoder = response_encoder;
+	}}
+	return encoder;
+}
+
+void ActiveStream::resumeReading() {
+	if (isDetached()) {
+		// the codec is used by the write fiber of the session only.
+		session->responseChannel.write(new ResumeReadingHttpResponse(this));
+	} else {
+		readDisable(false);
+	}
+}
+
+void ActiveStream::readDisable(boolean disable) {
+	Http::StreamEncoder* encoder = this->encoder();
+	if (encoder) {
+		encoder->getStream().readDisable(disable);
+	}
+}
+
+boolean ActiveStream::isDetached() {
+	return session->getHttpAcceptor()->isRWIoDetached();
+}
+
+void ActiveStream::sendResponse() {
+	if (isDetached()) {
+		// the codec is used by the write fiber of the session only.
+		session->responseChannel.write(response);
+	} else {
+		response->send();
+	}
+}
+
+uint64_t ActiveStream::bufferedBytes() {
+	Http::StreamEncoder* encoder = this->encoder();
+	return encoder ? encoder->getStream().bufferedBytes() : 0;
+}
+
+void ActiveStream::dispatch(boolean complete) {
+	// the worker may complete and recycle this stream at once, do not touch it after.
+	sp<EHttpRequest> req = request;
+	EHttpAcceptor* acceptor = session->getHttpAcceptor();
+	if (complete) {
+		req->endBody(false); // buffered: the whole body is queued.
+	}
+	SYNCBLOCK(&lock) {
+		remoteComplete = complete;
+		dispatched = true;
+	}}
+	acceptor->dispatchRequest(req);
+}
+
+void ActiveStream::onRemoteComplete() {
+	boolean complete;
+	SYNCBLOCK(&lock) {
+		remoteComplete = true;
+		complete = isComplete();
+	}}
+	if (complete) {
+		session->releaseStream(this);
+	}
+}
+
+void ActiveStream::onLocalComplete() {
+	EIoTrace::record(EIoTrace::STREAM_END, session->getId(), id);
+
+	// replied before the streamed body is read: drop the rest of it.
+	boolean discard;
+	SYNCBLOCK(&lock) {
+		discard = !remoteComplete && !localComplete && request != null;
+	}}
+	if (discard && request->endBody(true)) {
+		readDisable(false);
+	}
+
+	boolean complete;
+	SYNCBLOCK(&lock) {
+		if (localComplete) {
+			return;
+		}
+		localComplete = true;
+		complete = isComplete();
+	}}
+	if (complete) {
+		session->releaseStream(this);
+	}
+}
+
+boolean ActiveStream::isComplete() {
+	// a reset stream is complete unless its worker may still encode into it. The codec lets go of
+	// the stream first, so that it fires no callbacks into a released one.
+	if (response_encoder != null) {
+		return false;
+	}
+	return (remoteComplete && localComplete) || (reset && (localComplete || !dispatched));
 }
 
 //=============================================================================
 
 EHttpSession::~EHttpSession() {
-	//
+	// the codec first, it references the streams.
+	codec_.reset();
+
+	while (streams_) {
+		ActiveStream* stream = streams_;
+		streams_ = stream->next;
+		delete stream;
+	}
+	ActiveStream* stream;
+	while ((stream = freeStreams_.poll()) != null) {
+		delete stream;
+	}
 }
 
 EHttpSession::EHttpSession(EIoService* service, sp<ESocket>& socket) :
-	ESocketSession(service, socket), isFirstRequest(true) {
+	ESocketSession(service, socket), streams_(null), streamIds_(0), isFirstRequest(true), corked(false) {
 	acceptor = dynamic_cast<EHttpAcceptor*>(service);
+	if (acceptor) {
+		hs1.max_pipeline_depth_ = acceptor->getMaxPipelineDepth();
+	}
 }
 
 EHttpAcceptor* EHttpSession::getHttpAcceptor() {
@@ -124,60 +367,224 @@ void EHttpSession::init() {
 }
 
 sp<EObject> EHttpSession::read() {
+	if (isFirstRequest && isSecured()) {
+		// tls: the protocol is negotiated by ALPN, no need to peek the data.
+		const char* protocol = getNegotiatedProtocol();
+		if (protocol) {
+			createCodec(strcmp(protocol, "h2") == 0);
+		}
+	}
+
 	sp<EIoBuffer> ioBuffer = dynamic_pointer_cast<EIoBuffer>(ESocketSession::read());
 	if (ioBuffer != null) {
 		if (isFirstRequest) {
+			// h2c or tls without ALPN: sniff the http2 connection preface.
 			int magic_len = strlen(NGHTTP2_CLIENT_MAGIC);
 			sp<EIoBuffer> buf;
 			if (firstRequestBuffer == null) {
 				if (ioBuffer->remaining() < magic_len) {
 					firstRequestBuffer = new EByteBuffer(32);
 					firstRequestBuffer->append(ioBuffer->current(), ioBuffer->remaining());
-					buf = EIoBuffer::wrap(firstRequestBuffer->data(), firstRequestBuffer->size());
+					buf = copyOf(firstRequestBuffer);
 				} else {
 					buf = ioBuffer;
 				}
 			} else {
 				firstRequestBuffer->append(ioBuffer->current(), ioBuffer->remaining());
-				buf = EIoBuffer::wrap(firstRequestBuffer->data(), firstRequestBuffer->size());
+				buf = copyOf(firstRequestBuffer);
 			}
 
-			if (buf->remaining() >= magic_len) {
-				sp<EHttpSession> session = dynamic_pointer_cast<EHttpSession>(shared_from_this());
-
-				if (memcmp(buf->current(), NGHTTP2_CLIENT_MAGIC, magic_len) != 0) {
-					codec_.reset(new Http::Http1::ServerConnectionImpl(session, *this, hs1));
-				} else {
-					codec_.reset(new Http::Http2::ServerConnectionImpl(session, *this, hs2));
-				}
-				codec_->dispatch(buf);
-				isFirstRequest = false;
+			// a short http/1 request differs from the preface before its end.
+			int n = ES_MIN((int)buf->remaining(), magic_len);
+			boolean http2 = (memcmp(buf->current(), NGHTTP2_CLIENT_MAGIC, n) == 0);
+			if (!http2 || n == magic_len) {
+				createCodec(http2);
+				dispatch(buf);
 				firstRequestBuffer = null;
 			}
 		} else {
-			codec_->dispatch(ioBuffer);
+			dispatch(ioBuffer);
 		}
 	}
 	return ioBuffer;
 }
 
 boolean EHttpSession::write(sp<EObject> message) {
+	if (corked) {
+		sp<EIoBuffer> buf = dynamic_pointer_cast<EIoBuffer>(message);
+		sp<EIoBufferChain> chain = dynamic_pointer_cast<EIoBufferChain>(message);
+		int n = (buf != null) ? buf->remaining() : ((chain != null) ? (int)chain->remaining() : -1);
+		if (n >= 0) {
+			if (corkBuffer->position() + n > CORK_SIZE) {
+				flushCork();
+			}
+			if (n <= CORK_SIZE) {
+				// copy it, the codec may reuse or not own the memory.
+				if (buf != null) {
+					corkBuffer->put(buf->current(), n);
+				} else {
+					for (int i = 0; i < chain->size(); i++) {
+						sp<EIoBuffer> part = chain->get(i);
+						corkBuffer->put(part->current(), part->remaining());
+					}
+				}
+				return true;
+			}
+		} else {
+			flushCork();
+		}
+	}
 	return ESocketSession::write(message);
 }
 
 void EHttpSession::close() {
 	responseChannel.write(new EndHttpResponse());
 	ESocketSession::close();
+	if (codec_) {
+		codec_->onConnectionClosed(); // a dispatch may wait for a response.
+	}
+
+	// the handlers waiting in flush() give up.
+	SYNCBLOCK(&streamsLock_) {
+		for (ActiveStream* stream = streams_; stream; stream = stream->next) {
+			stream->wakeResponse();
+		}
+	}}
 }
 
 Http::StreamDecoder& EHttpSession::newStream(Http::StreamEncoder& response_encoder) {
-	ActiveStream* stream = new ActiveStream(this, response_encoder);
-	streams_.add(stream);
+	ActiveStream* stream;
+	SYNCBLOCK(&streamsLock_) {
+		stream = freeStreams_.poll();
+		if (!stream) {
+			stream = new ActiveStream(this);
+		}
+		stream->id = ++streamIds_;
+		stream->next = streams_;
+		if (streams_) {
+			streams_->prev = stream;
+		}
+		streams_ = stream;
+	}}
+
+	stream->response_encoder = &response_encoder;
+	response_encoder.getStream().addCallbacks(*stream);
+	EIoTrace::record(EIoTrace::STREAM_START, getId(), stream->id);
 	return *stream;
 }
 
+void EHttpSession::releaseStream(ActiveStream* stream) {
+	if (stream->request != null) {
+		// the handler may keep the request.
+		SYNCBLOCK(&stream->request->bodyLock) {
+			stream->request->stream = null;
+		}}
+	}
+
+	stream->response_encoder = null;
+	stream->request = null;
+	stream->response = null;
+	stream->remoteComplete = false;
+	stream->localComplete = false;
+	stream->dispatched = false;
+	stream->reset = false;
+
+	SYNCBLOCK(&streamsLock_) {
+		if (stream->prev) {
+			stream->prev->next = stream->next;
+		} else {
+			streams_ = stream->next;
+		}
+		if (stream->next) {
+			stream->next->prev = stream->prev;
+		}
+		stream->prev = stream->next = null;
+
+		if (freeStreams_.size() < MAX_FREE_STREAMS) {
+			freeStreams_.add(stream);
+			stream = null;
+		}
+	}}
+	delete stream;
+}
+
 void EHttpSession::onGoAway() {
 	//
 }
+
+const char* EHttpSession::getNegotiatedProtocol() {
+	ESSLSocket* ss = dynamic_cast<ESSLSocket*>(getSocket().get());
+	if (!ss) {
+		return null;
+	}
+
+	const unsigned char* data = null;
+	unsigned int len = 0;
+	SSL_get0_alpn_selected(ss->getSSL(), &data, &len);
+	if (len == 2 && memcmp(data, "h2", 2) == 0) {
+		return "h2";
+	}
+	if (len == 8 && memcmp(data, "http/1.1", 8) == 0) {
+		return "http/1.1";
+	}
+	return null;
+}
+
+void EHttpSession::dispatch(sp<EIoBuffer>& buf) {
+	if (!acceptor || !acceptor->isInlineHandling()) {
+		codec_->dispatch(buf);
+		return;
+	}
+
+	// inline: the requests are handled in the dispatch, hold their
+	// responses and write them by one write.
+	cork();
+	try {
+		codec_->dispatch(buf);
+	} catch (...) {
+		corked = false;
+		corkBuffer->clear();
+		throw;
+	}
+	uncork();
+}
+
+void EHttpSession::cork() {
+	if (corkBuffer == null) {
+		corkBuffer = EIoBuffer::allocate(CORK_SIZE)->setAutoExpand(true);
+	}
+	corked = true;
+}
+
+void EHttpSession::uncork() {
+	corked = false;
+	flushCork();
+}
+
+void EHttpSession::flushCork() {
+	if (corkBuffer != null && corkBuffer->position() > 0) {
+		corkBuffer->flip();
+		ESocketSession::write(corkBuffer);
+		corkBuffer->clear();
+	}
+}
+
+sp<EIoBuffer> EHttpSession::copyOf(sp<EByteBuffer>& data) {
+	// a copy which owns its data, independent of the first request buffer.
+	sp<EIoBuffer> buf = EIoBuffer::allocate(data->size());
+	buf->put(data->data(), data->size());
+	buf->flip();
+	return buf;
+}
+
+void EHttpSession::createCodec(boolean http2) {
+	sp<EHttpSession> session = dynamic_pointer_cast<EHttpSession>(shared_from_this());
+	if (http2) {
+		codec_.reset(new Http::Http2::ServerConnectionImpl(session, *this, hs2));
+	} else {
+		codec_.reset(new Http::Http1::ServerConnectionImpl(session, *this, hs1));
+	}
+	isFirstRequest = false;
+}
 } /* namespace naf */
 } /* namespace efc */
@@ -0,0 +1,65 @@
+#include "../inc/EIoBufferChain.hh"
+
+namespace efc {
+namespace naf {
+
+EIoBufferChain::~EIoBufferChain() {
+	//
+}
+
+EIoBufferChain::EIoBufferChain() {
+}
+
+EIoBufferChain* EIoBufferChain::add(sp<EIoBuffer> buffer) {
+	if (buffer == null) {
+		throw ENullPointerException(__FILE__, __LINE__, "buffer");
+	}
+	buffers.add(buffer);
+	return this;
+}
+
+sp<EIoBuffer> EIoBufferChain::get(int index) {
+	return buffers.getAt(index);
+}
+
+int EIoBufferChain::size() {
+	return buffers.size();
+}
+
+llong EIoBufferChain::remaining() {
+	llong n = 0;
+	for (int i = 0; i < buffers.size(); i++) {
+		n += buffers.getAt(i)->remaining();
+	}
+	return n;
+}
+
+boolean EIoBufferChain::hasRemaining() {
+	for (int i = 0; i < buffers.size(); i++) {
+		if (buffers.getAt(i)->hasRemaining()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void EIoBufferChain::clear() {
+	buffers.clear();
+}
+
+sp<EIoBuffer> EIoBufferChain::flatten() {
+	sp<EIoBuffer> out = EIoBuffer::allocate((int)remaining());
+	for (int i = 0; i < buffers.size(); i++) {
+		sp<EIoBuffer> buf = buffers.getAt(i);
+		out->put(buf->current(), buf->remaining());
+	}
+	out->flip();
+	return out;
+}
+
+EString EIoBufferChain::toString() {
+	return EString::formatOf("EIoBufferChain[buffers=%d, remaining=%lld]", buffers.size(), remaining());
+}
+
+} /* namespace naf */
+} /* namespace efc */
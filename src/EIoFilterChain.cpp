@@ -8,6 +8,8 @@
 #include "../inc/EIoFilterChain.hh"
 #include "../inc/EIoFilterAdapter.hh"
 #include "../inc/EIoBuffer.hh"
+#include "../inc/EIoBufferChain.hh"
+#include "../inc/EIoTrace.hh"
 
 namespace efc {
 namespace naf {
@@ -33,6 +35,7 @@ public:
 		this->name = name;
 		this->filter = filter;
 		this->owner = difc;
+		this->traceName_ = -1;
 
 		class _NextFilter: public EIoFilter::NextFilter {
 		private:
@@ -94,6 +97,16 @@ public:
 		return nextFilter;
 	}
 
+	/**
+	 * @return the interned trace name of the filter.
+	 */
+	short getTraceName() {
+		if (traceName_ < 0) {
+			traceName_ = EIoTrace::intern(getName());
+		}
+		return traceName_;
+	}
+
 	/**
 	 * Adds the specified filter with the specified name just before this entry.
 	 *
@@ -161,6 +174,7 @@ public:
 	EIoFilter* filter;
 	EIoFilter::NextFilter* nextFilter;
 	EIoFilterChain* owner;
+	short traceName_;
 };
 
 EIoFilterChain::~EIoFilterChain() {
@@ -380,6 +394,7 @@ EIoFilterChain::EntryImpl* EIoFilterChain::checkOldName(const char* baseName) {
 }
 
 boolean EIoFilterChain::fireSessionCreated() {
+	EIoTrace::record(EIoTrace::SESSION_CREATED, session->getId());
 	return callNextSessionCreated(head, session);
 }
 
@@ -391,6 +406,7 @@ boolean EIoFilterChain::callNextSessionCreated(EIoFilterChain::Entry* entry, EIo
 }
 
 void EIoFilterChain::fireSessionClosed() {
+	EIoTrace::record(EIoTrace::SESSION_CLOSED, session->getId());
 	callNextSessionClosed(head, session);
 }
 
@@ -420,6 +436,14 @@ sp<EObject> EIoFilterChain::callNextMessageReceived(Entry* entry, EIoSession* se
 	if (!entry) return message;
 	EIoFilter* filter = entry->getFilter();
 	EIoFilter::NextFilter* nextFilter = entry->getNextFilter();
+	if (EIoTrace::isEnabled() && entry != head && entry != tail) {
+		short name = static_cast<EntryImpl*>(entry)->getTraceName();
+		EIoTrace::record(EIoTrace::FILTER_ENTER, session->getId(), 0, 0, name);
+		ON_SCOPE_EXIT(
+			EIoTrace::record(EIoTrace::FILTER_EXIT, session->getId(), 0, 0, name);
+		);
+		return filter->messageReceived(nextFilter, session, message);
+	}
 	return filter->messageReceived(nextFilter, session, message);
 }
 
@@ -432,8 +456,12 @@ sp<EObject> EIoFilterChain::fireMessageSend(sp<EObject> message) {
 		if (currTime == 0) currTime = ESystem::currentTimeMillis();
 		session->increaseWrittenBytes(buf->remaining(), currTime);
 	} else {
-		EFile* file = dynamic_cast<EFile*>(o.get());
-		if (file) {
+		EIoBufferChain* chain = dynamic_cast<EIoBufferChain*>(o.get());
+		EFile* file = chain ? null : dynamic_cast<EFile*>(o.get());
+		if (chain) {
+			if (currTime == 0) currTime = ESystem::currentTimeMillis();
+			session->increaseWrittenBytes(chain->remaining(), currTime);
+		} else if (file) {
 			if (currTime == 0) currTime = ESystem::currentTimeMillis();
 			session->increaseWrittenBytes(file->length(), currTime);
 		} else {
@@ -452,6 +480,14 @@ sp<EObject> EIoFilterChain::callNextMessageSend(Entry* entry, EIoSession* sessio
 	if (!entry) return message;
 	EIoFilter* filter = entry->getFilter();
 	EIoFilter::NextFilter* nextFilter = entry->getNextFilter();
+	if (EIoTrace::isEnabled() && entry != head && entry != tail) {
+		short name = static_cast<EntryImpl*>(entry)->getTraceName();
+		EIoTrace::record(EIoTrace::FILTER_ENTER, session->getId(), 0, 0, name);
+		ON_SCOPE_EXIT(
+			EIoTrace::record(EIoTrace::FILTER_EXIT, session->getId(), 0, 0, name);
+		);
+		return filter->messageSend(nextFilter, session, message);
+	}
 	return filter->messageSend(nextFilter, session, message);
 }
 
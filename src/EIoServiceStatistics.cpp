@@ -110,6 +110,79 @@ void EIoServiceStatistics::setThroughputCalculationInterval(
 	this->throughputCalculationInterval.set(throughputCalculationInterval);
 }
 
+llong EIoServiceStatistics::getBlockedFiberCount() {
+	return blockedFiberCount.get();
+}
+
+#define SUM_THREADS(field) sumThreads(&ThreadThroughput::field)
+
+llong EIoServiceStatistics::sumThreads(EAtomicLLong ThreadThroughput::* field) {
+	llong sum = 0;
+	for (int i=0; i<workThreads; i++) {
+		sum += (threadThroughput[i]->*field).get();
+	}
+	return sum;
+}
+
+llong EIoServiceStatistics::getCompressionInputBytes() {
+	return SUM_THREADS(compressionInputBytes);
+}
+
+llong EIoServiceStatistics::getCompressionOutputBytes() {
+	return SUM_THREADS(compressionOutputBytes);
+}
+
+double EIoServiceStatistics::getCompressionRatio() {
+	llong in = getCompressionInputBytes();
+	return (in > 0) ? (double)getCompressionOutputBytes() / in : 1.0;
+}
+
+llong EIoServiceStatistics::getCompressionTime() {
+	return SUM_THREADS(compressionNanos) / 1000000;
+}
+
+llong EIoServiceStatistics::getDecompressionInputBytes() {
+	return SUM_THREADS(decompressionInputBytes);
+}
+
+llong EIoServiceStatistics::getDecompressionOutputBytes() {
+	return SUM_THREADS(decompressionOutputBytes);
+}
+
+llong EIoServiceStatistics::getDecompressionTime() {
+	return SUM_THREADS(decompressionNanos) / 1000000;
+}
+
+llong EIoServiceStatistics::getHandshakeCount() {
+	return handshakeCount.get();
+}
+
+llong EIoServiceStatistics::getResumedHandshakeCount() {
+	return resumedHandshakeCount.get();
+}
+
+double EIoServiceStatistics::getHandshakeResumptionRate() {
+	llong count = handshakeCount.get();
+	return (count > 0) ? (double)resumedHandshakeCount.get() / count : 0.0;
+}
+
+llong EIoServiceStatistics::getFailedHandshakeCount() {
+	return failedHandshakeCount.get();
+}
+
+double EIoServiceStatistics::getAverageHandshakeTime() {
+	llong count = handshakeCount.get();
+	return (count > 0) ? handshakeNanos.get() / 1000000.0 / count : 0.0;
+}
+
+llong EIoServiceStatistics::getKernelTLSCount() {
+	return kernelTLSCount.get();
+}
+
+llong EIoServiceStatistics::getKernelTLSFallbackCount() {
+	return kernelTLSFallbackCount.get();
+}
+
 void EIoServiceStatistics::updateThroughput(llong currentTime) {
 	// readBytes, writtenBytes, readMessages, writtenMessages, lastReadTime, lastWriteTime
 	llong readBytes, writtenBytes, readMessages, writtenMessages;
@@ -223,6 +296,23 @@ void EIoServiceStatistics::increaseWrittenMessages(llong currentTime) {
 	tt->writtenMessages.addAndGet(1);
 	tt->lastWriteTime.set(currentTime);
 }
+
+void EIoServiceStatistics::increaseCompression(llong inBytes, llong outBytes, llong nanos) {
+	// counters are atomic, a caller out of fiber schedule uses the first slot.
+	EFiber* fiber = EFiber::currentFiber();
+	ThreadThroughput* tt = threadThroughput[fiber ? fiber->getThreadIndex() : 0];
+	tt->compressionInputBytes.addAndGet(inBytes);
+	tt->compressionOutputBytes.addAndGet(outBytes);
+	tt->compressionNanos.addAndGet(nanos);
+}
+
+void EIoServiceStatistics::increaseDecompression(llong inBytes, llong outBytes, llong nanos) {
+	EFiber* fiber = EFiber::currentFiber();
+	ThreadThroughput* tt = threadThroughput[fiber ? fiber->getThreadIndex() : 0];
+	tt->decompressionInputBytes.addAndGet(inBytes);
+	tt->decompressionOutputBytes.addAndGet(outBytes);
+	tt->decompressionNanos.addAndGet(nanos);
+}
 //
 //void EIoServiceStatistics::setLastReadTime(llong lastReadTime) {
 //	SYNCBLOCK(&throughputCalculationLock) {
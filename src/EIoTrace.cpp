@@ -0,0 +1,191 @@
+#include "../inc/EIoTrace.hh"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+namespace efc {
+namespace naf {
+
+struct TraceRing {
+	llong threadId;
+	uint capacity;
+	uint mask;
+	volatile ullong head;
+	EIoTrace::Event* events;
+	TraceRing* next;
+};
+
+volatile boolean EIoTrace::enabled = false;
+
+static volatile int ringCapacity = 0;
+static TraceRing* volatile ringList = NULL;
+static thread_local TraceRing* localRing = NULL;
+
+static ESpinLock nameLock;
+static char names[EIoTrace::MAX_NAMES][EIoTrace::MAX_NAME_LENGTH];
+static volatile int nameCount = 1; // id 0 is reserved for no name.
+
+static char dumpPath[1024];
+
+static TraceRing* attachRing() {
+	TraceRing* ring = new TraceRing();
+	ring->threadId = EThread::currentThread()->getId();
+	ring->capacity = ringCapacity;
+	ring->mask = ring->capacity - 1;
+	ring->head = 0;
+	ring->events = (EIoTrace::Event*)eso_calloc(sizeof(EIoTrace::Event) * ring->capacity);
+
+	// lock-free push, rings live until process exit for safe dumping.
+	TraceRing* first;
+	do {
+		first = ringList;
+		ring->next = first;
+	} while (!__sync_bool_compare_and_swap(&ringList, first, ring));
+
+	return ring;
+}
+
+static boolean writeFully(int fd, const void* data, size_t size) {
+	const char* p = (const char*)data;
+	while (size > 0) {
+		ssize_t n = ::write(fd, p, size);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+static void onDumpSignal(int signo) {
+	EIoTrace::dump(dumpPath);
+}
+
+void EIoTrace::enable(int capacity) {
+	if (capacity <= 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal capacity: %d", capacity).c_str());
+	}
+	int n = 1;
+	while (n < capacity) n <<= 1;
+	if (!__sync_bool_compare_and_swap(&ringCapacity, 0, n) && ringCapacity != n) {
+		throw EIllegalStateException(__FILE__, __LINE__, EString::formatOf("Trace capacity is %d already, not %d", ringCapacity, n).c_str());
+	}
+	enabled = true;
+}
+
+void EIoTrace::disable() {
+	enabled = false;
+}
+
+short EIoTrace::intern(const char* name) {
+	if (!name) {
+		return 0;
+	}
+	SYNCBLOCK(&nameLock) {
+		for (int i = 1; i < nameCount; i++) {
+			if (strncmp(names[i], name, MAX_NAME_LENGTH - 1) == 0) {
+				return (short)i;
+			}
+		}
+		if (nameCount >= MAX_NAMES) {
+			return 0;
+		}
+		strncpy(names[nameCount], name, MAX_NAME_LENGTH - 1);
+		return (short)(nameCount++);
+    }}
+}
+
+llong EIoTrace::now() {
+	return ESystem::nanoTime();
+}
+
+void EIoTrace::record0(Type type, long session, llong arg, llong duration, short name) {
+	TraceRing* ring = localRing;
+	if (!ring) {
+		ring = localRing = attachRing();
+	}
+
+	ullong head = ring->head;
+	Event& e = ring->events[head & ring->mask];
+	e.time = ESystem::nanoTime();
+	e.duration = duration;
+	e.arg = arg;
+	e.session = (int)session;
+	e.type = (short)type;
+	e.name = name;
+
+	// publish the event before moving the head for concurrent dumping.
+	__sync_synchronize();
+	ring->head = head + 1;
+}
+
+boolean EIoTrace::dump(const char* path) {
+	if (!path) {
+		throw ENullPointerException(__FILE__, __LINE__, "path");
+	}
+	int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	boolean r = dump(fd);
+	::close(fd);
+	return r;
+}
+
+/**
+ * Async-signal-safe: plain memory reads and write(2) only.
+ */
+boolean EIoTrace::dump(int fd) {
+	uint version = VERSION;
+	uint count = nameCount;
+	if (!writeFully(fd, "NAFTRACE", 8)
+			|| !writeFully(fd, &version, sizeof(version))
+			|| !writeFully(fd, &count, sizeof(count))) {
+		return false;
+	}
+	for (uint i = 0; i < count; i++) {
+		unsigned short len = (unsigned short)strlen(names[i]);
+		if (!writeFully(fd, &len, sizeof(len)) || !writeFully(fd, names[i], len)) {
+			return false;
+		}
+	}
+
+	uint rings = 0;
+	for (TraceRing* r = ringList; r; r = r->next) {
+		rings++;
+	}
+	if (!writeFully(fd, &rings, sizeof(rings))) {
+		return false;
+	}
+	TraceRing* r = ringList;
+	for (uint i = 0; i < rings && r; i++, r = r->next) {
+		ullong head = r->head;
+		if (!writeFully(fd, &r->threadId, sizeof(r->threadId))
+				|| !writeFully(fd, &r->capacity, sizeof(r->capacity))
+				|| !writeFully(fd, &head, sizeof(head))
+				|| !writeFully(fd, r->events, sizeof(Event) * r->capacity)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void EIoTrace::installSignal(int signo, const char* path) {
+	if (!path) {
+		throw ENullPointerException(__FILE__, __LINE__, "path");
+	}
+	strncpy(dumpPath, path, sizeof(dumpPath) - 1);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onDumpSignal;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(signo, &sa, NULL);
+}
+
+} /* namespace naf */
+} /* namespace efc */
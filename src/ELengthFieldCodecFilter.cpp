@@ -0,0 +1,228 @@
+#include "../inc/ELengthFieldCodecFilter.hh"
+#include "../inc/EIoBufferChain.hh"
+
+namespace efc {
+namespace naf {
+
+#define MAX_VARINT_LENGTH 10
+
+static const char* SESSION_FRAME_CONTEXT = "session_frame_context";
+
+/**
+ * The decoding state of a session.
+ */
+class ELengthFieldCodecFilter::Context: public EObject {
+public:
+	sp<EIoBuffer> input; // the last received buffer, positioned at the next byte.
+	byte head[MAX_VARINT_LENGTH]; // a length field split by reads.
+	int headLength;
+	sp<EIoBuffer> frame; // a frame split by reads.
+	int needed;
+
+	Context() : headLength(0), needed(0) {
+	}
+};
+
+ELengthFieldCodecFilter::~ELengthFieldCodecFilter() {
+	//
+}
+
+ELengthFieldCodecFilter::ELengthFieldCodecFilter(int lengthFieldLength, boolean bigEndian, int maxFrameSize) :
+		lengthFieldLength(lengthFieldLength),
+		bigEndian(bigEndian),
+		maxFrameSize(maxFrameSize),
+		lengthAdjustment(0),
+		keepLengthField(false) {
+	if (lengthFieldLength != VARINT && lengthFieldLength != 1 && lengthFieldLength != 2
+			&& lengthFieldLength != 4 && lengthFieldLength != 8) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal length field length: %d", lengthFieldLength).c_str());
+	}
+	if (maxFrameSize <= 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal max frame size: %d", maxFrameSize).c_str());
+	}
+}
+
+ELengthFieldCodecFilter* ELengthFieldCodecFilter::setLengthAdjustment(int adjustment) {
+	lengthAdjustment = adjustment;
+	return this;
+}
+
+ELengthFieldCodecFilter* ELengthFieldCodecFilter::setKeepLengthField(boolean keep) {
+	keepLengthField = keep;
+	return this;
+}
+
+void ELengthFieldCodecFilter::sessionClosed(EIoFilter::NextFilter* nextFilter, EIoSession* session) {
+	session->attributes.remove((llong)SESSION_FRAME_CONTEXT);
+	nextFilter->sessionClosed(session);
+}
+
+sp<EObject> ELengthFieldCodecFilter::messageReceived(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) {
+	Context* ctx = contextOf(session);
+
+	if (message != null) {
+		sp<EIoBuffer> in = dynamic_pointer_cast<EIoBuffer>(message);
+		if (in == null) {
+			return nextFilter->messageReceived(session, message);
+		}
+		ctx->input = in;
+	}
+
+	// null: read more.
+	return nextFilter->messageReceived(session, decode(ctx));
+}
+
+sp<EObject> ELengthFieldCodecFilter::messageSend(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) {
+	sp<EIoBuffer> payload = dynamic_pointer_cast<EIoBuffer>(message);
+	if (payload != null) {
+		int size = payload->remaining();
+		if (size > maxFrameSize) {
+			throw EIOException(__FILE__, __LINE__, EString::formatOf("Frame size %d exceeds %d", size, maxFrameSize).c_str());
+		}
+
+		byte field[MAX_VARINT_LENGTH];
+		int n = encodeLength((llong)size - lengthAdjustment, field);
+		sp<EIoBuffer> head = EIoBuffer::allocate(n);
+		head->put(field, n);
+		head->flip();
+
+		sp<EIoBufferChain> chain(new EIoBufferChain());
+		chain->add(head)->add(payload);
+		message = chain;
+	}
+	return nextFilter->messageSend(session, message);
+}
+
+EString ELengthFieldCodecFilter::toString() {
+	return "ELengthFieldCodecFilter";
+}
+
+ELengthFieldCodecFilter::Context* ELengthFieldCodecFilter::contextOf(EIoSession* session) {
+	sp<Context> ctx = dynamic_pointer_cast<Context>(session->attributes.get((llong)SESSION_FRAME_CONTEXT));
+	if (ctx == null) {
+		ctx = new Context();
+		session->attributes.put((llong)SESSION_FRAME_CONTEXT, ctx);
+	}
+	return ctx.get();
+}
+
+sp<EIoBuffer> ELengthFieldCodecFilter::decode(Context* ctx) {
+	EIoBuffer* in = ctx->input.get();
+	if (in == null || !in->hasRemaining()) {
+		ctx->input = null;
+		return null;
+	}
+
+	int fieldLength, payloadLength;
+
+	if (ctx->frame == null) {
+		if (ctx->headLength == 0
+				&& decodeLength((byte*)in->current(), in->remaining(), &fieldLength, &payloadLength)
+				&& in->remaining() >= fieldLength + payloadLength) {
+			// the whole frame in the buffer: slice it.
+			if (!keepLengthField) {
+				in->skip(fieldLength);
+				return in->getSlice(payloadLength);
+			}
+			return in->getSlice(fieldLength + payloadLength);
+		}
+
+		// collect the length field.
+		while (true) {
+			if (!in->hasRemaining()) {
+				return null;
+			}
+			ctx->head[ctx->headLength++] = in->get();
+			if (decodeLength(ctx->head, ctx->headLength, &fieldLength, &payloadLength)) {
+				break;
+			}
+		}
+
+		ctx->frame = EIoBuffer::allocate(keepLengthField ? fieldLength + payloadLength : payloadLength);
+		if (keepLengthField) {
+			ctx->frame->put(ctx->head, fieldLength);
+		}
+		ctx->needed = payloadLength;
+		ctx->headLength = 0;
+	}
+
+	// assemble the frame across reads.
+	int n = ES_MIN(ctx->needed, in->remaining());
+	ctx->frame->put(in->current(), n);
+	in->skip(n);
+	ctx->needed -= n;
+	if (ctx->needed > 0) {
+		return null;
+	}
+
+	sp<EIoBuffer> out = ctx->frame;
+	ctx->frame = null;
+	out->flip();
+	return out;
+}
+
+boolean ELengthFieldCodecFilter::decodeLength(const byte* data, int size, int* fieldLength, int* payloadLength) {
+	ullong value = 0;
+
+	if (lengthFieldLength == VARINT) {
+		int i = 0;
+		for (; i < size && i < MAX_VARINT_LENGTH; i++) {
+			value |= (ullong)(data[i] & 0x7F) << (7 * i);
+			if ((data[i] & 0x80) == 0) {
+				break;
+			}
+		}
+		if (i == MAX_VARINT_LENGTH) {
+			throw EIOException(__FILE__, __LINE__, "Malformed varint length field");
+		}
+		if (i == size) {
+			return false; // more bytes.
+		}
+		*fieldLength = i + 1;
+	} else {
+		if (size < lengthFieldLength) {
+			return false;
+		}
+		for (int i = 0; i < lengthFieldLength; i++) {
+			int b = bigEndian ? data[i] : data[lengthFieldLength - 1 - i];
+			value = (value << 8) | (b & 0xFF);
+		}
+		*fieldLength = lengthFieldLength;
+	}
+
+	llong length = (llong)value + lengthAdjustment;
+	if ((llong)value < 0 || length < 0 || length > maxFrameSize) {
+		throw EIOException(__FILE__, __LINE__, EString::formatOf("Frame length %llu exceeds %d", value, maxFrameSize).c_str());
+	}
+	*payloadLength = (int)length;
+	return true;
+}
+
+int ELengthFieldCodecFilter::encodeLength(llong value, byte* out) {
+	if (value < 0) {
+		throw EIOException(__FILE__, __LINE__, EString::formatOf("Negative length field: %lld", value).c_str());
+	}
+
+	if (lengthFieldLength == VARINT) {
+		ullong v = (ullong)value;
+		int n = 0;
+		while (v >= 0x80) {
+			out[n++] = (byte)((v & 0x7F) | 0x80);
+			v >>= 7;
+		}
+		out[n++] = (byte)v;
+		return n;
+	}
+
+	if (lengthFieldLength < 8 && value >= (1LL << (lengthFieldLength * 8))) {
+		throw EIOException(__FILE__, __LINE__, EString::formatOf("Length %lld does not fit in %d bytes", value, lengthFieldLength).c_str());
+	}
+	for (int i = 0; i < lengthFieldLength; i++) {
+		byte b = (byte)(value >> (8 * (lengthFieldLength - 1 - i)));
+		out[bigEndian ? i : lengthFieldLength - 1 - i] = b;
+	}
+	return lengthFieldLength;
+}
+
+} /* namespace naf */
+} /* namespace efc */
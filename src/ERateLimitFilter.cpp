@@ -0,0 +1,259 @@
+#include "../inc/ERateLimitFilter.hh"
+#include "../inc/ESocketSession.hh"
+#include "../inc/EHttpSession.hh"
+
+namespace efc {
+namespace naf {
+
+#define SWEEP_INTERVAL_NANOS 1000000000LL
+
+static const char* SESSION_RATE_LIMIT_TICKET = "session_rate_limit_ticket";
+
+sp<ELogger> ERateLimitFilter::LOGGER = ELoggerManager::getLogger("ERateLimitFilter");
+
+/**
+ * Attached to an accepted session, releases the connection slot of its
+ * source when the session closed.
+ */
+class ERateLimitFilter::Ticket: public EObject {
+public:
+	ERateLimitFilter* filter;
+	Shard* shard;
+	Source* source;
+	boolean perMessage;
+
+	Ticket(ERateLimitFilter* filter, Shard* shard, Source* source, boolean perMessage) :
+		filter(filter), shard(shard), source(source), perMessage(perMessage) {
+	}
+};
+
+ERateLimitFilter::Shard::~Shard() {
+	sp<EIterator<Source*> > iter = sources.values()->iterator();
+	while (iter->hasNext()) {
+		delete iter->next();
+	}
+}
+
+ERateLimitFilter::~ERateLimitFilter() {
+	//
+}
+
+ERateLimitFilter::ERateLimitFilter(int maxConnections, int requestsPerSecond, int burst, int shards) :
+		maxConnections(maxConnections),
+		requestsPerSecond(requestsPerSecond),
+		burst(burst > 0 ? burst : requestsPerSecond),
+		subnetMask(32),
+		shards(shards > 0 ? shards : EOS::active_processor_count()) {
+	if (maxConnections < 0 || requestsPerSecond < 0 || burst < 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Limits can not be negative");
+	}
+	for (int i = 0; i < this->shards.length(); i++) {
+		this->shards[i] = new Shard();
+	}
+}
+
+ERateLimitFilter* ERateLimitFilter::setSubnetMask(int bits) {
+	if (bits < 0 || bits > 32) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Mask has to be an integer between 0 and 32");
+	}
+	subnetMask = bits;
+	return this;
+}
+
+llong ERateLimitFilter::getConnectionCount() {
+	llong count = 0;
+	for (int i = 0; i < shards.length(); i++) {
+		count += shards[i]->connections.get();
+	}
+	return count;
+}
+
+int ERateLimitFilter::getConnectionCount(EInetAddress* address) {
+	if (address == null) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Address can not be null");
+	}
+
+	int key = keyOf(address);
+	Shard* shard = shardOf(key);
+	SYNCBLOCK(&shard->lock) {
+		Source* source = shard->sources.get(key);
+		return source ? source->connections : 0;
+    }}
+	return 0;
+}
+
+int ERateLimitFilter::getSourceCount() {
+	int count = 0;
+	for (int i = 0; i < shards.length(); i++) {
+		SYNCBLOCK(&shards[i]->lock) {
+			count += shards[i]->sources.size();
+        }}
+	}
+	return count;
+}
+
+llong ERateLimitFilter::getRejectedConnections() {
+	llong count = 0;
+	for (int i = 0; i < shards.length(); i++) {
+		count += shards[i]->rejectedConnections.get();
+	}
+	return count;
+}
+
+llong ERateLimitFilter::getRejectedRequests() {
+	llong count = 0;
+	for (int i = 0; i < shards.length(); i++) {
+		count += shards[i]->rejectedRequests.get();
+	}
+	return count;
+}
+
+llong ERateLimitFilter::getLockContentions() {
+	llong count = 0;
+	for (int i = 0; i < shards.length(); i++) {
+		count += shards[i]->lock.contentions.get();
+	}
+	return count;
+}
+
+boolean ERateLimitFilter::tryAcquire(EIoSession* session) {
+	sp<Ticket> ticket = dynamic_pointer_cast<Ticket>(session->attributes.get((llong)SESSION_RATE_LIMIT_TICKET));
+	if (ticket == null) {
+		return true;
+	}
+
+	boolean acquired;
+	SYNCBLOCK(&ticket->shard->lock) {
+		acquired = ticket->filter->acquire(ticket->shard, ticket->source, ESystem::nanoTime());
+    }}
+	if (!acquired) {
+		ticket->shard->rejectedRequests.incrementAndGet();
+	}
+	return acquired;
+}
+
+boolean ERateLimitFilter::sessionCreated(EIoFilter::NextFilter* nextFilter, EIoSession* session) {
+	int key = keyOf(session);
+	Shard* shard = shardOf(key);
+	llong now = ESystem::nanoTime();
+	Source* source;
+	boolean rejected = false;
+
+	SYNCBLOCK(&shard->lock) {
+		source = shard->sources.get(key);
+		if (!source) {
+			if (now - shard->lastSweep > SWEEP_INTERVAL_NANOS) {
+				sweep(shard, now);
+			}
+			source = new Source();
+			source->connections = 0;
+			source->tokens = burst;
+			source->refillTime = now;
+			shard->sources.put(key, source);
+		}
+		if (maxConnections > 0 && source->connections >= maxConnections) {
+			rejected = true;
+		} else {
+			source->connections++;
+		}
+    }}
+
+	if (rejected) {
+		shard->rejectedConnections.incrementAndGet();
+		LOGGER->debug__(__FILE__, __LINE__, "Remote address: %s over the connection limit; closing.",
+				session->getRemoteAddress()->toString().c_str());
+		return false;
+	}
+
+	shard->connections.incrementAndGet();
+
+	// http counts streams in the codec, others count messages here.
+	boolean perMessage = (dynamic_cast<EHttpSession*>(session) == null);
+	sp<Ticket> ticket(new Ticket(this, shard, source, perMessage));
+	session->attributes.put((llong)SESSION_RATE_LIMIT_TICKET, ticket);
+
+	return nextFilter->sessionCreated(session);
+}
+
+void ERateLimitFilter::sessionClosed(EIoFilter::NextFilter* nextFilter, EIoSession* session) {
+	// the session may be rejected by a previous filter, only release the admitted.
+	sp<Ticket> ticket = dynamic_pointer_cast<Ticket>(session->attributes.remove((llong)SESSION_RATE_LIMIT_TICKET));
+	if (ticket != null) {
+		release(ticket.get());
+	}
+
+	nextFilter->sessionClosed(session);
+}
+
+sp<EObject> ERateLimitFilter::messageReceived(EIoFilter::NextFilter* nextFilter, EIoSession* session, sp<EObject> message) {
+	if (message != null) {
+		sp<Ticket> ticket = dynamic_pointer_cast<Ticket>(session->attributes.get((llong)SESSION_RATE_LIMIT_TICKET));
+		if (ticket != null && ticket->perMessage && !tryAcquire(session)) {
+			LOGGER->debug__(__FILE__, __LINE__, "Remote address: %s over the request rate; shutdown.",
+					session->getRemoteAddress()->toString().c_str());
+			ESocketSession* ss = dynamic_cast<ESocketSession*>(session);
+			if (ss) {
+				ss->getSocket()->shutdownInput();
+			}
+			return null;
+		}
+	}
+
+	return nextFilter->messageReceived(session, message);
+}
+
+int ERateLimitFilter::keyOf(EIoSession* session) {
+	return keyOf(session->getRemoteAddress()->getAddress());
+}
+
+int ERateLimitFilter::keyOf(EInetAddress* address) {
+	int mask = (subnetMask == 0) ? 0 : (int)(0xFFFFFFFFU << (32 - subnetMask));
+	return address->getAddress() & mask;
+}
+
+ERateLimitFilter::Shard* ERateLimitFilter::shardOf(int key) {
+	uint hash = (uint)key * 0x9E3779B1U; // fibonacci hashing, subnets differ in the high bits.
+	return shards[(hash >> 16) % shards.length()];
+}
+
+boolean ERateLimitFilter::acquire(Shard* shard, Source* source, llong now) {
+	if (requestsPerSecond <= 0) {
+		return true;
+	}
+
+	// refill the bucket lazily.
+	double tokens = source->tokens + (double)(now - source->refillTime) * requestsPerSecond / 1000000000.0;
+	source->tokens = ES_MIN(tokens, (double)burst);
+	source->refillTime = now;
+
+	if (source->tokens >= 1.0) {
+		source->tokens -= 1.0;
+		return true;
+	}
+	return false;
+}
+
+void ERateLimitFilter::sweep(Shard* shard, llong now) {
+	// drop the idle sources whose bucket is full again, they are same as new ones.
+	sp<EIterator<Source*> > iter = shard->sources.values()->iterator();
+	while (iter->hasNext()) {
+		Source* source = iter->next();
+		if (source->connections == 0
+				&& (requestsPerSecond <= 0
+						|| source->tokens + (double)(now - source->refillTime) * requestsPerSecond / 1000000000.0 >= burst)) {
+			iter->remove();
+			delete source;
+		}
+	}
+	shard->lastSweep = now;
+}
+
+void ERateLimitFilter::release(Ticket* ticket) {
+	SYNCBLOCK(&ticket->shard->lock) {
+		ticket->source->connections--;
+    }}
+	ticket->shard->connections.decrementAndGet();
+}
+
+} /* namespace naf */
+} /* namespace efc */
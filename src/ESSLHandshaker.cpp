@@ -0,0 +1,272 @@
+#include "./ESSLHandshaker.hh"
+
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <fcntl.h>
+#include <poll.h>
+
+namespace efc {
+namespace naf {
+
+sp<ELogger> ESSLHandshaker::logger = ELoggerManager::getLogger("ESSLHandshaker");
+
+int ESSLHandshaker::ctxIndex = -1;
+
+ESSLHandshaker::~ESSLHandshaker() {
+	OPENSSL_cleanse(keys, sizeof(keys));
+}
+
+ESSLHandshaker::ESSLHandshaker(EIoServiceStatistics* stats) :
+		stats(stats),
+		cacheSize(0),
+		cacheTimeout(0),
+		ticketKeyRotation(0),
+		kernelOffload(false),
+		keyCount(0) {
+}
+
+void ESSLHandshaker::setSessionCache(int size, int timeoutSeconds) {
+	if (size < 0 || timeoutSeconds < 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Session cache size and timeout can not be negative");
+	}
+	cacheSize = size;
+	cacheTimeout = timeoutSeconds;
+}
+
+void ESSLHandshaker::setTicketKeyRotation(int seconds) {
+	if (seconds < 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal rotation: %d", seconds).c_str());
+	}
+	ticketKeyRotation = seconds;
+}
+
+void ESSLHandshaker::setKernelOffload(boolean on) {
+	if (on) {
+#ifdef SSL_OP_ENABLE_KTLS
+		EString ulp;
+		FILE* fp = fopen("/proc/sys/net/ipv4/tcp_available_ulp", "r");
+		if (fp) {
+			char line[256];
+			if (fgets(line, sizeof(line), fp)) {
+				ulp = line;
+			}
+			fclose(fp);
+		}
+		if (ulp.indexOf("tls") < 0) {
+			// the kernel may still load it on demand, the sessions fall back if not.
+			logger->warn__(__FILE__, __LINE__, "kernel tls module is not loaded, try 'modprobe tls'.");
+		}
+#else
+		logger->warn__(__FILE__, __LINE__, "OpenSSL is built without ktls, the offload is ignored.");
+#endif
+	}
+	kernelOffload = on;
+}
+
+boolean ESSLHandshaker::isKernelOffload() {
+	return kernelOffload;
+}
+
+boolean ESSLHandshaker::handshake(ESocket* socket) {
+	ESSLSocket* ss = dynamic_cast<ESSLSocket*>(socket);
+	if (!ss) {
+		return true; // plain socket.
+	}
+
+	SSL* ssl = ss->getSSL();
+	configure(SSL_get_SSL_CTX(ssl));
+
+#ifdef SSL_OP_ENABLE_KTLS
+	if (kernelOffload) {
+		// the keys are pushed to the kernel by OpenSSL at the end of the handshake.
+		SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+	}
+#endif
+
+	// the socket io is fiber hooked, the handshake yields on io and only
+	// the crypto occupies the current thread.
+	llong t0 = ESystem::nanoTime();
+	int ret = SSL_do_handshake(ssl);
+	llong nanos = ESystem::nanoTime() - t0;
+
+	if (ret != 1) {
+		stats->failedHandshakeCount.incrementAndGet();
+		logger->debug__(__FILE__, __LINE__, "handshake failed: %d", SSL_get_error(ssl, ret));
+		return false;
+	}
+
+	stats->handshakeCount.incrementAndGet();
+	stats->handshakeNanos.addAndGet(nanos);
+	if (SSL_session_reused(ssl)) {
+		stats->resumedHandshakeCount.incrementAndGet();
+	}
+	if (kernelOffload) {
+		checkKernelOffload(ssl);
+	}
+	return true;
+}
+
+boolean ESSLHandshaker::sendfile(ESocket* socket, EFile* file) {
+#ifdef SSL_OP_ENABLE_KTLS
+	ESSLSocket* ss = dynamic_cast<ESSLSocket*>(socket);
+	if (!ss) {
+		return false;
+	}
+	SSL* ssl = ss->getSSL();
+	if (!BIO_get_ktls_send(SSL_get_wbio(ssl))) {
+		return false;
+	}
+
+	int fd = ::open(file->getPath().c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw EFileNotFoundException(__FILE__, __LINE__, file->getPath().c_str());
+	}
+	ON_SCOPE_EXIT(
+		::close(fd);
+	);
+
+	llong size = file->length();
+	llong offset = 0;
+	while (offset < size) {
+		ossl_ssize_t n = SSL_sendfile(ssl, fd, (off_t)offset, (size_t)ES_MIN(size - offset, 0x40000000LL), 0);
+		if (n > 0) {
+			offset += n;
+			continue;
+		}
+
+		if (SSL_get_error(ssl, (int)n) == SSL_ERROR_WANT_WRITE) {
+			// the socket is non-blocking under the fiber hook and sendfile is
+			// not hooked, so wait for it by the hooked poll.
+			struct pollfd pfd;
+			pfd.fd = SSL_get_fd(ssl);
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			int timeout = socket->getSoTimeout();
+			int r = ::poll(&pfd, 1, timeout > 0 ? timeout : -1);
+			if (r > 0) {
+				continue;
+			}
+			if (r == 0) {
+				throw ESocketTimeoutException(__FILE__, __LINE__, "SSL_sendfile timed out");
+			}
+		}
+		throw EIOException(__FILE__, __LINE__, EString::formatOf("SSL_sendfile failed: %d", errno).c_str());
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void ESSLHandshaker::configure(SSL_CTX* ctx) {
+	// the ctx is set up before it is marked, a concurrent first handshake
+	// waits here until it is done.
+	SYNCBLOCK(&lock) {
+		if (ctxIndex < 0) {
+			ctxIndex = SSL_CTX_get_ex_new_index(0, null, null, null, null);
+		}
+		if (SSL_CTX_get_ex_data(ctx, ctxIndex) == null) {
+			if (cacheSize > 0) {
+				SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+				SSL_CTX_sess_set_cache_size(ctx, cacheSize);
+				SSL_CTX_set_session_id_context(ctx, (const unsigned char*)"naf", 3);
+			}
+			if (cacheTimeout > 0) {
+				SSL_CTX_set_timeout(ctx, cacheTimeout); // also the ticket lifetime hint.
+			}
+			if (ticketKeyRotation > 0) {
+				SSL_CTX_set_tlsext_ticket_key_cb(ctx, onTicketKey);
+			}
+			SSL_CTX_set_ex_data(ctx, ctxIndex, this);
+		}
+    }}
+}
+
+void ESSLHandshaker::checkKernelOffload(SSL* ssl) {
+#ifdef SSL_OP_ENABLE_KTLS
+	boolean tx = BIO_get_ktls_send(SSL_get_wbio(ssl));
+	boolean rx = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+	if (tx) {
+		stats->kernelTLSCount.incrementAndGet();
+	} else {
+		stats->kernelTLSFallbackCount.incrementAndGet();
+	}
+	logger->debug__(__FILE__, __LINE__, "ktls: tx=%d, rx=%d, cipher=%s", tx, rx, SSL_get_cipher_name(ssl));
+#else
+	stats->kernelTLSFallbackCount.incrementAndGet();
+#endif
+}
+
+void ESSLHandshaker::rotateKeys(llong now) {
+	// under lock.
+	if (keyCount > 0 && now - keys[0].created < ticketKeyRotation * 1000LL) {
+		return;
+	}
+
+	keys[1] = keys[0];
+	TicketKey& key = keys[0];
+	if (RAND_bytes(key.name, sizeof(key.name)) != 1
+			|| RAND_bytes(key.aesKey, sizeof(key.aesKey)) != 1
+			|| RAND_bytes(key.hmacKey, sizeof(key.hmacKey)) != 1) {
+		throw EIllegalStateException(__FILE__, __LINE__, "RAND_bytes failed");
+	}
+	key.created = now;
+	keyCount = ES_MIN(keyCount + 1, 2);
+}
+
+int ESSLHandshaker::onTicketKey(SSL* ssl, unsigned char* name, unsigned char* iv,
+		EVP_CIPHER_CTX* ectx, HMAC_CTX* hctx, int enc) {
+	ESSLHandshaker* self = (ESSLHandshaker*)SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ctxIndex);
+	if (!self) {
+		return -1;
+	}
+
+	TicketKey key;
+	boolean current = true;
+	SYNCBLOCK(&self->lock) {
+		try {
+			self->rotateKeys(ESystem::currentTimeMillis());
+		} catch (...) {
+			return -1;
+		}
+		if (enc) {
+			key = self->keys[0];
+		} else {
+			int i = 0;
+			for (; i < self->keyCount; i++) {
+				if (memcmp(name, self->keys[i].name, sizeof(key.name)) == 0) {
+					break;
+				}
+			}
+			if (i == self->keyCount) {
+				return 0; // unknown or expired key, full handshake.
+			}
+			key = self->keys[i];
+			current = (i == 0);
+		}
+    }}
+
+	ON_SCOPE_EXIT(
+		OPENSSL_cleanse(&key, sizeof(key));
+	);
+
+	if (enc) {
+		memcpy(name, key.name, sizeof(key.name));
+		if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1
+				|| !EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), null, key.aesKey, iv)
+				|| !HMAC_Init_ex(hctx, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(), null)) {
+			return -1;
+		}
+		return 1;
+	}
+
+	if (!HMAC_Init_ex(hctx, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(), null)
+			|| !EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), null, key.aesKey, iv)) {
+		return -1;
+	}
+	return current ? 1 : 2; // 2: sealed by the previous key, issue a new ticket.
+}
+
+} /* namespace naf */
+} /* namespace efc */
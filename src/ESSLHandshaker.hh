@@ -0,0 +1,92 @@
+#ifndef ESSLHANDSHAKER_HH_
+#define ESSLHANDSHAKER_HH_
+
+#include "../inc/EIoServiceStatistics.hh"
+
+#include <openssl/ssl.h>
+
+namespace efc {
+namespace naf {
+
+/**
+ * Performs the server side TLS handshake of an accepted ssl socket
+ * explicitly, so the caller decides which thread pays for it, and
+ * counts it in the statistics.
+ *
+ * The SSL_CTX of every ssl service is configured at its first
+ * handshake: server session cache size and timeout, and session ticket
+ * keys rotated every <code>ticketKeyRotation</code> seconds, a ticket
+ * sealed by the previous key is still accepted and renewed.
+ */
+
+class ESSLHandshaker: public EObject {
+public:
+	virtual ~ESSLHandshaker();
+
+	ESSLHandshaker(EIoServiceStatistics* stats);
+
+	/**
+	 * Sets the server session cache, 0 to keep the OpenSSL defaults.
+	 */
+	void setSessionCache(int size, int timeoutSeconds);
+
+	/**
+	 * Sets the ticket key rotation interval, 0 to keep the OpenSSL
+	 * default key which lives as long as the service.
+	 */
+	void setTicketKeyRotation(int seconds);
+
+	/**
+	 * Enables the kTLS offload of the following handshakes, it needs
+	 * OpenSSL 3.0+ built with ktls.
+	 */
+	void setKernelOffload(boolean on);
+	boolean isKernelOffload();
+
+	/**
+	 * Handshakes the accepted ssl socket in the current fiber.
+	 *
+	 * @return false if the handshake failed.
+	 */
+	boolean handshake(ESocket* socket);
+
+	/**
+	 * Sends the whole file through the ssl socket by SSL_sendfile if the
+	 * transmit keys of the socket are in the kernel.
+	 *
+	 * @return false if kTLS is not active on the socket, nothing sent.
+	 */
+	static boolean sendfile(ESocket* socket, EFile* file) THROWS(EIOException);
+
+private:
+	struct TicketKey {
+		unsigned char name[16];
+		unsigned char aesKey[32];
+		unsigned char hmacKey[32];
+		llong created;
+	};
+
+	static sp<ELogger> logger;
+	static int ctxIndex;
+
+	EIoServiceStatistics* stats;
+	int cacheSize;
+	int cacheTimeout;
+	int ticketKeyRotation;
+	boolean kernelOffload;
+
+	ESpinLock lock;
+	TicketKey keys[2]; // 0: current, 1: previous
+	int keyCount;
+
+	void configure(SSL_CTX* ctx);
+	void rotateKeys(llong now);
+	void checkKernelOffload(SSL* ssl);
+
+	static int onTicketKey(SSL* ssl, unsigned char* name, unsigned char* iv,
+			EVP_CIPHER_CTX* ectx, HMAC_CTX* hctx, int enc);
+};
+
+} /* namespace naf */
+} /* namespace efc */
+#endif /* ESSLHANDSHAKER_HH_ */
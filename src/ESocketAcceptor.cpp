@@ -7,16 +7,22 @@
 
 #include "../inc/ESocketAcceptor.hh"
 #include "./EManagedSession.hh"
+#include "./EFiberWatchdog.hh"
+#include "./ESSLHandshaker.hh"
+#include "../inc/EIoTrace.hh"
 
 namespace efc {
 namespace naf {
 
 #define SOCKET_BACKLOG_MIN 512
+#define SSL_HANDSHAKE_TIMEOUT 10000 //ms
 
 sp<ELogger> ESocketAcceptor::logger = ELoggerManager::getLogger("ESocketAcceptor");
 
 ESocketAcceptor::~ESocketAcceptor() {
 	delete managedSessions_;
+	delete watchdog_; // joins its checker thread.
+	delete handshaker_;
 }
 
 ESocketAcceptor::ESocketAcceptor() :
@@ -27,8 +33,14 @@ ESocketAcceptor::ESocketAcceptor() :
 		bufsize_(-1),
 		maxConns_(-1),
 		workThreads_(EOS::active_processor_count()),
+		blockedThreshold_(0),
+		blockedDegrade_(false),
+		watchdog_(null),
+		cryptoThreads_(0),
+		cryptoMaxPending_(0),
 		stats_(this) {
 	managedSessions_ = new EManagedSession(this);
+	handshaker_ = new ESSLHandshaker(&stats_);
 }
 
 EFiberScheduler& ESocketAcceptor::getFiberScheduler() {
@@ -98,6 +110,61 @@ int ESocketAcceptor::getSessionIdleTime(EIdleStatus status) {
 	throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Unknown idle status: %d", status).c_str());
 }
 
+void ESocketAcceptor::setBlockedFiberThreshold(int millis, boolean degrade) {
+	if (millis < 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal blocked threshold: %d", millis).c_str());
+	}
+	if (status_ != INITED) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Acceptor is already listening.");
+	}
+	blockedThreshold_ = millis;
+	blockedDegrade_ = degrade;
+}
+
+int ESocketAcceptor::getBlockedFiberThreshold() {
+	return blockedThreshold_;
+}
+
+void ESocketAcceptor::setSSLHandshakeThreads(int threads, int maxPending) {
+	if (threads < 0 || maxPending <= 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal handshake threads: %d, %d", threads, maxPending).c_str());
+	}
+	if (status_ != INITED) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Acceptor is already listening.");
+	}
+	cryptoThreads_ = threads;
+	cryptoMaxPending_ = maxPending;
+}
+
+int ESocketAcceptor::getSSLHandshakeThreads() {
+	return cryptoThreads_;
+}
+
+void ESocketAcceptor::setSSLSessionCache(int size, int timeoutSeconds) {
+	if (status_ != INITED) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Acceptor is already listening.");
+	}
+	handshaker_->setSessionCache(size, timeoutSeconds);
+}
+
+void ESocketAcceptor::setSSLTicketKeyRotation(int seconds) {
+	if (status_ != INITED) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Acceptor is already listening.");
+	}
+	handshaker_->setTicketKeyRotation(seconds);
+}
+
+void ESocketAcceptor::setSSLKernelOffload(boolean on) {
+	if (status_ != INITED) {
+		throw EIllegalStateException(__FILE__, __LINE__, "Acceptor is already listening.");
+	}
+	handshaker_->setKernelOffload(on);
+}
+
+boolean ESocketAcceptor::isSSLKernelOffload() {
+	return handshaker_->isKernelOffload();
+}
+
 int ESocketAcceptor::getWorkThreads() {
 	return workThreads_;
 }
@@ -126,12 +193,14 @@ void ESocketAcceptor::bind(int port, boolean ssl, const char* name, std::functio
 	Service* svc = new Service(name, ssl, "127.0.0.1", port);
 	Services_.add(svc);
 	if (listener != null) { listener(*svc); }
+	this->onServiceBound(svc);
 }
 
 void ESocketAcceptor::bind(const char* hostname, int port, boolean ssl, const char* name, std::function<void(Service& service)> listener) {
 	Service* svc = new Service(name, ssl, hostname, port);
 	Services_.add(svc);
 	if (listener != null) { listener(*svc); }
+	this->onServiceBound(svc);
 }
 
 void ESocketAcceptor::bind(EInetSocketAddress* localAddress, boolean ssl, const char* name, std::function<void(Service& service)> listener) {
@@ -141,6 +210,7 @@ void ESocketAcceptor::bind(EInetSocketAddress* localAddress, boolean ssl, const
 	Service* svc = new Service(name, ssl, localAddress);
 	Services_.add(svc);
 	if (listener != null) { listener(*svc); }
+	this->onServiceBound(svc);
 }
 
 void ESocketAcceptor::bind(EIterable<EInetSocketAddress*>* localAddresses, boolean ssl, const char* name, std::function<void(Service& service)> listener) {
@@ -152,26 +222,47 @@ void ESocketAcceptor::bind(EIterable<EInetSocketAddress*>* localAddresses, boole
 		Service* svc = new Service(name, ssl, iter->next());
 		Services_.add(svc);
 		if (listener != null) { listener(*svc); }
+		this->onServiceBound(svc);
 	}
 }
 
 void ESocketAcceptor::listen() {
 	try {
+		if (blockedThreshold_ > 0) {
+			watchdog_ = new EFiberWatchdog(this, blockedThreshold_, blockedDegrade_);
+		}
+
 		// fibers balance
-		scheduler.setBalanceCallback([](EFiber* fiber, int threadNums){
+		scheduler.setBalanceCallback([this](EFiber* fiber, int threadNums){
 			long tag = fiber->getTag();
 			if (tag == 0) {
 				return 0;   // accept fibers
 			} else if (tag > 0) {
-				return (int)tag; // clean fibers
+				return (int)tag; // clean fibers and crypto fibers
 			} else {
+				int ioThreads = threadNums - cryptoThreads_; // crypto threads at the tail.
 				int fid = fiber->getId();
-				return fid % (threadNums - 1) + 1; // balance to other's threads.
+				int index = fid % (ioThreads - 1) + 1; // balance to other's threads.
+				if (watchdog_ && watchdog_->isDegraded(index)) {
+					// skip the blocked threads if possible.
+					for (int i=1; i<ioThreads - 1; i++) {
+						int next = (index - 1 + i) % (ioThreads - 1) + 1;
+						if (!watchdog_->isDegraded(next)) {
+							return next;
+						}
+					}
+				}
+				return index;
 			}
 		});
 
 		status_ = RUNNING;
 
+		// start blocked fiber watchdog
+		if (watchdog_) {
+			watchdog_->start(scheduler);
+		}
+
 		// create clean idle socket fibers for per-conn-thread.
 		if (idleTimeForRead_.value() > 0 || idleTimeForWrite_.value() > 0) {
 			for (int i=1; i<workThreads_; i++) {
@@ -192,12 +283,17 @@ void ESocketAcceptor::listen() {
 		this->onListeningHandle();
 
 		// wait for fibers work done.
-		scheduler.join(EOS::active_processor_count());
+		scheduler.join(EOS::active_processor_count() + cryptoThreads_);
 	} catch (EInterruptedException& e) {
 		logger->info__(__FILE__, __LINE__, "interrupted");
 	} catch (EException& e) {
 		logger->error__(__FILE__, __LINE__, e.toString().c_str());
 	}
+
+	// the io threads are gone, stop checking them.
+	if (watchdog_) {
+		watchdog_->stop();
+	}
 }
 
 void ESocketAcceptor::signalAccept() {
@@ -258,6 +354,8 @@ void ESocketAcceptor::startAccept(EFiberScheduler& scheduler, Service* service)
 					try {
 						sp<ESocketSession> session = newSession(this, socket);
 						session->init(); // enable shared from this.
+						session->watchdog_ = watchdog_;
+						EIoTrace::record(EIoTrace::ACCEPT, session->getId(), socket->getFD());
 
 						// reach the max connections.
 						int maxconns = maxConns_.value();
@@ -274,39 +372,11 @@ void ESocketAcceptor::startAccept(EFiberScheduler& scheduler, Service* service)
 							stats_.largestManagedSessionCount.set(connections_.value());
 						}
 
-						scheduler.schedule([session,service,this](){
-							ON_SCOPE_EXIT(
-								connections_--;
-
-								// remove from session manager.
-								managedSessions_->removeSession(session->getSocket()->getFD());
-								session->close();
-							);
-
-							try {
-								// add to session manager.
-								managedSessions_->addSession(session->getSocket()->getFD(), session.get());
-
-								// set so_timeout option.
-								if (timeout_ > 0) {
-									session->getSocket()->setSoTimeout(timeout_);
-								}
-
-								// on session create.
-								boolean created = session->getFilterChain()->fireSessionCreated();
-								if (!created) {
-									return;
-								}
-
-								// on connection.
-								sp<ESocketSession> noconstss = session;
-								this->onConnectionHandle(noconstss, service);
-							} catch (EThrowable& t) {
-								logger->error__(__FILE__, __LINE__, t.toString().c_str());
-							} catch (...) {
-								logger->error__(__FILE__, __LINE__, "error");
-							}
-						});
+						if (service->sslActive && cryptoThreads_ > 0) {
+							this->startHandshake(scheduler, session, service);
+						} else {
+							this->startSession(scheduler, session, service, !service->sslActive);
+						}
 					} catch (EThrowable& t) {
 						logger->error__(__FILE__, __LINE__, t.toString().c_str());
 					} catch (...) {
@@ -332,6 +402,89 @@ void ESocketAcceptor::startAccept(EFiberScheduler& scheduler, Service* service)
 	scheduler.schedule(acceptFiber);
 }
 
+void ESocketAcceptor::startSession(EFiberScheduler& scheduler, sp<ESocketSession>& session, Service* service, boolean handshaked) {
+	scheduler.schedule([session,service,handshaked,this](){
+		ON_SCOPE_EXIT(
+			connections_--;
+
+			// remove from session manager.
+			managedSessions_->removeSession(session->getSocket()->getFD());
+			session->close();
+		);
+
+		try {
+			// add to session manager.
+			managedSessions_->addSession(session->getSocket()->getFD(), session.get());
+
+			// set so_timeout option.
+			if (timeout_ > 0) {
+				session->getSocket()->setSoTimeout(timeout_);
+			}
+
+			// handshake on current io thread.
+			if (!handshaked && !handshaker_->handshake(session->getSocket().get())) {
+				return;
+			}
+
+			// on session create.
+			boolean created = session->getFilterChain()->fireSessionCreated();
+			if (!created) {
+				return;
+			}
+
+			// on connection.
+			sp<ESocketSession> noconstss = session;
+			this->onConnectionHandle(noconstss, service);
+		} catch (EThrowable& t) {
+			logger->error__(__FILE__, __LINE__, t.toString().c_str());
+		} catch (...) {
+			logger->error__(__FILE__, __LINE__, "error");
+		}
+	});
+}
+
+void ESocketAcceptor::startHandshake(EFiberScheduler& scheduler, sp<ESocketSession>& session, Service* service) {
+	// reach the max pending handshakes.
+	if (cryptoPending_.value() >= cryptoMaxPending_) {
+		connections_--;
+		stats_.failedHandshakeCount.incrementAndGet();
+		session->getSocket()->close();
+		return;
+	}
+	cryptoPending_++;
+
+	sp<EFiber> handshakeFiber = new EFiberTarget([session,service,this](){
+		boolean handshaked = false;
+		ON_SCOPE_EXIT(
+			cryptoPending_--;
+			if (!handshaked) {
+				connections_--;
+				session->getSocket()->close();
+			}
+		);
+
+		try {
+			sp<ESocket> socket = session->getSocket();
+			socket->setSoTimeout(timeout_ > 0 ? timeout_ : SSL_HANDSHAKE_TIMEOUT);
+			handshaked = handshaker_->handshake(socket.get());
+			if (handshaked) {
+				if (timeout_ <= 0) {
+					socket->setSoTimeout(0);
+				}
+				sp<ESocketSession> noconstss = session;
+				this->startSession(this->scheduler, noconstss, service, true);
+			}
+		} catch (EThrowable& t) {
+			logger->error__(__FILE__, __LINE__, t.toString().c_str());
+		} catch (...) {
+			logger->error__(__FILE__, __LINE__, "error");
+		}
+	});
+	handshakeFiber->setTag(workThreads_ + session->getId() % cryptoThreads_); //tag: N-(N+crypto threads)
+
+	scheduler.schedule(handshakeFiber);
+}
+
 void ESocketAcceptor::startClean(EFiberScheduler& scheduler, int tag) {
 	sp<EFiber> cleanFiber = new EFiberTarget([&,this](){
 		logger->debug__(__FILE__, __LINE__, "I'm clean fiber, thread id=%ld", EThread::currentThread()->getId());
@@ -438,6 +591,10 @@ sp<ESocketSession> ESocketAcceptor::newSession(EIoService *service, sp<ESocket>&
 	return new ESocketSession(this, socket);
 }
 
+void ESocketAcceptor::onServiceBound(Service* service) {
+	// default: do nothing.
+}
+
 void ESocketAcceptor::onListeningHandle() {
 	if (listeningCallback_ != null) {
 		scheduler.schedule([this](){
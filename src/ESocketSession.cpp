@@ -6,17 +6,27 @@
  */
 
 #include "../inc/ESocketSession.hh"
+#include "../inc/EIoBufferChain.hh"
+#include "./EFiberWatchdog.hh"
+#include "./ESSLHandshaker.hh"
+#include "../inc/EIoTrace.hh"
+
+#include <sys/uio.h>
+#include <poll.h>
 
 namespace efc {
 namespace naf {
 
+#define IOV_BATCH 64
+#define SSL_COALESCE_SIZE 16384 // one tls record
+
 ESocketSession::~ESocketSession() {
 	//
 }
 
 ESocketSession::ESocketSession(EIoService* service, sp<ESocket>& socket):
 		EIoSession(service),
-		socket_(socket), closed_(false),
+		socket_(socket), closed_(false), watchdog_(null),
 		ioBufferLimit(ES_MAX(socket_->getReceiveBufferSize(), 512)) {
 }
 
@@ -25,10 +35,6 @@ void ESocketSession::init() {
 }
 
 sp<EObject> ESocketSession::read() {
-	if (ioBuffer == null) {
-		ioBuffer = EIoBuffer::allocate(ioBufferLimit);
-	}
-
 	EInputStream* is = socket_->getInputStream();
 
 	// try it for packet splicing.
@@ -40,8 +46,18 @@ sp<EObject> ESocketSession::read() {
 	// else read next.
 
 RESUME:
+	if (ioBuffer == null) {
+		ioBuffer = EIoBuffer::allocate(ioBufferLimit);
+	}
 	ioBuffer->clear();
+	llong t0 = EIoTrace::isEnabled() ? EIoTrace::now() : 0;
 	int n = is->read(ioBuffer->current(), ioBuffer->limit());
+	if (t0) {
+		EIoTrace::record(EIoTrace::READ, getId(), n, EIoTrace::now() - t0);
+	}
+	if (watchdog_) {
+		watchdog_->active(this);
+	}
 	if (n > 0) {
 		ioBuffer->position(n);
 		ioBuffer->flip();
@@ -67,26 +83,129 @@ boolean ESocketSession::write(sp<EObject> message) {
 	// on session message send.
 	sp<EObject> out = filterChain->fireMessageSend(message);
 
+	ON_SCOPE_EXIT(
+		if (watchdog_) {
+			watchdog_->active(this);
+		}
+	);
+
+	llong t0 = EIoTrace::isEnabled() ? EIoTrace::now() : 0;
+
 	sp<EIoBuffer> ib = dynamic_pointer_cast<EIoBuffer>(out);
 	if (ib != null) {
-		os->write(ib->current(), ib->remaining());
+		int n = ib->remaining();
+		os->write(ib->current(), n);
+		if (t0) {
+			EIoTrace::record(EIoTrace::WRITE, getId(), n, EIoTrace::now() - t0);
+		}
+		return true;
+	}
+
+	sp<EIoBufferChain> chain = dynamic_pointer_cast<EIoBufferChain>(out);
+	if (chain != null) {
+		llong n = chain->remaining();
+		if (!isSecured()) {
+			writev(chain.get());
+		} else if (n <= SSL_COALESCE_SIZE) {
+			sp<EIoBuffer> buf = chain->flatten();
+			os->write(buf->current(), buf->remaining());
+		} else {
+			for (int i = 0; i < chain->size(); i++) {
+				sp<EIoBuffer> buf = chain->get(i);
+				os->write(buf->current(), buf->remaining());
+			}
+		}
+		if (t0) {
+			EIoTrace::record(EIoTrace::WRITE, getId(), n, EIoTrace::now() - t0);
+		}
 		return true;
 	}
 
 	sp<EFile> file = dynamic_pointer_cast<EFile>(out);
 	if (file != null) {
-		socket_->sendfile(file.get());
+		if (!isSecured()) {
+			socket_->sendfile(file.get());
+		} else if (!ESSLHandshaker::sendfile(socket_.get(), file.get())) {
+			// no kTLS, encrypt it in user space.
+			EFileInputStream fis(file.get());
+			char buf[16384];
+			int n;
+			while ((n = fis.read(buf, sizeof(buf))) > 0) {
+				os->write(buf, n);
+			}
+		}
+		if (t0) {
+			EIoTrace::record(EIoTrace::WRITE, getId(), file->length(), EIoTrace::now() - t0);
+		}
 		return true;
 	}
 
 	return false;
 }
 
+void ESocketSession::writev(EIoBufferChain* chain) {
+	int fd = socket_->getFD();
+	int count = chain->size();
+	struct iovec iov[IOV_BATCH];
+
+	for (int i = 0; i < count; ) {
+		int n = 0;
+		for (; n < IOV_BATCH && i + n < count; n++) {
+			sp<EIoBuffer> buf = chain->get(i + n);
+			iov[n].iov_base = buf->current();
+			iov[n].iov_len = buf->remaining();
+		}
+		i += n;
+
+		struct iovec* p = iov;
+		while (n > 0) {
+			ssize_t w = ::writev(fd, p, n);
+			if (w < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if (errno == EAGAIN) {
+					// not fiber hooked, wait for it.
+					struct pollfd pfd;
+					pfd.fd = fd;
+					pfd.events = POLLOUT;
+					pfd.revents = 0;
+					int timeout = socket_->getSoTimeout();
+					int r = ::poll(&pfd, 1, timeout > 0 ? timeout : -1);
+					if (r == 0) {
+						throw ESocketTimeoutException(__FILE__, __LINE__, "writev timed out");
+					}
+					if (r < 0 && errno != EINTR) {
+						throw EIOException(__FILE__, __LINE__, EString::formatOf("writev poll failed: %d", errno).c_str());
+					}
+					continue;
+				}
+				throw EIOException(__FILE__, __LINE__, EString::formatOf("writev failed: %d", errno).c_str());
+			}
+
+			// skip the written vectors and cut the partial one.
+			while (n > 0 && (size_t)w >= p->iov_len) {
+				w -= p->iov_len;
+				p++;
+				n--;
+			}
+			if (n > 0) {
+				p->iov_base = (char*)p->iov_base + w;
+				p->iov_len -= w;
+			}
+		}
+	}
+}
+
 void ESocketSession::close() {
 	if (!closed_) {
 		filterChain->fireSessionClosed();
 		socket_->close();
 		closed_ = true;
+
+		if (watchdog_) {
+			watchdog_->inactive(this);
+		}
 	}
 }
 
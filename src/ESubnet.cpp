@@ -6,131 +6,181 @@
  */
 
 #include "../inc/ESubnet.hh"
+#include "../inc/ESocketSession.hh"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
 
 namespace efc {
 namespace naf {
 
-// Warning: Now only support IPV4 address.
-
 ESubnet::~ESubnet() {
 
 }
 
 ESubnet::ESubnet(EInetAddress* subnet, int mask) {
-	/* @see:
 	if (subnet == null) {
-		throw new IllegalArgumentException("Subnet address can not be null");
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnet address can not be null");
 	}
 
-	if (!(subnet instanceof Inet4Address) && !(subnet instanceof Inet6Address)) {
-		throw new IllegalArgumentException("Only IPv4 and IPV6 supported");
+	byte bytes[4];
+	toBytes(subnet, bytes);
+	init(bytes, 4, mask);
+}
+
+ESubnet::ESubnet(const char* cidr) {
+	if (cidr == null) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnet can not be null");
 	}
 
-	if (subnet instanceof Inet4Address) {
-		// IPV4 address
-		if ((mask < 0) || (mask > 32)) {
-			throw new IllegalArgumentException("Mask has to be an integer between 0 and 32 for an IPV4 address");
-		} else {
-			this.subnet = subnet;
-			subnetInt = toInt(subnet);
-			this.suffix = mask;
-
-			// binary mask for this subnet
-			this.subnetMask = IP_MASK_V4 >> (mask - 1);
-		}
-	} else {
-		// IPV6 address
-		if ((mask < 0) || (mask > 128)) {
-			throw new IllegalArgumentException("Mask has to be an integer between 0 and 128 for an IPV6 address");
-		} else {
-			this.subnet = subnet;
-			subnetLong = toLong(subnet);
-			this.suffix = mask;
-
-			// binary mask for this subnet
-			this.subnetMask = IP_MASK_V6 >> (mask - 1);
-		}
+	EString text(cidr);
+	text = text.trim();
+	int slash = text.indexOf('/');
+	EString host = (slash < 0) ? text : text.substring(0, slash);
+
+	byte bytes[16];
+	int length = parseAddress(host.c_str(), bytes);
+	if (length == 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal subnet: %s", cidr).c_str());
 	}
-	*/
 
-	if (subnet == null) {
+	int mask = length * 8;
+	if (slash >= 0) {
+		mask = EInteger::parseInt(text.substring(slash + 1).c_str());
+	}
+	init(bytes, length, mask);
+}
+
+ESubnet::ESubnet(const byte* address, int length, int mask) {
+	if (address == null) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnet address can not be null");
 	}
+	if (length != 4 && length != 16) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Only IPv4 and IPV6 supported");
+	}
+	init(address, length, mask);
+}
 
-	// IPV4 address
-	if ((mask < 0) || (mask > 32)) {
+void ESubnet::init(const byte* address, int length, int mask) {
+	if (length == 4 && ((mask < 0) || (mask > 32))) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Mask has to be an integer between 0 and 32 for an IPV4 address");
-	} else {
-		this->subnet = *subnet;
-		subnetInt = toInt(subnet);
-		this->suffix = mask;
+	}
+	if (length == 16 && ((mask < 0) || (mask > 128))) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Mask has to be an integer between 0 and 128 for an IPV6 address");
+	}
+
+	length_ = length;
+	suffix_ = mask;
 
-		// binary mask for this subnet
-		this->subnetMask = IP_MASK_V4 >> (mask - 1);
+	// keep the network bits only.
+	memset(address_, 0, sizeof(address_));
+	int full = mask / 8;
+	memcpy(address_, address, full);
+	if (mask % 8) {
+		address_[full] = address[full] & (byte)(0xFF << (8 - mask % 8));
 	}
 }
 
 boolean ESubnet::inSubnet(EInetAddress* address) {
-	/* @see:
-	if (address.isAnyLocalAddress()) {
+	if (!address) return false;
+
+	if (address->isAnyLocalAddress()) {
 		return true;
 	}
 
-	if (address instanceof Inet4Address) {
-		return (int) toSubnet(address) == subnetInt;
-	} else {
-		return toSubnet(address) == subnetLong;
-	}
-	*/
+	byte bytes[4];
+	toBytes(address, bytes);
+	return inSubnet(bytes, 4);
+}
 
-	if (!address) return false;
+boolean ESubnet::inSubnet(const byte* address, int length) {
+	if (!address || length != length_) return false;
 
-	if (address->isAnyLocalAddress()) {
-		return true;
+	int full = suffix_ / 8;
+	if (memcmp(address, address_, full) != 0) {
+		return false;
+	}
+	if (suffix_ % 8) {
+		byte mask = (byte)(0xFF << (8 - suffix_ % 8));
+		return (address[full] & mask) == address_[full];
 	}
+	return true;
+}
+
+const byte* ESubnet::getAddress() {
+	return address_;
+}
+
+int ESubnet::getAddressLength() {
+	return length_;
+}
 
-	return (int) toSubnet(address) == subnetInt;
+int ESubnet::getMask() {
+	return suffix_;
 }
 
 EString ESubnet::toString() {
-	return subnet.getHostAddress() + "/" + suffix;
+	char text[INET6_ADDRSTRLEN];
+	inet_ntop((length_ == 4) ? AF_INET : AF_INET6, address_, text, sizeof(text));
+	return EString(text) + "/" + suffix_;
 }
 
 boolean ESubnet::equals(ESubnet* other) {
 	if (!other) return false;
 
-	return other->subnetInt == subnetInt && other->suffix == suffix;
+	return other->length_ == length_ && other->suffix_ == suffix_
+			&& memcmp(other->address_, address_, length_) == 0;
 }
 
-int ESubnet::toInt(EInetAddress* inetAddress) {
-	/* @see:
-	byte[] address = inetAddress.getAddress();
-	int result = 0;
+void ESubnet::toBytes(EInetAddress* address, byte bytes[4]) {
+	// the int address is in network order: the first byte is the highest.
+	int ip = address->getAddress();
+	bytes[0] = (byte)((ip >> 24) & 0xFF);
+	bytes[1] = (byte)((ip >> 16) & 0xFF);
+	bytes[2] = (byte)((ip >> 8) & 0xFF);
+	bytes[3] = (byte)(ip & 0xFF);
+}
 
-	for (int i = 0; i < address.length; i++) {
-		result <<= 8;
-		result |= address[i] & BYTE_MASK;
+int ESubnet::toBytes(EIoSession* session, byte bytes[16]) {
+	if (!session) return 0;
+
+	// the socket peer, the session address is IPv4 only.
+	ESocketSession* ss = dynamic_cast<ESocketSession*>(session);
+	if (ss) {
+		struct sockaddr_storage peer;
+		socklen_t len = sizeof(peer);
+		if (::getpeername(ss->getSocket()->getFD(), (struct sockaddr*)&peer, &len) == 0) {
+			if (peer.ss_family == AF_INET) {
+				memcpy(bytes, &((struct sockaddr_in*)&peer)->sin_addr, 4);
+				return 4;
+			}
+			if (peer.ss_family == AF_INET6) {
+				struct in6_addr* a6 = &((struct sockaddr_in6*)&peer)->sin6_addr;
+				if (IN6_IS_ADDR_V4MAPPED(a6)) {
+					memcpy(bytes, a6->s6_addr + 12, 4);
+					return 4;
+				}
+				memcpy(bytes, a6->s6_addr, 16);
+				return 16;
+			}
+		}
 	}
 
-	return result;
-	*/
-	return inetAddress->getAddress();
+	EInetSocketAddress* remote = session->getRemoteAddress();
+	if (!remote || !remote->getAddress()) return 0;
+	toBytes(remote->getAddress(), bytes);
+	return 4;
 }
 
-long ESubnet::toLong(EInetAddress* inetAddress) {
-	return inetAddress->getAddress();
-}
-
-long ESubnet::toSubnet(EInetAddress* address) {
-	/* @see:
-	if (address instanceof Inet4Address) {
-		return toInt(address) & (int) subnetMask;
-	} else {
-		return toLong(address) & subnetMask;
+int ESubnet::parseAddress(const char* text, byte bytes[16]) {
+	if (!text) return 0;
+	if (inet_pton(AF_INET, text, bytes) == 1) {
+		return 4;
 	}
-	*/
-
-	return address->getAddress() & (int) subnetMask;
+	if (inet_pton(AF_INET6, text, bytes) == 1) {
+		return 16;
+	}
+	return 0;
 }
 
 } /* namespace naf */
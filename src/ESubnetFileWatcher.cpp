@@ -0,0 +1,115 @@
+#include "../inc/ESubnetFileWatcher.hh"
+
+namespace efc {
+namespace naf {
+
+sp<ELogger> ESubnetFileWatcher::logger = ELoggerManager::getLogger("ESubnetFileWatcher");
+
+ESubnetFileWatcher::~ESubnetFileWatcher() {
+	stop();
+}
+
+ESubnetFileWatcher::ESubnetFileWatcher(const char* path, int intervalMillis, Listener listener) :
+		path(path),
+		interval(intervalMillis),
+		listener(listener),
+		lastModified(-1),
+		lastLength(-1),
+		stopped(false) {
+	if (path == null) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Path can not be null");
+	}
+	if (intervalMillis <= 0) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, EString::formatOf("Illegal interval: %d", intervalMillis).c_str());
+	}
+}
+
+void ESubnetFileWatcher::start() {
+	changed(); // remember the first version.
+	listener(load(path.c_str()));
+
+	watcher = new EEThreadTarget([this](){
+		try {
+			while (!stopped) {
+				EThread::sleep(interval);
+				if (stopped || !changed()) {
+					continue;
+				}
+
+				try {
+					ESubnetTrie* subnets = load(path.c_str());
+					logger->info__(__FILE__, __LINE__, "%s reloaded, %d subnets", path.c_str(), subnets->size());
+					listener(subnets);
+				} catch (EIOException& e) {
+					// may be in the middle of a replacement, keep the current one.
+					logger->warn__(__FILE__, __LINE__, e.toString().c_str());
+					lastModified = -1;
+				}
+			}
+		} catch (EInterruptedException& e) {
+			// stopped.
+		} catch (EThrowable& t) {
+			logger->error__(__FILE__, __LINE__, t.toString().c_str());
+		}
+	});
+	EThread::setDaemon(watcher, true);
+	watcher->start();
+}
+
+void ESubnetFileWatcher::stop() {
+	stopped = true;
+	if (watcher != null) {
+		watcher->interrupt();
+		watcher->join();
+		watcher = null;
+	}
+}
+
+boolean ESubnetFileWatcher::changed() {
+	EFile file(path.c_str());
+	llong modified = file.lastModified();
+	llong length = file.length();
+	if (modified == lastModified && length == lastLength) {
+		return false;
+	}
+	lastModified = modified;
+	lastLength = length;
+	return true;
+}
+
+ESubnetTrie* ESubnetFileWatcher::load(const char* path) {
+	FILE* fp = ::fopen(path, "r");
+	if (!fp) {
+		throw EIOException(__FILE__, __LINE__, EString::formatOf("Open %s failed: %s", path, strerror(errno)).c_str());
+	}
+	ON_SCOPE_EXIT(
+		::fclose(fp);
+	);
+
+	ESubnetTrie* subnets = new ESubnetTrie();
+	char buf[512];
+	int lineNo = 0;
+	while (::fgets(buf, sizeof(buf), fp)) {
+		lineNo++;
+		char* comment = ::strchr(buf, '#');
+		if (comment) {
+			*comment = '\0';
+		}
+		EString line(buf);
+		line = line.trim();
+		if (line.isEmpty()) {
+			continue;
+		}
+
+		try {
+			ESubnet subnet(line.c_str());
+			subnets->add(&subnet);
+		} catch (EException& e) {
+			logger->warn__(__FILE__, __LINE__, "%s:%d: skipped \"%s\", %s", path, lineNo, line.c_str(), e.toString().c_str());
+		}
+	}
+	return subnets;
+}
+
+} /* namespace naf */
+} /* namespace efc */
@@ -0,0 +1,223 @@
+#include "../inc/ESubnetTrie.hh"
+
+namespace efc {
+namespace naf {
+
+ESubnetTrie::~ESubnetTrie() {
+	clear();
+}
+
+ESubnetTrie::ESubnetTrie(): size_(0) {
+	roots[0] = roots[1] = null;
+}
+
+boolean ESubnetTrie::add(ESubnet* subnet) {
+	if (subnet == null) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnet can not be null");
+	}
+	return add(subnet->getAddress(), subnet->getAddressLength(), subnet->getMask());
+}
+
+boolean ESubnetTrie::remove(ESubnet* subnet) {
+	if (subnet == null) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnet can not be null");
+	}
+	return remove(subnet->getAddress(), subnet->getAddressLength(), subnet->getMask());
+}
+
+boolean ESubnetTrie::contains(EInetAddress* address) {
+	if (!address) return false;
+
+	byte bytes[4];
+	ESubnet::toBytes(address, bytes);
+	return longestMatch(bytes, 4) >= 0;
+}
+
+boolean ESubnetTrie::contains(const byte* address, int length) {
+	return longestMatch(address, length) >= 0;
+}
+
+boolean ESubnetTrie::contains(EIoSession* session) {
+	byte bytes[16];
+	int length = ESubnet::toBytes(session, bytes);
+	return length > 0 && longestMatch(bytes, length) >= 0;
+}
+
+int ESubnetTrie::longestMatch(const byte* address, int length) {
+	if (!address || (length != 4 && length != 16)) {
+		return -1;
+	}
+
+	int bits = length * 8;
+	int best = -1;
+	Node* cur = roots[length == 16];
+	while (cur) {
+		if (cur->bits > bits || commonBits(cur->key, address, cur->bits) < cur->bits) {
+			break;
+		}
+		if (cur->terminal) {
+			best = cur->bits;
+		}
+		if (cur->bits == bits) {
+			break;
+		}
+		cur = cur->child[bitAt(address, cur->bits)];
+	}
+	return best;
+}
+
+int ESubnetTrie::size() {
+	return size_;
+}
+
+void ESubnetTrie::clear() {
+	freeTree(roots[0]);
+	freeTree(roots[1]);
+	roots[0] = roots[1] = null;
+	size_ = 0;
+}
+
+ESubnetTrie* ESubnetTrie::clone() {
+	ESubnetTrie* trie = new ESubnetTrie();
+	trie->roots[0] = copyTree(roots[0]);
+	trie->roots[1] = copyTree(roots[1]);
+	trie->size_ = size_;
+	return trie;
+}
+
+boolean ESubnetTrie::add(const byte* key, int length, int bits) {
+	Node** link = &roots[length == 16];
+
+	while (true) {
+		Node* cur = *link;
+		if (!cur) {
+			*link = newNode(key, bits, true);
+			size_++;
+			return true;
+		}
+
+		int common = commonBits(cur->key, key, ES_MIN(cur->bits, bits));
+		if (common < cur->bits) {
+			if (common == bits) {
+				// the new subnet covers the current node.
+				Node* node = newNode(key, bits, true);
+				node->child[bitAt(cur->key, bits)] = cur;
+				*link = node;
+			} else {
+				// branch at the first different bit.
+				Node* glue = newNode(key, common, false);
+				glue->child[bitAt(key, common)] = newNode(key, bits, true);
+				glue->child[bitAt(cur->key, common)] = cur;
+				*link = glue;
+			}
+			size_++;
+			return true;
+		}
+
+		if (cur->bits == bits) {
+			if (cur->terminal) {
+				return false;
+			}
+			cur->terminal = true;
+			size_++;
+			return true;
+		}
+
+		link = &cur->child[bitAt(key, cur->bits)];
+	}
+}
+
+boolean ESubnetTrie::remove(const byte* key, int length, int bits) {
+	Node** link = &roots[length == 16];
+	Node** parentLink = null;
+	Node* parent = null;
+	Node* cur;
+
+	while ((cur = *link) != null) {
+		if (cur->bits > bits || commonBits(cur->key, key, cur->bits) < cur->bits) {
+			return false;
+		}
+		if (cur->bits == bits) {
+			break;
+		}
+		parentLink = link;
+		parent = cur;
+		link = &cur->child[bitAt(key, cur->bits)];
+	}
+
+	if (!cur || !cur->terminal) {
+		return false;
+	}
+
+	cur->terminal = false;
+	size_--;
+
+	if (cur->child[0] && cur->child[1]) {
+		return true; // still a branch point.
+	}
+
+	*link = cur->child[0] ? cur->child[0] : cur->child[1];
+	delete cur;
+
+	// the parent is a useless branch point now.
+	if (parent && !parent->terminal && (!parent->child[0] || !parent->child[1])) {
+		*parentLink = parent->child[0] ? parent->child[0] : parent->child[1];
+		delete parent;
+	}
+
+	return true;
+}
+
+ESubnetTrie::Node* ESubnetTrie::newNode(const byte* key, int bits, boolean terminal) {
+	Node* node = new Node();
+	memset(node->key, 0, sizeof(node->key));
+	int full = bits / 8;
+	memcpy(node->key, key, full);
+	if (bits % 8) {
+		node->key[full] = key[full] & (byte)(0xFF << (8 - bits % 8));
+	}
+	node->bits = bits;
+	node->terminal = terminal;
+	node->child[0] = node->child[1] = null;
+	return node;
+}
+
+void ESubnetTrie::freeTree(Node* node) {
+	if (node) {
+		freeTree(node->child[0]);
+		freeTree(node->child[1]);
+		delete node;
+	}
+}
+
+ESubnetTrie::Node* ESubnetTrie::copyTree(Node* node) {
+	if (!node) {
+		return null;
+	}
+	Node* copy = new Node(*node);
+	copy->child[0] = copyTree(node->child[0]);
+	copy->child[1] = copyTree(node->child[1]);
+	return copy;
+}
+
+int ESubnetTrie::commonBits(const byte* a, const byte* b, int maxBits) {
+	int i = 0;
+	int full = maxBits / 8;
+	while (i < full && a[i] == b[i]) {
+		i++;
+	}
+	if (i < full) {
+		return i * 8 + __builtin_clz((uint)(ubyte)(a[i] ^ b[i])) - 24;
+	}
+	int rest = maxBits % 8;
+	if (rest) {
+		int diff = (ubyte)(a[full] ^ b[full]) >> (8 - rest);
+		if (diff) {
+			return full * 8 + __builtin_clz((uint)diff) - (32 - rest);
+		}
+	}
+	return maxBits;
+}
+
+} /* namespace naf */
+} /* namespace efc */
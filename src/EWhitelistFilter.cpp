@@ -12,19 +12,36 @@ namespace naf {
 
 sp<ELogger> EWhitelistFilter::LOGGER = ELoggerManager::getLogger("EWhitelistFilter");
 
+EWhitelistFilter::~EWhitelistFilter() {
+	if (watcher != null) {
+		watcher->stop();
+	}
+}
+
+EWhitelistFilter::EWhitelistFilter() : whitelist(new ESubnetTrie()) {
+}
+
 EWhitelistFilter* EWhitelistFilter::setWhitelist(EA<EInetAddress*>* addresses) {
 	if (addresses == null) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "addresses");
 	}
 
-	whitelist.clear();
-
-	for (int i = 0; i < addresses->length(); i++) {
-		EInetAddress* addr = (*addresses)[i];
-		allow(addr);
+	ESubnetTrie* trie = new ESubnetTrie();
+	try {
+		for (int i = 0; i < addresses->length(); i++) {
+			EInetAddress* addr = (*addresses)[i];
+			if (addr == null) {
+				throw EIllegalArgumentException(__FILE__, __LINE__, "Adress to allow can not be null");
+			}
+			ESubnet subnet(addr, 32);
+			trie->add(&subnet);
+		}
+	} catch (...) {
+		delete trie;
+		throw;
 	}
 
-	return this;
+	return setSubnetWhitelist(trie);
 }
 
 EWhitelistFilter* EWhitelistFilter::setSubnetWhitelist(EA<ESubnet*>* subnets) {
@@ -32,14 +49,17 @@ EWhitelistFilter* EWhitelistFilter::setSubnetWhitelist(EA<ESubnet*>* subnets) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnets must not be null");
 	}
 
-	whitelist.clear();
-
-	for (int i = 0; i < subnets->length(); i++) {
-		ESubnet* subnet = (*subnets)[i];
-		allow(subnet);
+	ESubnetTrie* trie = new ESubnetTrie();
+	try {
+		for (int i = 0; i < subnets->length(); i++) {
+			trie->add((*subnets)[i]);
+		}
+	} catch (...) {
+		delete trie;
+		throw;
 	}
 
-	return this;
+	return setSubnetWhitelist(trie);
 }
 
 EWhitelistFilter* EWhitelistFilter::setWhitelist(EIterable<EInetAddress*>* addresses) {
@@ -47,14 +67,23 @@ EWhitelistFilter* EWhitelistFilter::setWhitelist(EIterable<EInetAddress*>* addre
 		throw EIllegalArgumentException(__FILE__, __LINE__, "addresses");
 	}
 
-	whitelist.clear();
-
-	sp<EIterator<EInetAddress*> > iter = addresses->iterator();
-	while (iter->hasNext()) {
-		allow(iter->next());
+	ESubnetTrie* trie = new ESubnetTrie();
+	try {
+		sp<EIterator<EInetAddress*> > iter = addresses->iterator();
+		while (iter->hasNext()) {
+			EInetAddress* addr = iter->next();
+			if (addr == null) {
+				throw EIllegalArgumentException(__FILE__, __LINE__, "Adress to allow can not be null");
+			}
+			ESubnet subnet(addr, 32);
+			trie->add(&subnet);
+		}
+	} catch (...) {
+		delete trie;
+		throw;
 	}
 
-	return this;
+	return setSubnetWhitelist(trie);
 }
 
 EWhitelistFilter* EWhitelistFilter::setSubnetWhitelist(EIterable<ESubnet*>* subnets) {
@@ -62,12 +91,42 @@ EWhitelistFilter* EWhitelistFilter::setSubnetWhitelist(EIterable<ESubnet*>* subn
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnets must not be null");
 	}
 
-	whitelist.clear();
+	ESubnetTrie* trie = new ESubnetTrie();
+	try {
+		sp<EIterator<ESubnet*> > iter = subnets->iterator();
+		while (iter->hasNext()) {
+			trie->add(iter->next());
+		}
+	} catch (...) {
+		delete trie;
+		throw;
+	}
 
-	sp<EIterator<ESubnet*> > iter = subnets->iterator();
-	while (iter->hasNext()) {
-		allow(iter->next());
+	return setSubnetWhitelist(trie);
+}
+
+EWhitelistFilter* EWhitelistFilter::setSubnetWhitelist(ESubnetTrie* subnets) {
+	if (subnets == null) {
+		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnets must not be null");
+	}
+
+	SYNCBLOCK(&updateLock) {
+		whitelist.publish(subnets);
+    }}
+
+	return this;
+}
+
+EWhitelistFilter* EWhitelistFilter::watchWhitelistFile(const char* path, int intervalMillis) {
+	ESubnetFileWatcher* fw = new ESubnetFileWatcher(path, intervalMillis, [this](ESubnetTrie* subnets){
+		this->setSubnetWhitelist(subnets);
+	});
+	sp<ESubnetFileWatcher> old = watcher;
+	watcher = fw;
+	if (old != null) {
+		old->stop();
 	}
+	fw->start();
 
 	return this;
 }
@@ -77,7 +136,8 @@ EWhitelistFilter* EWhitelistFilter::allow(EInetAddress* address) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Adress to allow can not be null");
 	}
 
-	whitelist.add(new ESubnet(address, 32));
+	ESubnet subnet(address, 32);
+	update(&subnet, true);
 
 	return this;
 }
@@ -92,7 +152,7 @@ EWhitelistFilter* EWhitelistFilter::allow(ESubnet* subnet) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnet can not be null");
 	}
 
-	whitelist.add(new ESubnet(*subnet));
+	update(subnet, true);
 
 	return this;
 }
@@ -103,7 +163,7 @@ EWhitelistFilter* EWhitelistFilter::disallow(EInetAddress* address) {
 	}
 
 	ESubnet subnet(address, 32);
-	whitelist.remove(&subnet);
+	update(&subnet, false);
 
 	return this;
 }
@@ -118,7 +178,7 @@ EWhitelistFilter* EWhitelistFilter::disallow(ESubnet* subnet) {
 		throw EIllegalArgumentException(__FILE__, __LINE__, "Subnet can not be null");
 	}
 
-	whitelist.remove(subnet);
+	update(subnet, false);
 
 	return this;
 }
@@ -137,24 +197,22 @@ boolean EWhitelistFilter::sessionCreated(EIoFilter::NextFilter* nextFilter,
 	}
 }
 
-boolean EWhitelistFilter::isAllowed(EIoSession* session) {
-	EInetSocketAddress* remoteAddress = session->getRemoteAddress();
-
-	//if (remoteAddress instanceof InetSocketAddress)
-	{
-		EInetAddress* address = remoteAddress->getAddress();
-
-		// check all subnets
-		sp<EIterator<sp<ESubnet> > > iter = whitelist.iterator();
-		while (iter->hasNext()) {
-			sp<ESubnet> subnet = iter->next();
-			if (subnet->inSubnet(address)) {
-				return true;
-			}
+void EWhitelistFilter::update(ESubnet* subnet, boolean add) {
+	// copy on write, readers keep the old snapshot until they finished.
+	SYNCBLOCK(&updateLock) {
+		ESubnetTrie* trie = whitelist.read()->clone();
+		if (add) {
+			trie->add(subnet);
+		} else {
+			trie->remove(subnet);
 		}
-	}
+		whitelist.publish(trie);
+    }}
+}
 
-	return false;
+boolean EWhitelistFilter::isAllowed(EIoSession* session) {
+	// longest prefix match of the peer, IPv4 or IPv6, on current snapshot, lock free.
+	return whitelist.read()->contains(session);
 }
 
 } /* namespace naf */
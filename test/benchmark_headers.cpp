@@ -0,0 +1,149 @@
+#include "es_main.h"
+#include "ENaf.hh"
+
+#include "http_parser/http_parser.h"
+
+#include "../http/source/header_map_impl.h"
+
+using namespace efc::naf::Http;
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+#define ROUNDS 1000000
+
+/**
+ * Parses a typical browser request and encodes its headers back to
+ * HTTP/1.1, like the codec does, and reports the time per request.
+ *
+ *   ./benchmark_headers
+ */
+
+static const char REQUEST[] =
+	"GET /static/js/app.4f2a9c.js?v=20181117 HTTP/1.1\r\n"
+	"Host: www.example.com\r\n"
+	"Connection: keep-alive\r\n"
+	"Pragma: no-cache\r\n"
+	"Cache-Control: no-cache\r\n"
+	"Upgrade-Insecure-Requests: 1\r\n"
+	"User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_14_1) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/70.0.3538.102 Safari/537.36\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,image/apng,*/*;q=0.8\r\n"
+	"Referer: https://www.example.com/index.html\r\n"
+	"Accept-Encoding: gzip, deflate, br\r\n"
+	"Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+	"Cookie: _ga=GA1.2.1523459870.1541577812; _gid=GA1.2.1178943245.1542357801; session=9f8e7d6c5b4a39281706f5e4d3c2b1a0; theme=dark; lang=zh-CN\r\n"
+	"If-None-Match: W/\"5be8f0a2-1c2f\"\r\n"
+	"If-Modified-Since: Mon, 12 Nov 2018 03:15:14 GMT\r\n"
+	"\r\n";
+
+class Parser {
+public:
+	HeaderMapImplPtr headers;
+	HeaderString field;
+	HeaderString value;
+	bool inValue;
+
+	Parser() : inValue(false) {
+		http_parser_init(&parser, HTTP_REQUEST);
+		parser.data = this;
+	}
+
+	HeaderMapImplPtr parse(const char* data, size_t length) {
+		http_parser_init(&parser, HTTP_REQUEST);
+		headers = new HeaderMapImpl();
+		http_parser_execute(&parser, &settings, data, length);
+		HeaderMapImplPtr out = headers;
+		headers = null;
+		return out;
+	}
+
+private:
+	http_parser parser;
+	static http_parser_settings settings;
+
+	void complete() {
+		if (!field.empty()) {
+			char* p = field.buffer();
+			for (uint32_t i = 0; i < field.size(); i++) {
+				p[i] = tolower(p[i]);
+			}
+			headers->addViaMove(std::move(field), std::move(value));
+		}
+		inValue = false;
+	}
+
+	static int onHeaderField(http_parser* p, const char* at, size_t length) {
+		Parser* self = static_cast<Parser*>(p->data);
+		if (self->inValue) {
+			self->complete();
+		}
+		self->field.append(at, length);
+		return 0;
+	}
+
+	static int onHeaderValue(http_parser* p, const char* at, size_t length) {
+		Parser* self = static_cast<Parser*>(p->data);
+		self->inValue = true;
+		self->value.append(at, length);
+		return 0;
+	}
+
+	static int onHeadersComplete(http_parser* p) {
+		static_cast<Parser*>(p->data)->complete();
+		return 0;
+	}
+};
+
+http_parser_settings Parser::settings = {
+	NULL, NULL, NULL, // on_message_begin, on_url, on_status
+	Parser::onHeaderField,
+	Parser::onHeaderValue,
+	Parser::onHeadersComplete,
+	NULL, NULL, NULL, NULL
+};
+
+static HeaderMap::Iterate encodeHeader(const HeaderEntry& header, void* context) {
+	EIoBuffer* out = static_cast<EIoBuffer*>(context);
+	out->put(header.key().c_str(), header.key().size());
+	out->put(": ", 2);
+	out->put(header.value().c_str(), header.value().size());
+	out->put("\r\n", 2);
+	return HeaderMap::Iterate::Continue;
+}
+
+MAIN_IMPL(testnaf_benchmark_headers) {
+	ESystem::init(argc, argv);
+
+	try {
+		Parser parser;
+		sp<EIoBuffer> out = EIoBuffer::allocate(4096)->setAutoExpand(true);
+		uint64_t bytes = 0;
+		int headers = 0;
+
+		llong t1 = ESystem::nanoTime();
+		for (int i = 0; i < ROUNDS; i++) {
+			HeaderMapImplPtr map = parser.parse(REQUEST, sizeof(REQUEST) - 1);
+			if (!map->Host() || !map->UserAgent()) {
+				throw EIllegalStateException(__FILE__, __LINE__, "Missing inline headers");
+			}
+			headers = map->size();
+			bytes += map->byteSize();
+
+			out->clear();
+			map->iterate(encodeHeader, out.get());
+		}
+		llong t2 = ESystem::nanoTime();
+
+		LOG("%d headers, %d bytes encoded, %.1f ns/request (parse + encode), checksum=%llu",
+				headers, out->position(), (double)(t2 - t1) / ROUNDS, bytes);
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+	}
+	catch (...) {
+		printf("catch all...\n");
+	}
+
+	ESystem::exit(0);
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+#include "es_main.h"
+#include "ENaf.hh"
+#include "../inc/EHttpAcceptor.hh"
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+/**
+ * Plaintext hello world server for a load generator, e.g. for 10k
+ * keep-alive clients on a 64 cores host:
+ *
+ *   ./benchmark_http workers=128 capacity=1000 &
+ *   wrk -t64 -c10000 -d60s --latency http://127.0.0.1:8080/
+ *
+ * Run it once per mode to compare them (add a wrk pipelining script to
+ * see the batching of the pipelined responses):
+ *
+ *   for m in inline fiber thread; do
+ *     ./benchmark_http mode=$m & sleep 1
+ *     wrk -t8 -c256 -d30s --latency http://127.0.0.1:8080/
+ *     kill -INT %1; wait
+ *   done
+ *
+ * Count the write syscalls per request of h2c traffic. The frames of a
+ * send are handed to the session as one buffer chain, which should take
+ * one writev unless the socket buffer is full; not measured yet:
+ *
+ *   strace -c -f -e trace=write,writev ./benchmark_http &
+ *   h2load -n100000 -c100 -m10 http://127.0.0.1:8080/
+ *
+ * Compare the handler path with the response cache, and the 304s of
+ * the conditional requests:
+ *
+ *   ./benchmark_http cache=1000 &
+ *   wrk -t8 -c256 -d30s -H 'If-None-Match: "6ef05bd7cc857c54"' http://127.0.0.1:8080/
+ *
+ * Arguments:
+ *   mode=M       inline: handle in the io fiber,
+ *                fiber: worker fibers (default),
+ *                thread: worker threads, detached read and write.
+ *   workers=N    request workers, default EHttpAcceptor::WORKERS.
+ *   capacity=N   request queue capacity per io thread.
+ *   depth=N      max pipelined requests in flight per connection.
+ *   cache=N      cache the responses for N ms, default 0 for none.
+ */
+
+static EHttpAcceptor* g_sa = NULL;
+static EHttpResponseCache* g_cache = NULL;
+
+#define HELLO "Hello, World!"
+
+class HelloHandler : public EHttpHandler {
+public:
+	virtual void doGet(sp<EHttpSession>& session, sp<EHttpRequest>& request, sp<EHttpResponse>& response) {
+		response->getHeaderMap().addReferenceKey(Headers::get().ContentLength, sizeof(HELLO) - 1);
+		response->write(HELLO, sizeof(HELLO) - 1);
+	}
+};
+
+static void onListening(ESocketAcceptor* acceptor) {
+	EHttpAcceptor* ha = dynamic_cast<EHttpAcceptor*>(acceptor);
+	while (!acceptor->isDisposed()) {
+		sleep(10);
+
+		EIoServiceStatistics* ss = acceptor->getStatistics();
+		LOG("sessions=%d, read msgs/s=%lf, written msgs/s=%lf, stolen requests=%lld",
+				acceptor->getManagedSessionCount(),
+				ss->getReadMessagesThroughput(), ss->getWrittenMessagesThroughput(),
+				ha->getStolenRequestCount());
+		if (g_cache) {
+			LOG("cache hits=%lld, misses=%lld, not modified=%lld", g_cache->getHitCount(),
+					g_cache->getMissCount(), g_cache->getNotModifiedCount());
+		}
+	}
+}
+
+static int intArgument(const char* name, int defaultValue) {
+	EString value = ESystem::getProgramArgument(name);
+	return value.isEmpty() ? defaultValue : EInteger::parseInt(value.c_str());
+}
+
+static void sigfunc(int sig_no) {
+	LOG("signaled.");
+	g_sa->shutdown();
+}
+
+MAIN_IMPL(benchmark_http) {
+	ESystem::init(argc, argv);
+	ELoggerManager::init("log4e.conf");
+
+	signal(SIGINT, sigfunc);
+
+	try {
+		EString mode = ESystem::getProgramArgument("mode");
+		if (mode.isEmpty()) {
+			mode = "fiber";
+		}
+		boolean detached = mode.equals("thread");
+
+		EHttpAcceptor sa(detached, detached);
+		g_sa = &sa;
+
+		HelloHandler handler;
+		sa.setInlineHandling(mode.equals("inline"));
+		sa.setWorkers(intArgument("workers", EHttpAcceptor::WORKERS),
+				intArgument("capacity", EHttpAcceptor::QUEUE_CAPACITY));
+		sa.setMaxPipelineDepth(intArgument("depth", Http::Http1Settings::DEFAULT_MAX_PIPELINE_DEPTH));
+		sa.setListeningHandler(onListening);
+		sa.setReuseAddress(true);
+		sa.setBacklog(10240);
+		sa.setMaxConnections(20000);
+		sa.setHttpHandler(&handler);
+		int ttl = intArgument("cache", 0);
+		EHttpResponseCache cache(64 * 1024 * 1024, ES_MAX(ttl, 1));
+		if (ttl > 0) {
+			g_cache = &cache;
+			sa.setResponseCache(&cache);
+		}
+		sa.bind("0.0.0.0", 8080);
+
+		LOG("mode=%s, workers=%d", mode.c_str(), sa.isInlineHandling() ? 0 : sa.getWorkers());
+		sa.listen();
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+	}
+
+	ESystem::exit(0);
+
+	return 0;
+}
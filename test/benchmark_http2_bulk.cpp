@@ -0,0 +1,122 @@
+#include "es_main.h"
+#include "ENaf.hh"
+#include "../inc/EHttpAcceptor.hh"
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+/**
+ * Bulk transfer server to compare the HTTP/2 flow control settings over
+ * a high latency link, emulated by netem on the loopback:
+ *
+ *   tc qdisc add dev lo root netem delay 50ms rate 1gbit
+ *
+ *   for w in 65535 1048576 16777216; do
+ *     ./benchmark_http2_bulk window=$w & sleep 1
+ *     h2load -n8 -c1 -m8 http://127.0.0.1:8080/          # downloads
+ *     h2load -n8 -c1 -m8 -d body.bin http://127.0.0.1:8080/  # uploads
+ *     kill -INT %1; wait
+ *   done
+ *
+ *   tc qdisc del dev lo root
+ *
+ * A stream moves at most one window per round trip, 64k per 100ms is
+ * about 5Mbit/s whatever the link.
+ *
+ * With flush=1 the download is flushed chunk by chunk without a
+ * content-length, the first byte comes at once and the memory of the
+ * server stays at the flush watermark per stream:
+ *
+ *   ./benchmark_http2_bulk flush=1 size=1024 &
+ *   curl -so /dev/null -w '%{time_starttransfer} %{time_total}\n' http://127.0.0.1:8080/
+ *
+ * Arguments:
+ *   size=N        the download body in MiB, default 64.
+ *   window=N      initial stream window, default Http2Settings's.
+ *   connection=N  initial connection window, default Http2Settings's.
+ *   threshold=N   window update threshold in percent.
+ *   flush=N       1 to stream the download by flush(), default 0.
+ */
+
+static EHttpAcceptor* g_sa = NULL;
+
+static int intArgument(const char* name, int defaultValue) {
+	EString value = ESystem::getProgramArgument(name);
+	return value.isEmpty() ? defaultValue : EInteger::parseInt(value.c_str());
+}
+
+class BulkHandler : public EHttpHandler {
+public:
+	BulkHandler(int size, boolean streamed) : size(size), streamed(streamed) {
+		chunk = EIoBuffer::allocate(CHUNK_SIZE);
+		memset(chunk->current(), 'x', CHUNK_SIZE);
+	}
+
+	virtual void doGet(sp<EHttpSession>& session, sp<EHttpRequest>& request, sp<EHttpResponse>& response) {
+		if (!streamed) {
+			response->getHeaderMap().addReferenceKey(Headers::get().ContentLength, (uint64_t)size);
+		}
+		for (int n = 0; n < size; n += CHUNK_SIZE) {
+			response->write(chunk->current(), ES_MIN(CHUNK_SIZE, size - n));
+			if (streamed) {
+				response->flush();
+			}
+		}
+	}
+
+	virtual void doPost(sp<EHttpSession>& session, sp<EHttpRequest>& request, sp<EHttpResponse>& response) {
+		// the body is streamed, its chunks are dropped once counted.
+		llong received = 0;
+		sp<EIoBuffer> chunk;
+		while ((chunk = request->read()) != null) {
+			received += chunk->remaining();
+		}
+		EString reply = EString::formatOf("%lld\n", received);
+		response->getHeaderMap().addReferenceKey(Headers::get().ContentLength, (uint64_t)reply.length());
+		response->write(reply.c_str(), reply.length());
+	}
+
+private:
+	static const int CHUNK_SIZE = 64 * 1024;
+
+	int size;
+	boolean streamed;
+	sp<EIoBuffer> chunk;
+};
+
+static void sigfunc(int sig_no) {
+	LOG("signaled.");
+	g_sa->shutdown();
+}
+
+MAIN_IMPL(benchmark_http2_bulk) {
+	ESystem::init(argc, argv);
+	ELoggerManager::init("log4e.conf");
+
+	signal(SIGINT, sigfunc);
+
+	try {
+		Http::Http2Settings http2;
+		http2.initial_stream_window_size_ = intArgument("window", http2.initial_stream_window_size_);
+		http2.initial_connection_window_size_ = intArgument("connection", http2.initial_connection_window_size_);
+		http2.window_update_threshold_ = intArgument("threshold", http2.window_update_threshold_);
+
+		EHttpAcceptor sa;
+		g_sa = &sa;
+
+		BulkHandler handler(intArgument("size", 64) * 1024 * 1024, intArgument("flush", 0) != 0);
+		sa.setReuseAddress(true);
+		sa.setHttpHandler(&handler);
+		sa.bind("0.0.0.0", 8080, http2);
+
+		LOG("window=%u, connection=%u, threshold=%u%%", http2.initial_stream_window_size_,
+				http2.initial_connection_window_size_, http2.window_update_threshold_);
+		sa.listen();
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+	}
+
+	ESystem::exit(0);
+
+	return 0;
+}
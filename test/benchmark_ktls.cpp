@@ -0,0 +1,147 @@
+#include "es_main.h"
+#include "ENaf.hh"
+
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+#define FILE_PATH   "/tmp/benchmark_ktls.dat"
+#define FILE_SIZE   (64 * 1024 * 1024)
+#define REQUESTS    32
+
+static volatile boolean g_listening = false;
+
+static void onListening(ESocketAcceptor* acceptor) {
+	g_listening = true;
+}
+
+static void onConnection(sp<ESocketSession>& session, ESocketAcceptor::Service* service) {
+	// any request gets the file.
+	while (session->read() != null) {
+		sp<EFile> file = new EFile(FILE_PATH);
+		session->write(file);
+	}
+}
+
+static void makeFile() {
+	EFile file(FILE_PATH);
+	if (file.exists() && file.length() == FILE_SIZE) {
+		return;
+	}
+	EFileOutputStream fos(&file);
+	char buf[65536];
+	for (int i = 0; i < (int)sizeof(buf); i++) {
+		buf[i] = (char)(i * 31);
+	}
+	for (int i = 0; i < FILE_SIZE / (int)sizeof(buf); i++) {
+		fos.write(buf, sizeof(buf));
+	}
+}
+
+/**
+ * A plain OpenSSL client out of the fiber scheduler.
+ */
+static void runClient(ESocketAcceptor* sa, int port, double* mbps) {
+	while (!g_listening) {
+		usleep(10000);
+	}
+
+	SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+	ON_SCOPE_EXIT(
+		SSL_CTX_free(ctx);
+	);
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		LOG("connect failed: %d", errno);
+		close(fd);
+		sa->shutdown();
+		return;
+	}
+
+	SSL* ssl = SSL_new(ctx);
+	SSL_set_fd(ssl, fd);
+	if (SSL_connect(ssl) != 1) {
+		LOG("SSL_connect failed.");
+	} else {
+		char buf[65536];
+		llong total = 0;
+		llong t1 = ESystem::nanoTime();
+		for (int i = 0; i < REQUESTS; i++) {
+			SSL_write(ssl, "GET\n", 4);
+			llong received = 0;
+			while (received < FILE_SIZE) {
+				int n = SSL_read(ssl, buf, sizeof(buf));
+				if (n <= 0) {
+					break;
+				}
+				received += n;
+			}
+			total += received;
+		}
+		llong t2 = ESystem::nanoTime();
+		*mbps = (double)total / (1024 * 1024) / ((t2 - t1) / 1000000000.0);
+		LOG("cipher=%s, received %lld bytes in %lld ms", SSL_get_cipher_name(ssl), total, (t2 - t1) / 1000000);
+		SSL_shutdown(ssl);
+	}
+	SSL_free(ssl);
+	close(fd);
+
+	sa->shutdown();
+}
+
+static double test_throughput(boolean ktls, int port) {
+	double mbps = 0.0;
+
+	g_listening = false;
+
+	ESocketAcceptor sa;
+	sa.setListeningHandler(onListening);
+	sa.setConnectionHandler(onConnection);
+	sa.setSSLKernelOffload(ktls);
+	sa.bind("127.0.0.1", port, true, "ktls", [](ESocketAcceptor::Service& service){
+		sp<ESSLServerSocket> sss = dynamic_pointer_cast<ESSLServerSocket>(service.ss);
+		sss->setSSLParameters(
+					"./certs/tests-cert.pem",
+					"./certs/tests-key.pem",
+					null);
+	});
+
+	std::thread client(runClient, &sa, port, &mbps);
+	sa.listen();
+	client.join();
+
+	EIoServiceStatistics* ss = sa.getStatistics();
+	LOG("ktls=%s: %.1f MB/s, kernel sessions=%lld, fallback sessions=%lld",
+			ktls ? "on" : "off", mbps, ss->getKernelTLSCount(), ss->getKernelTLSFallbackCount());
+	return mbps;
+}
+
+MAIN_IMPL(benchmark_ktls) {
+	ESystem::init(argc, argv);
+	ELoggerManager::init("log4e.conf");
+
+	try {
+		makeFile();
+
+		double user = test_throughput(false, 8893);
+		double kernel = test_throughput(true, 8894);
+		LOG("speedup: %.2fx", (user > 0) ? kernel / user : 0.0);
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+	}
+
+	ESystem::exit(0);
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+#include "es_main.h"
+#include "ENaf.hh"
+#include "../inc/EHttpRouter.hh"
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+#define ROUNDS 1000000
+
+/**
+ * Looks up paths in routers of 10 to 5000 routes and reports the time
+ * per lookup, which depends on the path and not on the route count:
+ *
+ *   ./benchmark_router
+ *
+ * A quarter of the routes each are static, with a parameter, with two
+ * and with a wildcard, the looked up paths match one of each.
+ */
+
+static int lastOf(int count, int kind) {
+	return ((count - 1 - kind) / 4) * 4 + kind;
+}
+
+static void addRoutes(EHttpRouter& router, int count) {
+	EHttpRouter::Handler handler = [](sp<EHttpSession>&, sp<EHttpRequest>&, sp<EHttpResponse>&) {};
+	for (int i = 0; i < count; i++) {
+		EString pattern;
+		switch (i % 4) {
+		case 0:
+			pattern = EString::formatOf("/api/v1/service%d/status", i);
+			break;
+		case 1:
+			pattern = EString::formatOf("/api/v1/users%d/:id", i);
+			break;
+		case 2:
+			pattern = EString::formatOf("/api/v1/users%d/:id/posts/:post", i);
+			break;
+		default:
+			pattern = EString::formatOf("/static/bundle%d/*file", i);
+			break;
+		}
+		router.add(Http::Method::Get, pattern.c_str(), handler);
+	}
+}
+
+MAIN_IMPL(testnaf_benchmark_router) {
+	ESystem::init(argc, argv);
+
+	try {
+		static const int counts[] = {10, 100, 1000, 5000};
+
+		for (int count : counts) {
+			EHttpRouter router;
+			addRoutes(router, count);
+
+			// the last routes of each kind, the deepest in a linear scan.
+			EString paths[] = {
+				EString::formatOf("/api/v1/service%d/status", lastOf(count, 0)),
+				EString::formatOf("/api/v1/users%d/12345", lastOf(count, 1)),
+				EString::formatOf("/api/v1/users%d/12345/posts/678?page=2", lastOf(count, 2)),
+				EString::formatOf("/static/bundle%d/js/app.4f2a9c.js", lastOf(count, 3))
+			};
+
+			int found = 0;
+			llong t1 = ESystem::nanoTime();
+			for (int i = 0; i < ROUNDS; i++) {
+				EString& path = paths[i & 3];
+				if (router.find(Http::Method::Get, path.c_str(), path.length())) {
+					found++;
+				}
+			}
+			llong t2 = ESystem::nanoTime();
+
+			if (found != ROUNDS) {
+				throw EIllegalStateException(__FILE__, __LINE__, "Missing routes");
+			}
+			LOG("routes=%d, %.1f ns/lookup", router.size(), (double)(t2 - t1) / ROUNDS);
+		}
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+	}
+	catch (...) {
+		printf("catch all...\n");
+	}
+
+	ESystem::exit(0);
+
+	return 0;
+}
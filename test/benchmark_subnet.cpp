@@ -0,0 +1,108 @@
+#include "es_main.h"
+#include "ENaf.hh"
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+#define PREFIXES 1000000
+#define LOOKUPS  10000000
+#define LINEAR_PREFIXES 10000
+#define LINEAR_LOOKUPS  10000
+
+static llong g_seed = 88172645463325252LL;
+
+static inline ullong nextRandom() {
+	// xorshift64
+	g_seed ^= g_seed << 13;
+	g_seed ^= (ullong)g_seed >> 7;
+	g_seed ^= g_seed << 17;
+	return (ullong)g_seed;
+}
+
+static void randomAddress(byte* address, int length) {
+	for (int i = 0; i < length; i += 8) {
+		ullong r = nextRandom();
+		memcpy(address + i, &r, ES_MIN(8, length - i));
+	}
+}
+
+static ESubnet* randomSubnet() {
+	byte address[16];
+	// 70% IPv4 /8-/32 and 30% IPv6 /16-/64 like a real abuse list.
+	if (nextRandom() % 10 < 7) {
+		randomAddress(address, 4);
+		return new ESubnet(address, 4, 8 + nextRandom() % 25);
+	} else {
+		randomAddress(address, 16);
+		return new ESubnet(address, 16, 16 + nextRandom() % 49);
+	}
+}
+
+static void test_trie() {
+	ESubnetTrie trie;
+
+	llong t1 = ESystem::nanoTime();
+	for (int i = 0; i < PREFIXES; i++) {
+		ESubnet* subnet = randomSubnet();
+		trie.add(subnet);
+		delete subnet;
+	}
+	llong t2 = ESystem::nanoTime();
+	LOG("trie build: %d prefixes in %lld ms", trie.size(), (t2 - t1) / 1000000);
+
+	byte address[16];
+	int hits = 0;
+	t1 = ESystem::nanoTime();
+	for (int i = 0; i < LOOKUPS; i++) {
+		int length = (i & 3) ? 4 : 16;
+		randomAddress(address, length);
+		if (trie.contains(address, length)) {
+			hits++;
+		}
+	}
+	t2 = ESystem::nanoTime();
+	LOG("trie lookup: %d lookups, %d hits, %.1f ns/lookup", LOOKUPS, hits, (double)(t2 - t1) / LOOKUPS);
+}
+
+static void test_linear() {
+	EArrayList<ESubnet*> list;
+	for (int i = 0; i < LINEAR_PREFIXES; i++) {
+		list.add(randomSubnet());
+	}
+
+	byte address[16];
+	int hits = 0;
+	llong t1 = ESystem::nanoTime();
+	for (int i = 0; i < LINEAR_LOOKUPS; i++) {
+		int length = (i & 3) ? 4 : 16;
+		randomAddress(address, length);
+		for (int j = 0; j < list.size(); j++) {
+			if (list.getAt(j)->inSubnet(address, length)) {
+				hits++;
+				break;
+			}
+		}
+	}
+	llong t2 = ESystem::nanoTime();
+	double ns = (double)(t2 - t1) / LINEAR_LOOKUPS;
+	LOG("linear lookup: %d prefixes, %.1f ns/lookup, ~%.1f ns/lookup extrapolated to %d prefixes",
+			LINEAR_PREFIXES, ns, ns * (PREFIXES / LINEAR_PREFIXES), PREFIXES);
+}
+
+MAIN_IMPL(testnaf_benchmark_subnet) {
+	ESystem::init(argc, argv);
+
+	try {
+		test_trie();
+		test_linear();
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+	}
+	catch (...) {
+		printf("catch all...\n");
+	}
+
+	ESystem::exit(0);
+
+	return 0;
+}
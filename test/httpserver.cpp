@@ -128,7 +128,6 @@ static void test_echo_server() {
 						"./certs/tests-cert.pem",
 						"./certs/tests-key.pem",
 						null);
-			sss->setNegotiatedProtocols("h2", "http/1.1", NULL);
 		}
 	});
 	sa.listen();
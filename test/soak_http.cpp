@@ -0,0 +1,175 @@
+#include "es_main.h"
+#include "ENaf.hh"
+#include "../inc/EHttpAcceptor.hh"
+
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+#define PORT 8895
+
+/**
+ * Sends millions of requests over one keep-alive connection and logs the
+ * resident memory of the process, which must stay flat once the stream
+ * free list is warm:
+ *
+ *   ./soak_http requests=10000000 batch=16
+ *
+ * For HTTP/2 run the server alone and load it with h2load, one
+ * connection with many streams, and watch the logged memory:
+ *
+ *   ./soak_http requests=0 &
+ *   h2load -n10000000 -c1 -m100 http://127.0.0.1:8895/
+ *
+ * Arguments:
+ *   requests=N   the requests of the built in HTTP/1.1 client, 0 for none.
+ *   batch=N      pipelined requests per write.
+ */
+
+#define HELLO "Hello, World!"
+
+static volatile boolean g_listening = false;
+
+class HelloHandler : public EHttpHandler {
+public:
+	virtual void doGet(sp<EHttpSession>& session, sp<EHttpRequest>& request, sp<EHttpResponse>& response) {
+		response->getHeaderMap().addReferenceKey(Headers::get().ContentLength, sizeof(HELLO) - 1);
+		response->write(HELLO, sizeof(HELLO) - 1);
+	}
+};
+
+static int intArgument(const char* name, int defaultValue) {
+	EString value = ESystem::getProgramArgument(name);
+	return value.isEmpty() ? defaultValue : EInteger::parseInt(value.c_str());
+}
+
+static long residentKB() {
+	long pages = 0, resident = 0;
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (f) {
+		if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+			resident = 0;
+		}
+		fclose(f);
+	}
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void onListening(ESocketAcceptor* acceptor) {
+	g_listening = true;
+	while (!acceptor->isDisposed()) {
+		sleep(10);
+		LOG("sessions=%d, rss=%ld KB", acceptor->getManagedSessionCount(), residentKB());
+	}
+}
+
+/**
+ * A plain socket client out of the fiber scheduler.
+ */
+static void runClient(ESocketAcceptor* sa, int requests, int batch) {
+	while (!g_listening) {
+		usleep(10000);
+	}
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(PORT);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		LOG("connect failed: %d", errno);
+		close(fd);
+		sa->shutdown();
+		return;
+	}
+
+	static const char REQUEST[] = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+	static const char RESPONSE_END[] = HELLO;
+
+	EByteBuffer out;
+	for (int i = 0; i < batch; i++) {
+		out.append(REQUEST, sizeof(REQUEST) - 1);
+	}
+
+	char buf[65536];
+	long rss0 = 0;
+	llong t1 = ESystem::nanoTime();
+	for (int sent = 0; sent < requests; sent += batch) {
+		if (write(fd, out.data(), out.size()) != (ssize_t)out.size()) {
+			LOG("write failed: %d", errno);
+			break;
+		}
+
+		// a response ends with the body, count the bodies.
+		int replied = 0;
+		int matched = 0;
+		while (replied < batch) {
+			ssize_t n = read(fd, buf, sizeof(buf));
+			if (n <= 0) {
+				LOG("read failed: %d", errno);
+				requests = sent;
+				break;
+			}
+			for (ssize_t i = 0; i < n; i++) {
+				matched = (buf[i] == RESPONSE_END[matched]) ? matched + 1 : (buf[i] == RESPONSE_END[0]);
+				if (matched == (int)sizeof(RESPONSE_END) - 1) {
+					replied++;
+					matched = 0;
+				}
+			}
+		}
+
+		if (sent % 1000000 < batch) {
+			long rss = residentKB();
+			if (sent == 0) {
+				rss0 = rss;
+			}
+			LOG("requests=%d, rss=%ld KB (%+ld KB)", sent, rss, rss - rss0);
+		}
+	}
+	llong t2 = ESystem::nanoTime();
+	LOG("%d requests in %lld ms, rss=%ld KB", requests, (t2 - t1) / 1000000, residentKB());
+
+	close(fd);
+	sa->shutdown();
+}
+
+MAIN_IMPL(soak_http) {
+	ESystem::init(argc, argv);
+	ELoggerManager::init("log4e.conf");
+
+	try {
+		int requests = intArgument("requests", 10000000);
+		int batch = ES_MAX(intArgument("batch", 16), 1);
+
+		EHttpAcceptor sa;
+		HelloHandler handler;
+		sa.setListeningHandler(onListening);
+		sa.setReuseAddress(true);
+		sa.setMaxPipelineDepth(batch);
+		sa.setHttpHandler(&handler);
+		sa.bind("127.0.0.1", PORT);
+
+		if (requests > 0) {
+			std::thread client(runClient, &sa, requests, batch);
+			sa.listen();
+			client.join();
+		} else {
+			sa.listen();
+		}
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+	}
+	catch (...) {
+		printf("catch all...\n");
+	}
+
+	ESystem::exit(0);
+
+	return 0;
+}
@@ -0,0 +1,169 @@
+#include "es_main.h"
+#include "ENaf.hh"
+#include "../inc/EHttpAcceptor.hh"
+
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+#define PORT 8896
+
+/**
+ * POSTs bodies to a server which buffers the request bodies and echoes
+ * them, and checks the replies:
+ *
+ *   ./test_buffering
+ *
+ * The bodies are empty, small and larger than a read, the last one is
+ * split over two writes.
+ */
+
+static volatile boolean g_listening = false;
+static volatile boolean g_passed = false;
+
+class EchoHandler : public EHttpHandler {
+public:
+	virtual void doPost(sp<EHttpSession>& session, sp<EHttpRequest>& request, sp<EHttpResponse>& response) {
+		Http::Buffer::LinkedBuffer body = request->getBodyData();
+		llong length = 0;
+		for (auto buf : body) {
+			length += buf->remaining();
+		}
+		response->getHeaderMap().addReferenceKey(Headers::get().ContentLength, (uint64_t)length);
+		for (auto buf : body) {
+			response->write(buf->current(), buf->remaining());
+		}
+	}
+};
+
+static void onListening(ESocketAcceptor* acceptor) {
+	g_listening = true;
+}
+
+static boolean sendFully(int fd, const char* data, size_t size) {
+	while (size > 0) {
+		ssize_t n = send(fd, data, size, 0);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+/**
+ * Reads one response and compares its body.
+ */
+static boolean expectEcho(int fd, const std::string& body) {
+	std::string in;
+	char buf[16384];
+	size_t headersEnd;
+	while ((headersEnd = in.find("\r\n\r\n")) == std::string::npos) {
+		ssize_t n = recv(fd, buf, sizeof(buf), 0);
+		if (n <= 0) {
+			LOG("no response");
+			return false;
+		}
+		in.append(buf, n);
+	}
+
+	std::string headers = in.substr(0, headersEnd);
+	for (auto& c : headers) {
+		c = tolower(c);
+	}
+	size_t p = headers.find("content-length:");
+	if (headers.compare(0, 12, "http/1.1 200") != 0 || p == std::string::npos) {
+		LOG("bad response: %s", headers.c_str());
+		return false;
+	}
+	size_t length = strtoul(headers.c_str() + p + 15, null, 10);
+
+	std::string data = in.substr(headersEnd + 4);
+	while (data.size() < length) {
+		ssize_t n = recv(fd, buf, sizeof(buf), 0);
+		if (n <= 0) {
+			LOG("short body, %d of %d bytes", (int)data.size(), (int)length);
+			return false;
+		}
+		data.append(buf, n);
+	}
+	if (data != body) {
+		LOG("bad body of %d bytes, expected %d", (int)data.size(), (int)body.size());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * A plain socket client out of the fiber scheduler.
+ */
+static void runClient(ESocketAcceptor* sa) {
+	while (!g_listening) {
+		usleep(10000);
+	}
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(PORT);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		LOG("connect failed: %d", errno);
+		close(fd);
+		sa->shutdown();
+		return;
+	}
+
+	std::string bodies[] = {"", "hello", std::string(300 * 1024, 'x')};
+	boolean passed = true;
+	for (auto& body : bodies) {
+		std::string request = EString::formatOf(
+				"POST /echo HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: %d\r\n\r\n",
+				(int)body.size()).c_str();
+		request.append(body);
+
+		// split inside the body.
+		size_t cut = request.size() - body.size() / 2;
+		passed = passed && sendFully(fd, request.data(), cut);
+		usleep(10000);
+		passed = passed && sendFully(fd, request.data() + cut, request.size() - cut);
+		passed = passed && expectEcho(fd, body);
+	}
+	close(fd);
+
+	g_passed = passed;
+	sa->shutdown();
+}
+
+MAIN_IMPL(testnaf_buffering) {
+	ESystem::init(argc, argv);
+	ELoggerManager::init("log4e.conf");
+
+	try {
+		EHttpAcceptor sa;
+		EchoHandler handler;
+		sa.setListeningHandler(onListening);
+		sa.setReuseAddress(true);
+		sa.setRequestBuffering(true);
+		sa.setHttpHandler(&handler);
+		sa.bind("127.0.0.1", PORT);
+
+		std::thread client(runClient, &sa);
+		sa.listen();
+		client.join();
+
+		LOG("buffering %s", g_passed ? "passed" : "FAILED");
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+	}
+
+	ESystem::exit(g_passed ? 0 : 1);
+
+	return 0;
+}
@@ -0,0 +1,191 @@
+#include "es_main.h"
+#include "ENaf.hh"
+
+#include <map>
+#include <mutex>
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+#define PORT 8897
+#define CLIENTS 4
+#define FRAMES 200
+#define QUEUE_CAPACITY 2
+
+/**
+ * Sends numbered frames from several sessions through EExecutorFilter
+ * with a slow handler and a tiny queue, and checks that:
+ *
+ *   ./test_executor
+ *
+ * - the handler sees the frames of each session in order, one at a time,
+ * - the replies come back in order,
+ * - the queue never holds more than its capacity and the reading fibers
+ *   wait for it,
+ * - shutdown() runs the queued frames and joins the workers.
+ */
+
+static volatile boolean g_listening = false;
+static EAtomicInteger g_clientsPassed;
+
+static std::mutex g_orderLock;
+static std::map<llong, int> g_lastFrame; // by session.
+static std::map<llong, int> g_inHandler;
+static volatile boolean g_orderBroken = false;
+
+static void onListening(ESocketAcceptor* acceptor) {
+	g_listening = true;
+}
+
+static void onConnection(sp<ESocketSession>& session, ESocketAcceptor::Service* service) {
+	while (session->read() != null) {
+		// the executor takes the frames, read() returns on close.
+	}
+}
+
+static sp<EObject> handle(sp<ESocketSession>& session, sp<EObject> message) {
+	sp<EIoBuffer> buf = dynamic_pointer_cast<EIoBuffer>(message);
+	int frame = atoi(std::string((const char*)buf->current(), buf->remaining()).c_str());
+
+	{
+		std::lock_guard<std::mutex> guard(g_orderLock);
+		if (g_inHandler[session->getId()]++ > 0) {
+			g_orderBroken = true; // two workers on one session.
+		}
+		auto it = g_lastFrame.find(session->getId());
+		if (frame != (it == g_lastFrame.end() ? 0 : it->second + 1)) {
+			g_orderBroken = true;
+		}
+		g_lastFrame[session->getId()] = frame;
+	}
+
+	usleep(500); // slower than the readers.
+
+	{
+		std::lock_guard<std::mutex> guard(g_orderLock);
+		g_inHandler[session->getId()]--;
+	}
+	return buf;
+}
+
+static void putFrame(std::string& out, const std::string& payload) {
+	uint len = htonl((uint)payload.size());
+	out.append((const char*)&len, 4);
+	out.append(payload);
+}
+
+static boolean recvFully(int fd, char* data, size_t size) {
+	while (size > 0) {
+		ssize_t n = recv(fd, data, size, 0);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+/**
+ * A plain socket client out of the fiber scheduler.
+ */
+static void runClient() {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(PORT);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		LOG("connect failed: %d", errno);
+		close(fd);
+		return;
+	}
+
+	std::string out;
+	for (int i = 0; i < FRAMES; i++) {
+		putFrame(out, std::to_string(i));
+	}
+	if (send(fd, out.data(), out.size(), 0) != (ssize_t)out.size()) {
+		LOG("send failed: %d", errno);
+		close(fd);
+		return;
+	}
+
+	boolean passed = true;
+	for (int i = 0; i < FRAMES && passed; i++) {
+		uint len;
+		char payload[16];
+		passed = recvFully(fd, (char*)&len, 4) && (len = ntohl(len)) < sizeof(payload)
+				&& recvFully(fd, payload, len) && std::string(payload, len) == std::to_string(i);
+		if (!passed) {
+			LOG("reply %d out of order", i);
+		}
+	}
+	close(fd);
+
+	if (passed) {
+		g_clientsPassed.incrementAndGet();
+	}
+}
+
+static void runClients(ESocketAcceptor* sa) {
+	while (!g_listening) {
+		usleep(10000);
+	}
+
+	std::thread clients[CLIENTS];
+	for (int i = 0; i < CLIENTS; i++) {
+		clients[i] = std::thread(runClient);
+	}
+	for (int i = 0; i < CLIENTS; i++) {
+		clients[i].join();
+	}
+	sa->shutdown();
+}
+
+MAIN_IMPL(testnaf_executor) {
+	ESystem::init(argc, argv);
+	ELoggerManager::init("log4e.conf");
+
+	boolean passed = false;
+	try {
+		ELengthFieldCodecFilter codec(4, true, 1024);
+		EExecutorFilter executor(3, QUEUE_CAPACITY);
+		executor.setHandler(handle);
+
+		ESocketAcceptor sa;
+		sa.getFilterChainBuilder()->addLast("frame", &codec);
+		sa.getFilterChainBuilder()->addLast("executor", &executor);
+		sa.setListeningHandler(onListening);
+		sa.setConnectionHandler(onConnection);
+		sa.setReuseAddress(true);
+		sa.bind("127.0.0.1", PORT, false, "executor");
+
+		std::thread client(runClients, &sa);
+		sa.listen();
+		client.join();
+
+		// returns once the workers are joined.
+		executor.shutdown();
+
+		passed = (g_clientsPassed.get() == CLIENTS) && !g_orderBroken
+				&& executor.getCompletedCount() == CLIENTS * FRAMES
+				&& executor.getQueueSize() == 0
+				&& executor.getLargestQueueSize() <= QUEUE_CAPACITY
+				&& executor.getBlockedCount() > 0;
+		LOG("executor %s: clients=%d, order=%s, completed=%lld, largest queue=%d, blocked=%lld",
+				passed ? "passed" : "FAILED", g_clientsPassed.get(), g_orderBroken ? "broken" : "kept",
+				executor.getCompletedCount(), executor.getLargestQueueSize(), executor.getBlockedCount());
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+	}
+
+	ESystem::exit(passed ? 0 : 1);
+
+	return 0;
+}
@@ -0,0 +1,152 @@
+#include "es_main.h"
+#include "ENaf.hh"
+
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+#define PORT 8895
+
+/**
+ * Sends length framed messages through a session of an echo server
+ * with ELengthFieldCodecFilter and checks the frames coming back:
+ *
+ *   ./test_framing
+ *
+ * The frames are sent together, split over two writes and larger than
+ * a socket buffer, the replies are written by the codec as a gather
+ * write of the length field and the payload.
+ */
+
+static volatile boolean g_listening = false;
+static volatile boolean g_passed = false;
+
+static void onListening(ESocketAcceptor* acceptor) {
+	g_listening = true;
+}
+
+static void onConnection(sp<ESocketSession>& session, ESocketAcceptor::Service* service) {
+	sp<EObject> message;
+	while ((message = session->read()) != null) {
+		session->write(message); // framed again by the codec.
+	}
+}
+
+static void putFrame(std::string& out, const std::string& payload) {
+	uint len = htonl((uint)payload.size());
+	out.append((const char*)&len, 4);
+	out.append(payload);
+}
+
+static boolean sendFully(int fd, const char* data, size_t size) {
+	while (size > 0) {
+		ssize_t n = send(fd, data, size, 0);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+static boolean recvFully(int fd, char* data, size_t size) {
+	while (size > 0) {
+		ssize_t n = recv(fd, data, size, 0);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+static boolean expectFrame(int fd, const std::string& payload) {
+	uint len;
+	if (!recvFully(fd, (char*)&len, 4) || ntohl(len) != payload.size()) {
+		LOG("bad length field, expected %d", (int)payload.size());
+		return false;
+	}
+	std::string data(payload.size(), '\0');
+	if (!recvFully(fd, &data[0], data.size()) || data != payload) {
+		LOG("bad payload of %d bytes", (int)payload.size());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * A plain socket client out of the fiber scheduler.
+ */
+static void runClient(ESocketAcceptor* sa) {
+	while (!g_listening) {
+		usleep(10000);
+	}
+
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(PORT);
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		LOG("connect failed: %d", errno);
+		close(fd);
+		sa->shutdown();
+		return;
+	}
+
+	std::string payloads[] = {"hello", "", "framing", std::string(1024 * 1024, 'x'), "split"};
+	std::string out;
+	for (auto& payload : payloads) {
+		putFrame(out, payload);
+	}
+
+	// the last frame is split inside its length field.
+	size_t cut = out.size() - 7;
+	boolean passed = sendFully(fd, out.data(), cut);
+	usleep(10000);
+	passed = passed && sendFully(fd, out.data() + cut, out.size() - cut);
+
+	for (auto& payload : payloads) {
+		passed = passed && expectFrame(fd, payload);
+	}
+	close(fd);
+
+	g_passed = passed;
+	sa->shutdown();
+}
+
+MAIN_IMPL(testnaf_framing) {
+	ESystem::init(argc, argv);
+	ELoggerManager::init("log4e.conf");
+
+	try {
+		ELengthFieldCodecFilter codec(4, true, 4 * 1024 * 1024);
+
+		ESocketAcceptor sa;
+		sa.getFilterChainBuilder()->addLast("frame", &codec);
+		sa.setListeningHandler(onListening);
+		sa.setConnectionHandler(onConnection);
+		sa.bind("127.0.0.1", PORT, false, "framing");
+
+		std::thread client(runClient, &sa);
+		sa.listen();
+		client.join();
+
+		EIoServiceStatistics* ss = sa.getStatistics();
+		LOG("framing %s, written bytes=%lld, written messages=%lld", g_passed ? "passed" : "FAILED",
+				ss->getWrittenBytes(), ss->getWrittenMessages());
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+	}
+
+	ESystem::exit(g_passed ? 0 : 1);
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+#include "es_main.h"
+#include "ENaf.hh"
+#include "../inc/EHttpRouter.hh"
+
+#define LOG(fmt,...) ESystem::out->printfln(fmt, ##__VA_ARGS__)
+
+/**
+ * Checks the precedence of static, parameter and wildcard routes and the
+ * fallback to a less specific route of the method:
+ *
+ *   ./test_router
+ */
+
+static int g_routed = 0;
+static int g_failures = 0;
+
+static EHttpRouter::Handler handlerOf(int id) {
+	return [id](sp<EHttpSession>&, sp<EHttpRequest>&, sp<EHttpResponse>&) {
+		g_routed = id;
+	};
+}
+
+static sp<EHttpRequest> newRequest(Http::Method method, const char* path) {
+	sp<Http::HeaderMapImpl> headers(new Http::HeaderMapImpl());
+	headers->insertPath().value(std::string(path));
+	headers->setMethod(method);
+	return sp<EHttpRequest>(new EHttpRequest(null, headers));
+}
+
+static void expect(EHttpRouter& router, Http::Method method, const char* path,
+		Http::Code code, int id, const char* param=null, const char* value=null) {
+	sp<EHttpSession> session;
+	sp<EHttpResponse> response;
+	sp<EHttpRequest> request = newRequest(method, path);
+
+	g_routed = 0;
+	Http::Code routed = router.route(session, request, response);
+	boolean passed = (routed == code && g_routed == id);
+	if (passed && param) {
+		const EHttpRequest::PathParameter* p = request->getPathParameter(param);
+		passed = p && (int)strlen(value) == p->length && memcmp(value, p->value, p->length) == 0;
+	}
+	if (!passed) {
+		LOG("FAILED: method %d %s, code=%d, route=%d", (int)method, path, (int)routed, g_routed);
+		g_failures++;
+	}
+}
+
+MAIN_IMPL(testnaf_router) {
+	ESystem::init(argc, argv);
+
+	try {
+		EHttpRouter router;
+		router.add(Http::Method::Get, "/users/new", handlerOf(1));
+		router.add(Http::Method::Get, "/users/:id", handlerOf(2));
+		router.add(Http::Method::Delete, "/users/:id", handlerOf(3));
+		router.add(Http::Method::Get, "/users/:id/posts", handlerOf(4));
+		router.add(Http::Method::Get, "/users/*rest", handlerOf(5));
+		router.add(Http::Method::Get, "/files/*path", handlerOf(6));
+
+		// static before parameter before wildcard.
+		expect(router, Http::Method::Get, "/users/new", Http::Code::OK, 1);
+		expect(router, Http::Method::Get, "/users/42", Http::Code::OK, 2, "id", "42");
+		expect(router, Http::Method::Get, "/users/42?page=2", Http::Code::OK, 2, "id", "42");
+		expect(router, Http::Method::Get, "/users/42/posts", Http::Code::OK, 4, "id", "42");
+		expect(router, Http::Method::Get, "/users/42/friends", Http::Code::OK, 5, "rest", "42/friends");
+		expect(router, Http::Method::Get, "/files/", Http::Code::OK, 6, "path", "");
+		expect(router, Http::Method::Get, "/files/css/site.css", Http::Code::OK, 6, "path", "css/site.css");
+
+		// a static node without the method falls back to the parameter.
+		expect(router, Http::Method::Delete, "/users/new", Http::Code::OK, 3, "id", "new");
+
+		// 405 only if some route matches the path, 404 if none.
+		expect(router, Http::Method::Post, "/users/new", Http::Code::MethodNotAllowed, 0);
+		expect(router, Http::Method::Delete, "/users/42/friends", Http::Code::MethodNotAllowed, 0);
+		expect(router, Http::Method::Get, "/groups/1", Http::Code::NotFound, 0);
+		expect(router, Http::Method::Get, "/users", Http::Code::NotFound, 0);
+
+		LOG("router %s, routes=%d", g_failures == 0 ? "passed" : "FAILED", router.size());
+	}
+	catch (EException& e) {
+		e.printStackTrace();
+		g_failures++;
+	}
+
+	ESystem::exit(g_failures == 0 ? 0 : 1);
+
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * tracedecode.cpp
+ *
+ * Offline decoder of EIoTrace dump files, writes Chrome trace JSON
+ * which can be loaded by chrome://tracing or ui.perfetto.dev.
+ *
+ * usage: tracedecode <dump file> [<output json>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// keep in sync with EIoTrace::Type and EIoTrace::Event.
+enum Type {
+	ACCEPT = 1,
+	SESSION_CREATED,
+	SESSION_CLOSED,
+	READ,
+	WRITE,
+	FILTER_ENTER,
+	FILTER_EXIT,
+	STREAM_START,
+	STREAM_END
+};
+
+struct Event {
+	int64_t time;
+	int64_t duration;
+	int64_t arg;
+	int32_t session;
+	int16_t type;
+	int16_t name;
+};
+
+static bool readFully(FILE* f, void* data, size_t size) {
+	return fread(data, 1, size, f) == size;
+}
+
+static void printEvent(FILE* out, bool& first, const Event& e, uint64_t tid,
+		int64_t base, const std::vector<std::string>& names) {
+	double ts = (e.time - base) / 1000.0; // micros
+	const char* name = (e.name > 0 && e.name < (int)names.size()) ? names[e.name].c_str() : "filter";
+
+	fprintf(out, first ? "\n" : ",\n");
+	first = false;
+
+	switch (e.type) {
+	case ACCEPT:
+		fprintf(out, "{\"name\":\"accept\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%llu,"
+				"\"args\":{\"session\":%d,\"fd\":%lld}}", ts, (unsigned long long)tid, e.session, (long long)e.arg);
+		break;
+	case SESSION_CREATED:
+	case SESSION_CLOSED:
+		fprintf(out, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%llu,"
+				"\"args\":{\"session\":%d}}", (e.type == SESSION_CREATED) ? "session created" : "session closed",
+				ts, (unsigned long long)tid, e.session);
+		break;
+	case READ:
+	case WRITE:
+		// the event is recorded when the syscall returned.
+		fprintf(out, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%llu,"
+				"\"args\":{\"session\":%d,\"bytes\":%lld}}", (e.type == READ) ? "read" : "write",
+				ts - e.duration / 1000.0, e.duration / 1000.0, (unsigned long long)tid, e.session, (long long)e.arg);
+		break;
+	case FILTER_ENTER:
+	case FILTER_EXIT:
+		fprintf(out, "{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%llu,"
+				"\"args\":{\"session\":%d}}", name, (e.type == FILTER_ENTER) ? "B" : "E",
+				ts, (unsigned long long)tid, e.session);
+		break;
+	case STREAM_START:
+	case STREAM_END:
+		// the stream ids count per session.
+		fprintf(out, "{\"name\":\"http stream\",\"cat\":\"http\",\"ph\":\"%s\",\"id\":\"%d.%lld\",\"ts\":%.3f,"
+				"\"pid\":1,\"tid\":%llu,\"args\":{\"session\":%d}}", (e.type == STREAM_START) ? "b" : "e",
+				e.session, (long long)e.arg, ts, (unsigned long long)tid, e.session);
+		break;
+	default:
+		break;
+	}
+}
+
+int main(int argc, const char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <dump file> [<output json>]\n", argv[0]);
+		return 1;
+	}
+
+	FILE* f = fopen(argv[1], "rb");
+	if (!f) {
+		fprintf(stderr, "open %s failed.\n", argv[1]);
+		return 1;
+	}
+
+	char magic[8];
+	uint32_t version, nameCount;
+	if (!readFully(f, magic, 8) || memcmp(magic, "NAFTRACE", 8) != 0
+			|| !readFully(f, &version, 4) || version != 1
+			|| !readFully(f, &nameCount, 4)) {
+		fprintf(stderr, "bad trace file.\n");
+		return 1;
+	}
+
+	std::vector<std::string> names;
+	for (uint32_t i = 0; i < nameCount; i++) {
+		uint16_t len;
+		if (!readFully(f, &len, 2)) return 1;
+		std::string s(len, '\0');
+		if (len > 0 && !readFully(f, &s[0], len)) return 1;
+		names.push_back(s);
+	}
+
+	uint32_t ringCount;
+	if (!readFully(f, &ringCount, 4)) return 1;
+
+	struct Ring {
+		uint64_t tid;
+		std::vector<Event> events;
+	};
+	std::vector<Ring> rings;
+	int64_t base = INT64_MAX;
+
+	for (uint32_t r = 0; r < ringCount; r++) {
+		Ring ring;
+		uint32_t capacity;
+		uint64_t head;
+		if (!readFully(f, &ring.tid, 8) || !readFully(f, &capacity, 4) || !readFully(f, &head, 8)) {
+			fprintf(stderr, "truncated trace file.\n");
+			return 1;
+		}
+		std::vector<Event> slots(capacity);
+		if (capacity > 0 && !readFully(f, &slots[0], sizeof(Event) * capacity)) {
+			fprintf(stderr, "truncated trace file.\n");
+			return 1;
+		}
+
+		// unroll the ring, oldest first.
+		uint64_t count = std::min<uint64_t>(head, capacity);
+		for (uint64_t i = head - count; i < head; i++) {
+			const Event& e = slots[i & (capacity - 1)];
+			if (e.type == 0) continue;
+			ring.events.push_back(e);
+			base = std::min(base, e.time - e.duration);
+		}
+		rings.push_back(ring);
+	}
+	fclose(f);
+
+	FILE* out = (argc > 2) ? fopen(argv[2], "w") : stdout;
+	if (!out) {
+		fprintf(stderr, "open %s failed.\n", argv[2]);
+		return 1;
+	}
+
+	bool first = true;
+	fprintf(out, "{\"traceEvents\":[");
+	for (size_t r = 0; r < rings.size(); r++) {
+		for (size_t i = 0; i < rings[r].events.size(); i++) {
+			printEvent(out, first, rings[r].events[i], rings[r].tid, base, names);
+		}
+	}
+	fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+	if (out != stdout) fclose(out);
+	return 0;
+}